@@ -0,0 +1,477 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "factor.h"
+
+// numbers factored per factor_batch call, batches in flight, and the
+// sizes of the read and write buffers
+#define AEFACTOR_BATCH (1 << 16)
+#define AEFACTOR_SLOTS 3
+#define AEFACTOR_READ_BUFFER (1 << 20)
+#define AEFACTOR_WRITE_BUFFER (1 << 20)
+
+// the most worker threads -t asks for
+#define AEFACTOR_MAX_THREADS 1024
+
+// the longest line one number can produce: itself, and at most 64 prime
+// factors, each with a space, all of at most 20 digits
+#define AEFACTOR_MAX_LINE (22 + 64 * 21)
+
+// numbers come from each named file in turn, or stdin, a buffer at a time
+struct aefactor_input {
+	char **files;
+	int nfiles;
+	int next_file;
+	int fd;
+	const char *name;
+	char *buf;
+	size_t pos;
+	size_t len;
+	int status;
+};
+
+// a batch of numbers on its way from the reader to the writer; each slot
+// of the ring goes free, parsed, factored and free again, and every stage
+// takes the slots in ring order, so batches come out in input order while
+// the next is parsed, one is factored and the last is written
+enum aefactor_state {
+	AEFACTOR_FREE,
+	AEFACTOR_PARSED,
+	AEFACTOR_FACTORED
+};
+
+struct aefactor_slot {
+	uint64_t nums[AEFACTOR_BATCH];
+	size_t n;
+	factor_batch_t results;
+	enum aefactor_state state;
+};
+
+struct aefactor_output {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct aefactor_slot slots[AEFACTOR_SLOTS];
+	struct aefactor_input *in;
+	int read_done;		// no slot will be parsed after the last one
+	int done;			// nor factored
+	int failed;
+	int error;			// errno of the write that failed
+	char *buf;
+	size_t len;
+};
+
+// {{{ static int aefactor_open(struct aefactor_input *in)
+static int aefactor_open(struct aefactor_input *in) {
+
+	// stdin when no files were named, or for -
+	while (in->fd == -1) {
+		if (in->nfiles == 0 && in->next_file == 0) {
+			in->next_file++;
+			in->name = "-";
+			in->fd = STDIN_FILENO;
+		} else if (in->next_file >= in->nfiles) {
+			return 0;
+		} else {
+			in->name = in->files[in->next_file++];
+			if (strcmp(in->name, "-") == 0) {
+				in->fd = STDIN_FILENO;
+			} else if ((in->fd = open(in->name, O_RDONLY)) == -1) {
+				fprintf(stderr, "aefactor: %s: %s\n", in->name, strerror(errno));
+				in->status = 1;
+			}
+		}
+	}
+
+	return 1;
+
+} // }}}
+// {{{ static int aefactor_fill(struct aefactor_input *in)
+static int aefactor_fill(struct aefactor_input *in) {
+
+	ssize_t got;
+
+	// the next buffer of input, moving on through the files at the end of
+	// each; a file boundary ends a number like a space would
+	for (;;) {
+		if (!aefactor_open(in)) {
+			return 0;
+		}
+		if ((got = read(in->fd, in->buf, AEFACTOR_READ_BUFFER)) > 0) {
+			in->pos = 0;
+			in->len = got;
+			return 1;
+		}
+		if (got == -1 && errno == EINTR) {
+			continue;
+		}
+		if (got == -1) {
+			fprintf(stderr, "aefactor: %s: %s\n", in->name, strerror(errno));
+			in->status = 1;
+		}
+		if (in->fd != STDIN_FILENO) {
+			close(in->fd);
+		}
+		in->fd = -1;
+		return 2;
+	}
+
+} // }}}
+// {{{ static int aefactor_next(struct aefactor_input *in, uint64_t *num_r)
+static int aefactor_next(struct aefactor_input *in, uint64_t *num_r) {
+
+	char token[32];
+	size_t length = 0;
+	uint64_t num = 0;
+	int valid = 1, c, filled;
+
+	for (;;) {
+		if (in->pos == in->len) {
+			if ((filled = aefactor_fill(in)) != 1) {
+				if (length != 0 || filled == 0) {
+					break;
+				}
+				continue;
+			}
+		}
+
+		c = (unsigned char) in->buf[in->pos++];
+		if (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f') {
+			if (length != 0) {
+				break;
+			}
+			continue;
+		}
+
+		// decimal digits that fit in a uint64_t; anything else spoils
+		// the whole token, which is kept for the message
+		if (length < sizeof(token) - 1) {
+			token[length] = c;
+		}
+		length++;
+		if (c < '0' || c > '9' || num > (UINT64_MAX - (c - '0')) / 10) {
+			valid = 0;
+		} else {
+			num = 10 * num + (c - '0');
+		}
+	}
+
+	if (length == 0) {
+		return 0;
+	}
+	if (!valid) {
+		token[length < sizeof(token) - 1 ? length : sizeof(token) - 1] = '\0';
+		fprintf(stderr, "aefactor: '%s%s' is not a valid integer below 2^64\n",
+				token, length < sizeof(token) - 1 ? "" : "...");
+		in->status = 1;
+		return 2;
+	}
+
+	*num_r = num;
+	return 1;
+
+} // }}}
+
+// {{{ static char *aefactor_format(uint64_t num, char *p)
+static char *aefactor_format(uint64_t num, char *p) {
+
+	char digits[20];
+	int i = 0;
+
+	do {
+		digits[i++] = '0' + num % 10;
+		num /= 10;
+	} while (num != 0);
+	while (i > 0) {
+		*p++ = digits[--i];
+	}
+
+	return p;
+
+} // }}}
+// {{{ static int aefactor_flush(struct aefactor_output *out)
+static int aefactor_flush(struct aefactor_output *out) {
+
+	const char *p = out->buf;
+	ssize_t written;
+
+	while (out->len > 0) {
+		if ((written = write(STDOUT_FILENO, p, out->len)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += written;
+		out->len -= written;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int aefactor_write(struct aefactor_output *out, struct aefactor_slot *slot)
+static int aefactor_write(struct aefactor_output *out, struct aefactor_slot *slot) {
+
+	const prime_factor_t *factors = slot->results.factors;
+	const size_t *offsets = slot->results.offsets;
+	size_t i, j;
+	uint32_t k;
+	char *p;
+
+	// "n: p p q", a prime repeated as often as it divides n, as factor(1)
+	// prints it
+	for (i = 0; i < slot->n; i++) {
+		if (out->len > AEFACTOR_WRITE_BUFFER - AEFACTOR_MAX_LINE && aefactor_flush(out) == -1) {
+			return -1;
+		}
+		p = aefactor_format(slot->nums[i], out->buf + out->len);
+		*p++ = ':';
+		for (j = offsets[i]; j < offsets[i + 1]; j++) {
+			for (k = 0; k < factors[j].power; k++) {
+				*p++ = ' ';
+				p = aefactor_format(factors[j].prime, p);
+			}
+		}
+		*p++ = '\n';
+		out->len = p - out->buf;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static void *aefactor_writer(void *arg)
+static void *aefactor_writer(void *arg) {
+
+	struct aefactor_output *out = arg;
+	struct aefactor_slot *slot;
+	int next = 0, failed;
+
+	// the slots are written strictly in turn, which keeps input order
+	for (;;) {
+		slot = &out->slots[next];
+		pthread_mutex_lock(&out->lock);
+		while (slot->state != AEFACTOR_FACTORED && !out->done) {
+			pthread_cond_wait(&out->cond, &out->lock);
+		}
+		if (slot->state != AEFACTOR_FACTORED) {
+			pthread_mutex_unlock(&out->lock);
+			break;
+		}
+		pthread_mutex_unlock(&out->lock);
+
+		failed = aefactor_write(out, slot) == -1;
+		factor_batch_free(&slot->results);
+
+		pthread_mutex_lock(&out->lock);
+		slot->state = AEFACTOR_FREE;
+		if (failed && !out->failed) {
+			out->failed = 1;
+			out->error = errno;
+		}
+		pthread_cond_broadcast(&out->cond);
+		pthread_mutex_unlock(&out->lock);
+
+		next = (next + 1) % AEFACTOR_SLOTS;
+	}
+
+	if (aefactor_flush(out) == -1) {
+		pthread_mutex_lock(&out->lock);
+		if (!out->failed) {
+			out->failed = 1;
+			out->error = errno;
+		}
+		pthread_mutex_unlock(&out->lock);
+	}
+
+	return NULL;
+
+} // }}}
+
+// {{{ static void *aefactor_reader(void *arg)
+static void *aefactor_reader(void *arg) {
+
+	struct aefactor_output *out = arg;
+	struct aefactor_slot *slot;
+	int next = 0, got, stop;
+	uint64_t num;
+
+	// parse ahead into free slots until the input runs out, or until the
+	// factoring or the writing gives up
+	for (;;) {
+		slot = &out->slots[next];
+		pthread_mutex_lock(&out->lock);
+		while (slot->state != AEFACTOR_FREE && !out->failed && !out->done) {
+			pthread_cond_wait(&out->cond, &out->lock);
+		}
+		stop = out->failed || out->done;
+		pthread_mutex_unlock(&out->lock);
+		if (stop) {
+			break;
+		}
+
+		for (slot->n = 0; slot->n < AEFACTOR_BATCH && (got = aefactor_next(out->in, &num)) != 0; ) {
+			if (got == 1) {
+				slot->nums[slot->n++] = num;
+			}
+		}
+
+		pthread_mutex_lock(&out->lock);
+		if (slot->n != 0) {
+			slot->state = AEFACTOR_PARSED;
+		}
+		stop = slot->n < AEFACTOR_BATCH;
+		pthread_cond_broadcast(&out->cond);
+		pthread_mutex_unlock(&out->lock);
+		if (stop) {
+			break;
+		}
+
+		next = (next + 1) % AEFACTOR_SLOTS;
+	}
+
+	pthread_mutex_lock(&out->lock);
+	out->read_done = 1;
+	pthread_cond_broadcast(&out->cond);
+	pthread_mutex_unlock(&out->lock);
+
+	return NULL;
+
+} // }}}
+// {{{ static int aefactor_run(prime_ctx_t *pctx, struct aefactor_output *out)
+static int aefactor_run(prime_ctx_t *pctx, struct aefactor_output *out) {
+
+	struct aefactor_slot *slot;
+	int current = 0, ready;
+
+	// factor each slot once the reader has parsed it and hand it on to
+	// the writer; a write error stops everything, and is reported once
+	// the writer has finished
+	for (;;) {
+		slot = &out->slots[current];
+		pthread_mutex_lock(&out->lock);
+		while (slot->state != AEFACTOR_PARSED && !out->read_done && !out->failed) {
+			pthread_cond_wait(&out->cond, &out->lock);
+		}
+		ready = slot->state == AEFACTOR_PARSED && !out->failed;
+		pthread_mutex_unlock(&out->lock);
+		if (!ready) {
+			break;
+		}
+
+		if (factor_batch(pctx, slot->nums, slot->n, NULL, &slot->results) == -1) {
+			fprintf(stderr, "aefactor: %s\n", strerror(errno));
+			return -1;
+		}
+
+		pthread_mutex_lock(&out->lock);
+		slot->state = AEFACTOR_FACTORED;
+		pthread_cond_broadcast(&out->cond);
+		pthread_mutex_unlock(&out->lock);
+
+		current = (current + 1) % AEFACTOR_SLOTS;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static void aefactor_usage(void)
+static void aefactor_usage(void) {
+
+	fprintf(stderr,
+		"usage: aefactor [-t threads] [file ...]\n"
+		"\n"
+		"Prints the prime factors of each number read from the files, or from\n"
+		"standard input, one line per number in input order.\n"
+		"\n"
+		"  -t threads  worker threads, up to 1024, or 0 (the default) for one per CPU\n");
+
+} // }}}
+// {{{ int main(int argc, char **argv)
+int main(int argc, char **argv) {
+
+	struct aefactor_input in;
+	struct aefactor_output *out;
+	unsigned int threads = 0;
+	unsigned long value;
+	prime_ctx_t *pctx;
+	pthread_t reader, writer;
+	int opt, status;
+	char *end;
+
+	while ((opt = getopt(argc, argv, "t:h")) != -1) {
+		switch (opt) {
+		case 't':
+			// digits only: strtoul would take a sign or leading space
+			errno = 0;
+			value = strtoul(optarg, &end, 10);
+			if (*optarg < '0' || *optarg > '9' || *end != '\0' || errno != 0
+					|| value > AEFACTOR_MAX_THREADS) {
+				fprintf(stderr, "aefactor: invalid thread count '%s'\n", optarg);
+				aefactor_usage();
+				return 2;
+			}
+			threads = value;
+			break;
+		default:
+			aefactor_usage();
+			return opt == 'h' ? 0 : 2;
+		}
+	}
+
+	// the factor_batch workers are the threads of pctx
+	if ((pctx = prime_ctx_new_threads(threads)) == NULL) {
+		fprintf(stderr, "aefactor: %s\n", strerror(errno));
+		return 2;
+	}
+
+	memset(&in, 0, sizeof(struct aefactor_input));
+	in.files = argv + optind;
+	in.nfiles = argc - optind;
+	in.fd = -1;
+	in.buf = malloc(AEFACTOR_READ_BUFFER);
+	if ((out = calloc(1, sizeof(struct aefactor_output))) == NULL || in.buf == NULL
+			|| (out->buf = malloc(AEFACTOR_WRITE_BUFFER)) == NULL) {
+		fprintf(stderr, "aefactor: %s\n", strerror(errno));
+		return 2;
+	}
+	out->in = &in;
+	pthread_mutex_init(&out->lock, NULL);
+	pthread_cond_init(&out->cond, NULL);
+	if (pthread_create(&reader, NULL, aefactor_reader, out) != 0
+			|| pthread_create(&writer, NULL, aefactor_writer, out) != 0) {
+		fprintf(stderr, "aefactor: cannot start the reader and writer threads\n");
+		return 2;
+	}
+
+	status = aefactor_run(pctx, out) == -1 ? 2 : 0;
+
+	pthread_mutex_lock(&out->lock);
+	out->done = 1;
+	pthread_cond_broadcast(&out->cond);
+	pthread_mutex_unlock(&out->lock);
+	pthread_join(reader, NULL);
+	pthread_join(writer, NULL);
+	if (status == 0) {
+		status = in.status;
+	}
+	if (out->failed) {
+		fprintf(stderr, "aefactor: write error: %s\n", strerror(out->error));
+		status = 2;
+	}
+
+	pthread_mutex_destroy(&out->lock);
+	pthread_cond_destroy(&out->cond);
+	free(out->buf);
+	free(out);
+	free(in.buf);
+	prime_ctx_free(pctx);
+
+	return status;
+
+} // }}}
+
+// vim: fdm=marker ts=4
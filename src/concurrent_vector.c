@@ -0,0 +1,224 @@
+#include "concurrent_vector.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simple_vector.h"
+
+// Segment k holds CONCURRENT_VECTOR_BASE << k elements followed by one
+// ready byte per element, so offsets map to segments with a single bit
+// scan and a segment, once allocated, never moves.
+#define CONCURRENT_VECTOR_BASE_BITS 10
+#define CONCURRENT_VECTOR_BASE ((size_t) 1 << CONCURRENT_VECTOR_BASE_BITS)
+#define CONCURRENT_VECTOR_SEGMENTS (sizeof(size_t) * 8 - CONCURRENT_VECTOR_BASE_BITS)
+
+struct concurrent_vector {
+
+	size_t elem_size;
+	simple_vector_allocator_t allocator;
+
+	atomic_size_t reserved;		// slots handed out to appenders
+	atomic_size_t published;	// slots known to be completely written
+
+	_Atomic(unsigned char *) segments[CONCURRENT_VECTOR_SEGMENTS];
+
+};
+
+// {{{ static void concurrent_vector_locate(size_t offset, size_t *segment_r, size_t *index_r)
+static void
+concurrent_vector_locate(size_t offset, size_t *segment_r, size_t *index_r)
+{
+	size_t biased = offset + CONCURRENT_VECTOR_BASE;
+	size_t high = sizeof(size_t) * 8 - 1 - __builtin_clzl(biased);
+
+	*segment_r = high - CONCURRENT_VECTOR_BASE_BITS;
+	*index_r = biased - ((size_t) 1 << high);
+
+} // }}}
+// {{{ static unsigned char *concurrent_vector_segment(concurrent_vector_t *cv, size_t segment)
+static unsigned char *
+concurrent_vector_segment(concurrent_vector_t *cv, size_t segment)
+{
+	unsigned char *seg, *expected = NULL;
+	size_t count = CONCURRENT_VECTOR_BASE << segment, size;
+
+	if ((seg = atomic_load_explicit(&cv->segments[segment], memory_order_acquire)) != NULL) {
+		return seg;
+	}
+
+	if (cv->elem_size >= SIZE_MAX / count) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	// racing allocators both build a segment, the loser frees its own
+	size = count * (cv->elem_size + 1);
+	if ((seg = cv->allocator.alloc(cv->allocator.ctx, size)) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(seg, 0, size);
+	if (!atomic_compare_exchange_strong_explicit(&cv->segments[segment], &expected, seg,
+			memory_order_acq_rel, memory_order_acquire)) {
+		cv->allocator.free(cv->allocator.ctx, seg, size);
+		seg = expected;
+	}
+
+	return seg;
+
+} // }}}
+
+// {{{ concurrent_vector_t *concurrent_vector_new(size_t elem_size)
+concurrent_vector_t *
+concurrent_vector_new(size_t elem_size)
+{
+	return concurrent_vector_new_allocator(elem_size, simple_vector_default_allocator());
+} // }}}
+// {{{ concurrent_vector_t *concurrent_vector_new_allocator(size_t elem_size, const simple_vector_allocator_t *allocator)
+concurrent_vector_t *
+concurrent_vector_new_allocator(size_t elem_size, const simple_vector_allocator_t *allocator)
+{
+	concurrent_vector_t *cv;
+	size_t i;
+
+	if (elem_size == 0 || allocator == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if ((cv = allocator->alloc(allocator->ctx, sizeof(concurrent_vector_t))) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	cv->elem_size = elem_size;
+	cv->allocator = *allocator;
+	atomic_init(&cv->reserved, 0);
+	atomic_init(&cv->published, 0);
+	for (i = 0; i < CONCURRENT_VECTOR_SEGMENTS; i++) {
+		atomic_init(&cv->segments[i], NULL);
+	}
+
+	return cv;
+
+} // }}}
+// {{{ void concurrent_vector_free(concurrent_vector_t *cv)
+void
+concurrent_vector_free(concurrent_vector_t *cv)
+{
+	simple_vector_allocator_t allocator;
+	unsigned char *seg;
+	size_t i;
+
+	if (cv != NULL) {
+		allocator = cv->allocator;
+		for (i = 0; i < CONCURRENT_VECTOR_SEGMENTS; i++) {
+			if ((seg = atomic_load_explicit(&cv->segments[i], memory_order_relaxed)) != NULL) {
+				allocator.free(allocator.ctx, seg,
+						(CONCURRENT_VECTOR_BASE << i) * (cv->elem_size + 1));
+			}
+		}
+		allocator.free(allocator.ctx, cv, sizeof(concurrent_vector_t));
+	}
+
+} // }}}
+
+// {{{ int concurrent_vector_append(concurrent_vector_t *cv, void *elem, size_t *offset_r)
+int
+concurrent_vector_append(concurrent_vector_t *cv, void *elem, size_t *offset_r)
+{
+	size_t offset, segment, index, count, expected;
+	unsigned char *seg;
+
+	// claim a slot, nobody else will ever write it
+	offset = atomic_fetch_add_explicit(&cv->reserved, 1, memory_order_relaxed);
+	concurrent_vector_locate(offset, &segment, &index);
+
+	// readers wait on a claimed slot until it is written, so one whose
+	// segment cannot be allocated is handed back while it is the latest
+	// claim, and otherwise tried again until either its segment turns up
+	// or the claims after it have been handed back in turn
+	while ((seg = concurrent_vector_segment(cv, segment)) == NULL) {
+		expected = offset + 1;
+		if (atomic_compare_exchange_strong_explicit(&cv->reserved, &expected, offset,
+				memory_order_relaxed, memory_order_relaxed)) {
+			return -1;
+		}
+		sched_yield();
+	}
+
+	// fill the slot, then flag it ready for readers
+	count = CONCURRENT_VECTOR_BASE << segment;
+	memcpy(seg + index * cv->elem_size, elem, cv->elem_size);
+	atomic_store_explicit((_Atomic unsigned char *) (seg + count * cv->elem_size + index), 1,
+			memory_order_release);
+
+	if (offset_r != NULL) {
+		*offset_r = offset;
+	}
+	return 0;
+
+} // }}}
+// {{{ size_t concurrent_vector_size(concurrent_vector_t *cv)
+size_t
+concurrent_vector_size(concurrent_vector_t *cv)
+{
+	size_t start, end, reserved, segment, index;
+	unsigned char *seg;
+
+	start = atomic_load_explicit(&cv->published, memory_order_acquire);
+	reserved = atomic_load_explicit(&cv->reserved, memory_order_relaxed);
+
+	// walk forward over slots whose writers have finished
+	for (end = start; end < reserved; end++) {
+		concurrent_vector_locate(end, &segment, &index);
+		seg = atomic_load_explicit(&cv->segments[segment], memory_order_acquire);
+		if (seg == NULL || atomic_load_explicit((_Atomic unsigned char *) (seg
+				+ (CONCURRENT_VECTOR_BASE << segment) * cv->elem_size + index),
+				memory_order_acquire) == 0) {
+			break;
+		}
+	}
+
+	// share the progress, published only ever moves forward
+	while (start < end && !atomic_compare_exchange_weak_explicit(&cv->published, &start, end,
+			memory_order_acq_rel, memory_order_acquire)) {
+	}
+
+	return start > end ? start : end;
+
+} // }}}
+
+// {{{ void *concurrent_vector_at(concurrent_vector_t *cv, size_t offset)
+void *
+concurrent_vector_at(concurrent_vector_t *cv, size_t offset)
+{
+	size_t segment, index;
+
+	if (offset >= concurrent_vector_size(cv)) {
+		return NULL;
+	}
+
+	concurrent_vector_locate(offset, &segment, &index);
+	return atomic_load_explicit(&cv->segments[segment], memory_order_acquire)
+		+ index * cv->elem_size;
+
+} // }}}
+// {{{ int concurrent_vector_get(concurrent_vector_t *cv, size_t offset, void *elem)
+int
+concurrent_vector_get(concurrent_vector_t *cv, size_t offset, void *elem)
+{
+	void *slot;
+
+	if ((slot = concurrent_vector_at(cv, offset)) == NULL) {
+		return -1;
+	}
+
+	memcpy(elem, slot, cv->elem_size);
+	return 0;
+
+} // }}}
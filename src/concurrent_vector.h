@@ -0,0 +1,32 @@
+#ifndef CONCURRENT_VECTOR_H
+#define CONCURRENT_VECTOR_H
+
+#include <sys/types.h>
+
+#include "simple_vector.h"
+
+// An append-only vector for many concurrent producers. Appends are
+// lock-free apart from the first touch of each segment, elements never
+// move once written, and concurrent_vector_size gives readers a prefix
+// that is completely written and safe to read without locking.
+struct concurrent_vector;
+typedef struct concurrent_vector concurrent_vector_t;
+
+concurrent_vector_t *concurrent_vector_new(size_t elem_size);
+// as concurrent_vector_new, segments come from (a copy of) *allocator
+concurrent_vector_t *concurrent_vector_new_allocator(size_t elem_size,
+		const simple_vector_allocator_t *allocator);
+void concurrent_vector_free(concurrent_vector_t *cv);
+
+// -1 with errno ENOMEM when the slot's segment cannot be allocated and no
+// later append has claimed a slot yet; otherwise the allocation is retried
+// until it succeeds, so a failed append never leaves a gap below the size
+int concurrent_vector_append(concurrent_vector_t *cv, void *elem, size_t *offset_r);
+
+// every element below the returned size is published
+size_t concurrent_vector_size(concurrent_vector_t *cv);
+
+int concurrent_vector_get(concurrent_vector_t *cv, size_t offset, void *elem);
+void *concurrent_vector_at(concurrent_vector_t *cv, size_t offset);
+
+#endif
@@ -1,14 +1,137 @@
 #include "factor.h"
 
+#include <errno.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#include "factor64.h"
+#include "factor_integer.h"
+#include "prime_table.h"
+#include "typed_vector.h"
+#include "work_pool.h"
+
+// the mod 30 wheel: the residues coprime to 30 in order
+static const unsigned char wheel_residues[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+
+// one sieve segment: a byte per 30 numbers, one bit per wheel residue;
+// 32 KiB keeps the whole segment in L1 while primes are crossed off it
+#define PRIME_CTX_SEGMENT_BYTES 32768
+
+// segments handed to each thread per parallel batch; the batch is merged
+// into the table in order before the next one starts
+#define PRIME_CTX_BATCH_SEGMENTS 4
+
+// a prime >= 7 used for sieving; its multiples p * q with q coprime to 30
+// fall into eight classes (by q mod 30), each of which lands on the same
+// bit of every p-th byte, starting from next[k]
+struct prime_sieve_entry {
+	uint64_t prime;
+	uint64_t next[8];
+	unsigned char mask[8];
+};
+
+// what each worker of a parallel sieve keeps to itself
+struct prime_sieve_scratch {
+	unsigned char *bits;
+	simple_vector_t *entries;
+	int failed;
+};
+
+// one parallel batch: task t sieves the segment starting at byte
+// lo + t * PRIME_CTX_SEGMENT_BYTES and leaves its primes in found[t], as
+// offsets from the start of the segment
+struct prime_sieve_job {
+	prime_ctx_t *ctx;
+	uint64_t lo;
+	uint64_t hi;
+};
+
+// trial division covers the primes below this, factor64_split the rest
+#define FACTOR_CTX_TRIAL_LIMIT 1024
+#define FACTOR_CTX_TRIAL_PRIMES 171
+
+// an odd prime for trial division without dividing: n is a multiple of
+// prime exactly when n * inverse, mod 2^64, is at most limit
+struct factor_trial {
+	uint64_t prime;
+	uint64_t inverse;
+	uint64_t limit;
+};
+
+// numbers per factor_batch task
+#define FACTOR_BATCH_CHUNK 1024
+
+// prime_iter segments grow to this with the range, and stop at the
+// largest prime below 2^64; it sieves with the primes up to
+// PRIME_ITER_SIEVE_LIMIT at most (about 80 MiB of entries), and past its
+// square checks what is left by Miller-Rabin, as the 200 million primes
+// up to 2^32 would take 16 GiB
+#define PRIME_ITER_SEGMENT_BYTES (1 << 20)
+#define PRIME_ITER_MAX 18446744073709551557ULL
+#define PRIME_ITER_SIEVE_LIMIT (1 << 24)
+
+// prime_ctx_count: counts per task, levels smaller than this are not
+// worth the pool, and the largest x a double divides exactly
+#define PRIME_COUNT_CHUNK (1 << 14)
+#define PRIME_COUNT_PARALLEL (1 << 16)
+#define PRIME_COUNT_MAX ((uint64_t) 1 << 53)
+
+// default stage efforts: rho and SQUFOF iterations, and ECM curves
+#define FACTOR_CTX_RHO_ITERATIONS (1 << 16)
+#define FACTOR_CTX_SQUFOF_ITERATIONS (1 << 20)
+#define FACTOR_CTX_ECM_CURVES 64
+
+// integer_factor_ctx trial divides by the primes below this, and sieves
+// the table as far as INTEGER_FACTOR_ECM_PRIMES for ECM on cofactors that
+// are still too big for factor64
+#define INTEGER_FACTOR_TRIAL_LIMIT (1 << 16)
+#define INTEGER_FACTOR_ECM_PRIMES (1 << 22)
+
+TYPED_VECTOR(u64, uint64_t)
+TYPED_VECTOR(u32, uint32_t)
+TYPED_VECTOR(prime_factor, prime_factor_t)
+TYPED_VECTOR(integer_prime_factor, integer_prime_factor_t)
+TYPED_VECTOR(integer, integer_t *)
+TYPED_VECTOR(sieve_entry, struct prime_sieve_entry)
 
 struct prime_ctx {
 
-	simple_vector_t *primes;
+	prime_table_t *primes;
 	uint64_t highest_checked; // contiguous only
 	uint64_t reach;
 
+	simple_vector_t *sieve;		// primes 7 up to sqrt(highest_checked)
+	uint64_t sieved;			// where the sieve entries left off
+
+	// the odd primes factor_ctx trial divides by
+	struct factor_trial trial[FACTOR_CTX_TRIAL_PRIMES];
+	size_t trial_count;
+
+	// parallel sieving, set up on first use when there is a pool
+	work_pool_t *pool;
+	struct prime_sieve_scratch *scratch;
+	simple_vector_t **found;
+
+};
+
+struct prime_iter {
+
+	uint64_t from;
+	uint64_t to;
+
+	simple_vector_t *entries;	// primes 7 up to sqrt(to), at most the limit
+	uint64_t sure;				// what the sieve leaves up to here is prime
+	unsigned char *bits;
+	size_t bytes;
+
+	uint64_t lo;				// first byte of the current segment
+	size_t count;				// bytes in it
+	size_t pos;					// the byte after mask
+	unsigned int mask;			// primes of that byte still to return
+	int small;					// of 2, 3 and 5, how many are done
+
 };
 
 struct factor_ctx {
@@ -17,192 +140,1516 @@ struct factor_ctx {
 	simple_vector_t *factors;
 	uint64_t num;
 
+	factor_effort_t effort;
+
+};
+
+// one round of prime_ctx_count, sieving p out of the counts in [lo, hi]
+// of either array; sp is the count of primes below p
+struct prime_count_job {
+	uint64_t x;
+	uint64_t root;
+	uint64_t *small_counts;		// by v, v <= root
+	uint64_t *large_counts;		// by i, v = x / i
+	uint64_t p;
+	uint64_t sp;
+	int large;
+	uint64_t lo;
+	uint64_t hi;
+};
+
+// one factor_batch: task t factors the numbers from t * FACTOR_BATCH_CHUNK
+// into found[t], leaving how many factors each had in offsets
+struct factor_batch_job {
+	prime_ctx_t *pctx;
+	factor_effort_t effort;
+	const uint64_t *nums;
+	size_t n;
+	size_t *offsets;
+	simple_vector_t **found;
+	atomic_int failed;
+};
+
+struct integer_factor_ctx {
+
+	prime_ctx_t *pctx;
+	simple_vector_t *factors;
+	integer_t *num;
+
+	factor_effort_t effort;
+
 };
 
+// {{{ static void prime_ctx_sieve_teardown(prime_ctx_t *ctx)
+static void prime_ctx_sieve_teardown(prime_ctx_t *ctx) {
+
+	unsigned int i, threads = work_pool_threads(ctx->pool);
+
+	for (i = 0; ctx->scratch != NULL && i < threads; i++) {
+		free(ctx->scratch[i].bits);
+		simple_vector_free(ctx->scratch[i].entries, 0, NULL);
+	}
+	for (i = 0; ctx->found != NULL && i < threads * PRIME_CTX_BATCH_SEGMENTS; i++) {
+		simple_vector_free(ctx->found[i], 0, NULL);
+	}
+
+	free(ctx->scratch);
+	free(ctx->found);
+	ctx->scratch = NULL;
+	ctx->found = NULL;
+
+} // }}}
+
+// {{{ static void prime_ctx_set_highest(prime_ctx_t *ctx, uint64_t highest)
+static void prime_ctx_set_highest(prime_ctx_t *ctx, uint64_t highest) {
+
+	ctx->highest_checked = highest;
+	ctx->reach = highest >= ((uint64_t) 1 << 32) ? UINT64_MAX : highest * highest;
+
+} // }}}
+// {{{ static void prime_ctx_trial_init(prime_ctx_t *ctx)
+static void prime_ctx_trial_init(prime_ctx_t *ctx) {
+
+	struct factor_trial *trial;
+	uint64_t p, d;
+	int i;
+
+	for (p = 3, ctx->trial_count = 0; p < FACTOR_CTX_TRIAL_LIMIT; p += 2) {
+		for (d = 3; d * d <= p && p % d != 0; d += 2) {
+		}
+		if (d * d <= p) {
+			continue;
+		}
+
+		// p is its own inverse mod 8, and each Newton step doubles the
+		// bits that are right
+		trial = &ctx->trial[ctx->trial_count++];
+		trial->prime = p;
+		for (trial->inverse = p, i = 0; i < 5; i++) {
+			trial->inverse *= 2 - p * trial->inverse;
+		}
+		trial->limit = UINT64_MAX / p;
+	}
+
+} // }}}
 // {{{ prime_ctx_t *prime_ctx_new()
 prime_ctx_t *prime_ctx_new() {
+	return prime_ctx_new_threads(1);
+} // }}}
+// {{{ prime_ctx_t *prime_ctx_new_threads(unsigned int threads)
+prime_ctx_t *prime_ctx_new_threads(unsigned int threads) {
 
 	prime_ctx_t *ctx;
 
-	if ((ctx = malloc(sizeof(prime_ctx_t))) == NULL) {
+	if ((ctx = calloc(1, sizeof(prime_ctx_t))) == NULL) {
 		return NULL;
 	}
 
-	if ((ctx->primes = simple_vector_new(16, sizeof(uint64_t))) == NULL) {
+	if (threads != 1 && (ctx->pool = work_pool_new(threads)) == NULL) {
 		prime_ctx_free(ctx);
 		return NULL;
 	}
 
-	uint64_t i;
-	i = 2;
-	simple_vector_append(ctx->primes, &i);
-	i = 3;
-	simple_vector_append(ctx->primes, &i);
+	// the table only ever grows and can get very large, so it is stored
+	// gap encoded at about a byte per prime
+	ctx->primes = prime_table_new();
+	ctx->sieve = sieve_entry_vector_new(16);
+	if (ctx->primes == NULL || ctx->sieve == NULL
+			|| prime_table_append(ctx->primes, 2) == -1
+			|| prime_table_append(ctx->primes, 3) == -1) {
+		prime_ctx_free(ctx);
+		return NULL;
+	}
 
 	ctx->highest_checked = 3;
 	ctx->reach = 9;
+	ctx->sieved = 0;
+	prime_ctx_trial_init(ctx);
+
+	// the primes below 30 by trial division, so the table always holds
+	// 2, 3 and 5 ahead of anything the wheel produces
+	while (ctx->highest_checked < 29) {
+		prime_ctx_check_next(ctx, NULL);
+	}
 	
 	return ctx;
 
 } // }}}
+// {{{ prime_ctx_t *prime_ctx_new_file(const char *path, unsigned int threads)
+prime_ctx_t *prime_ctx_new_file(const char *path, unsigned int threads) {
+
+	prime_ctx_t *ctx;
+	prime_table_t *primes;
+	uint64_t limit;
+
+	if ((primes = prime_table_load(path, &limit)) == NULL) {
+		return NULL;
+	}
+
+	// a saved table holds at least what prime_ctx_new starts with
+	if (limit < 29 || (ctx = prime_ctx_new_threads(threads)) == NULL) {
+		prime_table_free(primes);
+		if (limit < 29) {
+			errno = EINVAL;
+		}
+		return NULL;
+	}
+
+	// the sieve entries are rebuilt from the table on the next segment
+	prime_table_free(ctx->primes);
+	ctx->primes = primes;
+	prime_ctx_set_highest(ctx, limit);
+
+	return ctx;
+
+} // }}}
+// {{{ int prime_ctx_save(prime_ctx_t *ctx, const char *path)
+int prime_ctx_save(prime_ctx_t *ctx, const char *path) {
+	return prime_table_save(ctx->primes, ctx->highest_checked, path);
+} // }}}
 // {{{ void prime_ctx_free(prime_ctx_t *ctx)
 void prime_ctx_free(prime_ctx_t *ctx) {
 
 	if (ctx != NULL) {
-		simple_vector_free(ctx->primes, 0, NULL);
+		if (ctx->pool != NULL) {
+			prime_ctx_sieve_teardown(ctx);
+			work_pool_free(ctx->pool);
+		}
+		prime_table_free(ctx->primes);
+		simple_vector_free(ctx->sieve, 0, NULL);
 		free(ctx);
 	}
 
 } // }}}
 
-// {{{ static int prime_ctx_check_unsafe(prime_ctx_t *ctx, uint64_t num)
-static int prime_ctx_check_unsafe(prime_ctx_t *ctx, uint64_t num) {
+// {{{ static void prime_sieve_entry_init(struct prime_sieve_entry *entry, uint64_t prime, uint64_t start)
+static void prime_sieve_entry_init(struct prime_sieve_entry *entry, uint64_t prime, uint64_t start) {
 
-	size_t i;
-	uint64_t p;
+	uint64_t q, qmin, m;
+	int k;
+
+	// the first multiple to cross off is prime^2, or later if sieving
+	// has already passed it
+	qmin = start / prime + (start % prime != 0);
+	if (qmin < prime) {
+		qmin = prime;
+	}
+
+	entry->prime = prime;
+	for (k = 0; k < 8; k++) {
+		q = qmin + (wheel_residues[k] + 30 - qmin % 30) % 30;
+		if (q > UINT64_MAX / prime) {
+			// past 2^64, which only prime_iter gets near: never reached
+			entry->next[k] = UINT64_MAX / 30 + 1;
+			entry->mask[k] = 0;
+			continue;
+		}
+		m = prime * q;
+		entry->next[k] = m / 30;
+		entry->mask[k] = 1 << ((const unsigned char *) memchr(wheel_residues, m % 30, 8) - wheel_residues);
+	}
 
-	for (i = 0; i < simple_vector_size(ctx->primes); i++) {
-		simple_vector_get(ctx->primes, i, &p);
+} // }}}
+// {{{ static void prime_ctx_align(prime_ctx_t *ctx)
+static void prime_ctx_align(prime_ctx_t *ctx) {
+
+	// segments start on a wheel turn; single steps by
+	// prime_ctx_check_next may have left us part way through one
+	while ((ctx->highest_checked + 1) % 30 != 0) {
+		prime_ctx_check_next(ctx, NULL);
+	}
+
+} // }}}
+// {{{ static uint64_t prime_ctx_last_byte(prime_ctx_t *ctx)
+static uint64_t prime_ctx_last_byte(prime_ctx_t *ctx) {
+
+	// the last sieve byte the known primes are enough for
+	return ctx->reach == UINT64_MAX ? UINT64_MAX / 30 - 1 : (ctx->reach + 1) / 30 - 1;
+
+} // }}}
+// {{{ static int prime_ctx_sieve_primes(prime_ctx_t *ctx, uint64_t hi, uint64_t start)
+static int prime_ctx_sieve_primes(prime_ctx_t *ctx, uint64_t hi, uint64_t start) {
+
+	struct prime_sieve_entry entry;
+	uint64_t prime;
+	size_t index;
 
-		if (p * p > num) {
+	// bring in the primes that now have squares up to hi; the table
+	// starts 2, 3, 5, which the wheel already excludes
+	for (index = sieve_entry_vector_size(ctx->sieve) + 3; index < prime_table_size(ctx->primes); index++) {
+		prime = prime_table_at(ctx->primes, index);
+		if (prime * prime > hi) {
 			break;
 		}
+		prime_sieve_entry_init(&entry, prime, start);
+		if (sieve_entry_vector_append(ctx->sieve, entry) == -1) {
+			return -1;
+		}
+	}
 
-		if (num % p == 0) {
-			return 0;
+	return 0;
+
+} // }}}
+// {{{ static void prime_sieve_cross(unsigned char *bits, uint64_t lo, size_t bytes, struct prime_sieve_entry *sieve, size_t count)
+static void prime_sieve_cross(unsigned char *bits, uint64_t lo, size_t bytes,
+		struct prime_sieve_entry *sieve, size_t count) {
+
+	uint64_t b;
+	size_t i;
+	int k;
+
+	memset(bits, 0, bytes);
+
+	for (i = 0; i < count; i++) {
+		for (k = 0; k < 8; k++) {
+			for (b = sieve[i].next[k] - lo; b < bytes; b += sieve[i].prime) {
+				bits[b] |= sieve[i].mask[k];
+			}
+			sieve[i].next[k] = lo + b;
 		}
+	}
+
+} // }}}
+// {{{ static int prime_sieve_collect(const unsigned char *bits, size_t bytes, simple_vector_t *found)
+static int prime_sieve_collect(const unsigned char *bits, size_t bytes, simple_vector_t *found) {
+
+	unsigned int byte;
+	size_t i;
 
+	// whatever is left uncrossed is prime
+	simple_vector_clear(found);
+	for (i = 0; i < bytes; i++) {
+		for (byte = ~bits[i] & 0xff; byte != 0; byte &= byte - 1) {
+			if (u32_vector_append(found, 30 * i + wheel_residues[__builtin_ctz(byte)]) == -1) {
+				return -1;
+			}
+		}
 	}
 
-	return 1;
-	
+	return 0;
+
 } // }}}
-// {{{ int prime_ctx_check(prime_ctx_t *ctx, uint64_t num) 
-int prime_ctx_check(prime_ctx_t *ctx, uint64_t num) {
+// {{{ static int prime_ctx_merge(prime_ctx_t *ctx, uint64_t lo, simple_vector_t *found)
+static int prime_ctx_merge(prime_ctx_t *ctx, uint64_t lo, simple_vector_t *found) {
 
-	while (num > ctx->reach) {
-		prime_ctx_check_next(ctx, NULL);
+	uint32_t *offsets = u32_vector_data(found);
+	size_t i, count = u32_vector_size(found);
+
+	for (i = 0; i < count; i++) {
+		if (prime_table_append(ctx->primes, 30 * lo + offsets[i]) == -1) {
+			return -1;
+		}
 	}
 
-	return prime_ctx_check_unsafe(ctx, num);
+	return 0;
+
 } // }}}
-// {{{ int prime_ctx_check_next(prime_ctx_t *ctx, uint64_t *num_r) 
-int prime_ctx_check_next(prime_ctx_t *ctx, uint64_t *num_r) {
+// {{{ static int prime_ctx_sieve_segment(prime_ctx_t *ctx)
+static int prime_ctx_sieve_segment(prime_ctx_t *ctx) {
 
-	if (num_r != NULL) {
-		*num_r = ctx->highest_checked + 1;
+	unsigned char bits[PRIME_CTX_SEGMENT_BYTES];
+	struct prime_sieve_entry *sieve;
+	simple_vector_t *found;
+	size_t i, count, bytes;
+	uint64_t lo, hi;
+	int result;
+
+	prime_ctx_align(ctx);
+
+	// never past what the known primes can sieve
+	lo = (ctx->highest_checked + 1) / 30;
+	hi = lo + PRIME_CTX_SEGMENT_BYTES - 1;
+	if (hi > prime_ctx_last_byte(ctx)) {
+		hi = prime_ctx_last_byte(ctx);
 	}
-	
-	ctx->highest_checked += 1;
-	ctx->reach = ctx->highest_checked * ctx->highest_checked;
+	bytes = hi - lo + 1;
 
-	int result = prime_ctx_check_unsafe(ctx, ctx->highest_checked);
+	// catch the entries up if the sieve did not do the last stretch
+	sieve = sieve_entry_vector_data(ctx->sieve);
+	count = sieve_entry_vector_size(ctx->sieve);
+	if (ctx->sieved != ctx->highest_checked) {
+		for (i = 0; i < count; i++) {
+			prime_sieve_entry_init(&sieve[i], sieve[i].prime, 30 * lo);
+		}
+	}
 
-	if (result) {
-		simple_vector_append(ctx->primes, &ctx->highest_checked);
+	if (prime_ctx_sieve_primes(ctx, 30 * hi + 29, 30 * lo) == -1) {
+		return -1;
 	}
 
-	return result;
+	prime_sieve_cross(bits, lo, bytes, sieve_entry_vector_data(ctx->sieve),
+			sieve_entry_vector_size(ctx->sieve));
+
+	if ((found = u32_vector_new(bytes)) == NULL) {
+		return -1;
+	}
+	result = prime_sieve_collect(bits, bytes, found) == -1 ? -1 : prime_ctx_merge(ctx, lo, found);
+	simple_vector_free(found, 0, NULL);
+	if (result == -1) {
+		return -1;
+	}
+
+	prime_ctx_set_highest(ctx, 30 * hi + 29);
+	ctx->sieved = ctx->highest_checked;
+	return 0;
 
 } // }}}
+// {{{ static void prime_sieve_task(void *arg, size_t task, unsigned int worker)
+static void prime_sieve_task(void *arg, size_t task, unsigned int worker) {
 
-// {{{ factor_ctx_t *factor_ctx_new(prime_ctx_t *pctx, uint64_t num)
-factor_ctx_t *factor_ctx_new(prime_ctx_t *pctx, uint64_t num) {
+	struct prime_sieve_job *job = arg;
+	struct prime_sieve_scratch *scratch = &job->ctx->scratch[worker];
+	struct prime_sieve_entry *shared, *entries;
+	uint64_t lo = job->lo + task * PRIME_CTX_SEGMENT_BYTES;
+	size_t i, count, bytes;
 
-	factor_ctx_t *ctx;
+	bytes = job->hi - lo + 1 < PRIME_CTX_SEGMENT_BYTES ? job->hi - lo + 1 : PRIME_CTX_SEGMENT_BYTES;
 
-	if ((ctx = malloc(sizeof(factor_ctx_t))) == NULL) {
-		return NULL;
+	// the shared entries are only read; each segment starts its own
+	// multiples from scratch
+	shared = sieve_entry_vector_data(job->ctx->sieve);
+	count = sieve_entry_vector_size(job->ctx->sieve);
+	if (simple_vector_reserve(scratch->entries, count) == -1) {
+		scratch->failed = 1;
+		return;
 	}
-
-	if ((ctx->factors = simple_vector_new(16, sizeof(prime_factor_t))) == NULL) {
-		factor_ctx_free(ctx);
-		return NULL;
+	entries = sieve_entry_vector_data(scratch->entries);
+	for (i = 0; i < count; i++) {
+		prime_sieve_entry_init(&entries[i], shared[i].prime, 30 * lo);
 	}
-	
-	ctx->pctx = pctx;
-	ctx->num = num;
 
-	return ctx;
+	prime_sieve_cross(scratch->bits, lo, bytes, entries, count);
+	if (prime_sieve_collect(scratch->bits, bytes, job->ctx->found[task]) == -1) {
+		scratch->failed = 1;
+	}
 
 } // }}}
-// {{{ void factor_ctx_free(factor_ctx_t *ctx) 
-void factor_ctx_free(factor_ctx_t *ctx) {
-	
-	if (ctx != NULL) {
-		simple_vector_free(ctx->factors, 0, NULL);
-		free(ctx);
+// {{{ static int prime_ctx_sieve_setup(prime_ctx_t *ctx)
+static int prime_ctx_sieve_setup(prime_ctx_t *ctx) {
+
+	unsigned int i, threads = work_pool_threads(ctx->pool);
+
+	if (ctx->scratch != NULL) {
+		return 0;
 	}
 
+	ctx->scratch = calloc(threads, sizeof(struct prime_sieve_scratch));
+	ctx->found = calloc(threads * PRIME_CTX_BATCH_SEGMENTS, sizeof(simple_vector_t *));
+	if (ctx->scratch == NULL || ctx->found == NULL) {
+		prime_ctx_sieve_teardown(ctx);
+		return -1;
+	}
+
+	for (i = 0; i < threads; i++) {
+		ctx->scratch[i].bits = malloc(PRIME_CTX_SEGMENT_BYTES);
+		ctx->scratch[i].entries = sieve_entry_vector_new(16);
+		if (ctx->scratch[i].bits == NULL || ctx->scratch[i].entries == NULL) {
+			prime_ctx_sieve_teardown(ctx);
+			return -1;
+		}
+	}
+	for (i = 0; i < threads * PRIME_CTX_BATCH_SEGMENTS; i++) {
+		if ((ctx->found[i] = u32_vector_new(16)) == NULL) {
+			prime_ctx_sieve_teardown(ctx);
+			return -1;
+		}
+	}
+
+	return 0;
+
 } // }}}
+// {{{ static int prime_ctx_sieve_batch(prime_ctx_t *ctx, uint64_t limit)
+static int prime_ctx_sieve_batch(prime_ctx_t *ctx, uint64_t limit) {
 
-// {{{ void factor_ctx_finish(factor_ctx_t *ctx)
-void factor_ctx_finish(factor_ctx_t *ctx) {
+	unsigned int i, threads = work_pool_threads(ctx->pool);
+	struct prime_sieve_job job;
+	size_t task, tasks;
 
-	// FIXME: this shouldn't preset all of the primes
-	// that is, we should make the prime iteration and the factorisation iterations concurrent
+	prime_ctx_align(ctx);
 
-	// ensure the reach is good enough
-	while (ctx->pctx->reach < ctx->num) {
-		prime_ctx_check_next(ctx->pctx, NULL);
+	job.ctx = ctx;
+	job.lo = (ctx->highest_checked + 1) / 30;
+	job.hi = job.lo + (uint64_t) threads * PRIME_CTX_BATCH_SEGMENTS * PRIME_CTX_SEGMENT_BYTES - 1;
+	if (job.hi > limit / 30) {
+		job.hi = limit / 30;
 	}
-	
-	prime_factor_t pf;
-	size_t i;
+	if (job.hi > prime_ctx_last_byte(ctx)) {
+		job.hi = prime_ctx_last_byte(ctx);
+	}
+	tasks = (job.hi - job.lo) / PRIME_CTX_SEGMENT_BYTES + 1;
 
-	uint64_t remaining = ctx->num;
+	if (prime_ctx_sieve_setup(ctx) == -1
+			|| prime_ctx_sieve_primes(ctx, 30 * job.hi + 29, 30 * job.lo) == -1) {
+		return -1;
+	}
 
-	for (i = 0; i < simple_vector_size(ctx->pctx->primes); i++) {
+	work_pool_run(ctx->pool, tasks, prime_sieve_task, &job);
 
-		simple_vector_get(ctx->pctx->primes, i, &pf.prime);
-		pf.power = 0;
+	for (i = 0; i < threads; i++) {
+		if (ctx->scratch[i].failed) {
+			ctx->scratch[i].failed = 0;
+			return -1;
+		}
+	}
 
-		while (remaining % pf.prime == 0) {
-			pf.power += 1;
-			remaining /= pf.prime;
+	// in order, so the table stays sorted
+	for (task = 0; task < tasks; task++) {
+		if (prime_ctx_merge(ctx, job.lo + task * PRIME_CTX_SEGMENT_BYTES, ctx->found[task]) == -1) {
+			return -1;
 		}
+	}
 
-		if (pf.power != 0) {
-			simple_vector_append(ctx->factors, &pf);
-			printf("%llu ^ %lu\n", pf.prime, pf.power);
-		} else if (pf.prime * pf.prime > remaining) {
-			break;
+	prime_ctx_set_highest(ctx, 30 * job.hi + 29);
+	return 0;
+
+} // }}}
+// {{{ int prime_ctx_grow(prime_ctx_t *ctx, uint64_t limit)
+int prime_ctx_grow(prime_ctx_t *ctx, uint64_t limit) {
+
+	int result;
+
+	while (ctx->highest_checked < limit) {
+		// batches in parallel once the table can sieve a whole one,
+		// single segments while it cannot
+		if (ctx->pool != NULL && limit / 30 - (ctx->highest_checked + 1) / 30
+				>= (uint64_t) work_pool_threads(ctx->pool) * PRIME_CTX_SEGMENT_BYTES
+				&& prime_ctx_last_byte(ctx) - (ctx->highest_checked + 1) / 30
+				>= (uint64_t) work_pool_threads(ctx->pool) * PRIME_CTX_SEGMENT_BYTES) {
+			result = prime_ctx_sieve_batch(ctx, limit);
+		} else {
+			result = prime_ctx_sieve_segment(ctx);
 		}
+		if (result == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int prime_iter_sieve(prime_iter_t *it)
+static int prime_iter_sieve(prime_iter_t *it) {
+
+	uint64_t last = it->to / 30;
 
+	// the next segment, cut short at the end of the range
+	it->lo += it->count;
+	if (it->lo > last || it->to < it->from) {
+		return 0;
 	}
+	it->count = last - it->lo + 1 < it->bytes ? last - it->lo + 1 : it->bytes;
+	it->pos = 0;
 
-	if (remaining != 1) {
-		pf.prime = remaining;
-		pf.power = 1;
-		simple_vector_append(ctx->factors, &pf);
+	prime_sieve_cross(it->bits, it->lo, it->count, sieve_entry_vector_data(it->entries),
+			sieve_entry_vector_size(it->entries));
+
+	return 1;
+
+} // }}}
+// {{{ void prime_iter_skip(prime_iter_t *it, uint64_t from)
+void prime_iter_skip(prime_iter_t *it, uint64_t from) {
+
+	struct prime_sieve_entry *entries = sieve_entry_vector_data(it->entries);
+	size_t i, count = sieve_entry_vector_size(it->entries);
+
+	// start over from the wheel turn holding from, in either direction
+	it->from = from;
+	it->lo = from / 30;
+	it->count = 0;
+	it->pos = 0;
+	it->mask = 0;
+	it->small = 0;
+
+	for (i = 0; i < count; i++) {
+		prime_sieve_entry_init(&entries[i], entries[i].prime, 30 * it->lo);
 	}
 
 } // }}}
+// {{{ prime_iter_t *prime_iter_new(prime_ctx_t *ctx, uint64_t from, uint64_t to)
+prime_iter_t *prime_iter_new(prime_ctx_t *ctx, uint64_t from, uint64_t to) {
 
-// {{{ void factor_ctx_print(factor_ctx_t *ctx)
-void factor_ctx_print(factor_ctx_t *ctx) {
+	struct prime_sieve_entry entry;
+	prime_table_iter_t pit;
+	prime_iter_t *it;
+	uint64_t p, root;
+	size_t count;
 
-	printf("%llu =", ctx->num);
-	
-	size_t i;
-	prime_factor_t pf;
-	for (i = 0; i < simple_vector_size(ctx->factors) - 1; i++) {
-		
-		simple_vector_get(ctx->factors, i, &pf);
+	if ((it = calloc(1, sizeof(prime_iter_t))) == NULL) {
+		return NULL;
+	}
 
-		if (pf.power == 1) {
-			printf(" %llu *", pf.prime);
-		} else {
-			printf(" %llu^%lu *", pf.prime, pf.power);
-		}
+	// nothing past the largest prime below 2^64, so 30 * byte + 29 never
+	// wraps
+	it->to = to < PRIME_ITER_MAX ? to : PRIME_ITER_MAX;
+	for (root = it->to, p = (it->to + 1) / 2; p < root; p = (p + it->to / p) / 2) {
+		root = p;
+	}
 
+	// segments of about sqrt(to) numbers, so the largest sieving primes
+	// still hit most segments, within the bounds of the cache
+	it->bytes = root / 30;
+	if (it->bytes < PRIME_CTX_SEGMENT_BYTES) {
+		it->bytes = PRIME_CTX_SEGMENT_BYTES;
+	} else if (it->bytes > PRIME_ITER_SEGMENT_BYTES) {
+		it->bytes = PRIME_ITER_SEGMENT_BYTES;
 	}
 
-	simple_vector_get(ctx->factors, i, &pf);
-	if (pf.power == 1) {
-		printf(" %llu\n", pf.prime);
+	// only the primes up to sqrt(to) from the table, past 2, 3 and 5, and
+	// Miller-Rabin for the rest when that is too many
+	if (root > PRIME_ITER_SIEVE_LIMIT) {
+		root = PRIME_ITER_SIEVE_LIMIT;
+		it->sure = root * root;
 	} else {
-		printf(" %llu^%lu\n", pf.prime, pf.power);
+		it->sure = it->to;
+	}
+	if (prime_ctx_grow(ctx, root) == -1
+			|| (it->bits = malloc(it->bytes)) == NULL) {
+		prime_iter_free(it);
+		return NULL;
+	}
+
+	// counted first, so the entries take no more room than they need
+	prime_table_iter_init(ctx->primes, 3, &pit);
+	for (count = 0; prime_table_iter_next(&pit, &p) && p <= root; count++) {
+	}
+	if ((it->entries = sieve_entry_vector_new(count + 1)) == NULL) {
+		prime_iter_free(it);
+		return NULL;
+	}
+	prime_table_iter_init(ctx->primes, 3, &pit);
+	while (prime_table_iter_next(&pit, &p) && p <= root) {
+		entry.prime = p;
+		if (sieve_entry_vector_append(it->entries, entry) == -1) {
+			prime_iter_free(it);
+			return NULL;
+		}
+	}
+
+	prime_iter_skip(it, from);
+	return it;
+
+} // }}}
+// {{{ void prime_iter_free(prime_iter_t *it)
+void prime_iter_free(prime_iter_t *it) {
+
+	if (it != NULL) {
+		simple_vector_free(it->entries, 0, NULL);
+		free(it->bits);
+		free(it);
+	}
+
+} // }}}
+// {{{ int prime_iter_next(prime_iter_t *it, uint64_t *prime_r)
+int prime_iter_next(prime_iter_t *it, uint64_t *prime_r) {
+
+	static const unsigned char small[3] = { 2, 3, 5 };
+	uint64_t p;
+
+	// 2, 3 and 5 are not on the wheel
+	while (it->small < 3) {
+		p = small[it->small++];
+		if (p >= it->from && p <= it->to) {
+			*prime_r = p;
+			return 1;
+		}
+	}
+
+	// whatever is left uncrossed is prime, but for 1 and what comes
+	// before from in its wheel turn
+	for (;;) {
+		while (it->mask == 0) {
+			if (it->pos == it->count && !prime_iter_sieve(it)) {
+				return 0;
+			}
+			it->mask = ~it->bits[it->pos++] & 0xff;
+		}
+		p = 30 * (it->lo + it->pos - 1) + wheel_residues[__builtin_ctz(it->mask)];
+		it->mask &= it->mask - 1;
+		if (p > it->to) {
+			// only the last segment runs past to, so this is the end
+			it->mask = 0;
+			it->pos = it->count;
+			return 0;
+		}
+		if (p >= it->from && p != 1 && (p <= it->sure || factor64_is_prime(p))) {
+			*prime_r = p;
+			return 1;
+		}
+	}
+
+} // }}}
+// {{{ static int prime_ctx_check_unsafe(prime_ctx_t *ctx, uint64_t num)
+static int prime_ctx_check_unsafe(prime_ctx_t *ctx, uint64_t num) {
+
+	prime_table_iter_t it;
+	uint64_t p;
+
+	prime_table_iter_init(ctx->primes, 0, &it);
+	while (prime_table_iter_next(&it, &p) && p * p <= num) {
+		if (num % p == 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+	
+} // }}}
+// {{{ int prime_ctx_check(prime_ctx_t *ctx, uint64_t num) 
+int prime_ctx_check(prime_ctx_t *ctx, uint64_t num) {
+
+	prime_table_iter_t it;
+	uint64_t p = 0;
+
+	if (num < 2) {
+		return 0;
+	}
+
+	// the primes below 30 are always in the table, and settle
+	// everything below 31^2 by themselves
+	prime_table_iter_init(ctx->primes, 0, &it);
+	while (prime_table_iter_next(&it, &p) && p < 30) {
+		if (num % p == 0) {
+			return num == p;
+		}
+	}
+	if (num < 31 * 31) {
+		return 1;
+	}
+
+	return factor64_is_prime(num);
+
+} // }}}
+// {{{ int prime_ctx_check_next(prime_ctx_t *ctx, uint64_t *num_r) 
+int prime_ctx_check_next(prime_ctx_t *ctx, uint64_t *num_r) {
+
+	if (num_r != NULL) {
+		*num_r = ctx->highest_checked + 1;
+	}
+	
+	prime_ctx_set_highest(ctx, ctx->highest_checked + 1);
+
+	int result = prime_ctx_check_unsafe(ctx, ctx->highest_checked);
+
+	if (result) {
+		prime_table_append(ctx->primes, ctx->highest_checked);
+	}
+
+	return result;
+
+} // }}}
+
+// {{{ int integer_primorial(prime_ctx_t *ctx, uint64_t n, integer_t *r)
+int integer_primorial(prime_ctx_t *ctx, uint64_t n, integer_t *r) {
+
+	// make sure every prime up to n is in the table
+	if (prime_ctx_grow(ctx, n) == -1) {
+		return -1;
+	}
+
+	// the table is sorted, so the primes <= n are a prefix of it; unpack
+	// them for the product tree
+	simple_vector_t *primes;
+	prime_table_iter_t it;
+	uint64_t p;
+
+	if ((primes = u64_vector_new(prime_table_size(ctx->primes))) == NULL) {
+		return -1;
+	}
+
+	prime_table_iter_init(ctx->primes, 0, &it);
+	while (prime_table_iter_next(&it, &p) && p <= n) {
+		if (u64_vector_append(primes, p) == -1) {
+			simple_vector_free(primes, 0, NULL);
+			return -1;
+		}
+	}
+
+	integer_product_u64(u64_vector_data(primes), u64_vector_size(primes), r);
+	simple_vector_free(primes, 0, NULL);
+
+	return 0;
+
+} // }}}
+
+// {{{ static inline uint64_t prime_count_div(uint64_t n, uint64_t d)
+static inline uint64_t prime_count_div(uint64_t n, uint64_t d) {
+
+	// a double divides far faster than a uint64_t, and below 2^53 is off
+	// by at most one
+	uint64_t q = (double) n / (double) d;
+
+	if (q * d > n) {
+		q--;
+	} else if ((q + 1) * d <= n) {
+		q++;
+	}
+
+	return q;
+
+} // }}}
+// {{{ static void prime_count_level(struct prime_count_job *job, uint64_t lo, uint64_t hi)
+static void prime_count_level(struct prime_count_job *job, uint64_t lo, uint64_t hi) {
+
+	uint64_t i, d, p = job->p, sp = job->sp;
+
+	// sieve p out of the counts in [lo, hi], reading only counts outside
+	// it, which this round has not reached yet
+	if (job->large) {
+		for (i = lo; i <= hi; i++) {
+			d = i * p;
+			job->large_counts[i] -= (d <= job->root ? job->large_counts[d]
+					: job->small_counts[prime_count_div(job->x, d)]) - sp;
+		}
+	} else {
+		for (i = hi; i >= lo; i--) {
+			job->small_counts[i] -= job->small_counts[i / p] - sp;
+		}
+	}
+
+} // }}}
+// {{{ static void prime_count_task(void *arg, size_t task, unsigned int worker)
+static void prime_count_task(void *arg, size_t task, unsigned int worker) {
+
+	struct prime_count_job *job = arg;
+	uint64_t lo = job->lo + task * PRIME_COUNT_CHUNK, hi = lo + PRIME_COUNT_CHUNK - 1;
+
+	(void) worker;
+	prime_count_level(job, lo, hi < job->hi ? hi : job->hi);
+
+} // }}}
+// {{{ static void prime_count_run(prime_ctx_t *ctx, struct prime_count_job *job, uint64_t lo, uint64_t hi)
+static void prime_count_run(prime_ctx_t *ctx, struct prime_count_job *job, uint64_t lo, uint64_t hi) {
+
+	// big levels are split into chunks over the pool
+	if (ctx->pool != NULL && hi - lo >= PRIME_COUNT_PARALLEL) {
+		job->lo = lo;
+		job->hi = hi;
+		work_pool_run(ctx->pool, (hi - lo) / PRIME_COUNT_CHUNK + 1, prime_count_task, job);
+	} else {
+		prime_count_level(job, lo, hi);
+	}
+
+} // }}}
+// {{{ int prime_ctx_count(prime_ctx_t *ctx, uint64_t x, uint64_t *count_r)
+int prime_ctx_count(prime_ctx_t *ctx, uint64_t x, uint64_t *count_r) {
+
+	struct prime_count_job job;
+	prime_table_iter_t it;
+	uint64_t i, lo, hi, top, p;
+
+	if (x > PRIME_COUNT_MAX) {
+		errno = ERANGE;
+		return -1;
+	}
+	if (x < 2) {
+		*count_r = 0;
+		return 0;
+	}
+
+	// Lucy_Hedgehog: counts of the numbers in [2, v] that survive sieving
+	// by the primes so far, for every v = x / i, small v by value and
+	// large v by i; each prime p <= sqrt(x) takes away those with least
+	// prime factor p
+	job.x = x;
+	for (job.root = x, i = (x + 1) / 2; i < job.root; i = (i + x / i) / 2) {
+		job.root = i;
+	}
+	if (prime_ctx_grow(ctx, job.root) == -1) {
+		return -1;
+	}
+	job.small_counts = malloc((job.root + 1) * sizeof(uint64_t));
+	job.large_counts = malloc((job.root + 1) * sizeof(uint64_t));
+	if (job.small_counts == NULL || job.large_counts == NULL) {
+		free(job.small_counts);
+		free(job.large_counts);
+		return -1;
+	}
+	job.small_counts[0] = 0;
+	for (i = 1; i <= job.root; i++) {
+		job.small_counts[i] = i - 1;
+		job.large_counts[i] = x / i - 1;
+	}
+
+	// in place, so each round splits its updates into levels whose reads
+	// fall outside the level and have not been updated yet: upwards from
+	// i = 1 for large v, as v / p is x / (i p); downwards for small v
+	prime_table_iter_init(ctx->primes, 0, &it);
+	while (prime_table_iter_next(&it, &p) && p <= job.root) {
+		job.p = p;
+		job.sp = job.small_counts[p - 1];
+
+		job.large = 1;
+		top = x / (p * p) < job.root ? x / (p * p) : job.root;
+		for (lo = 1; lo <= top; lo = hi + 1) {
+			hi = lo * p - 1 < top ? lo * p - 1 : top;
+			prime_count_run(ctx, &job, lo, hi);
+		}
+
+		job.large = 0;
+		for (hi = job.root; hi >= p * p; hi = lo - 1) {
+			lo = hi / p + 1 > p * p ? hi / p + 1 : p * p;
+			prime_count_run(ctx, &job, lo, hi);
+		}
+	}
+
+	*count_r = job.large_counts[1];
+	free(job.small_counts);
+	free(job.large_counts);
+
+	return 0;
+
+} // }}}
+
+// {{{ factor_ctx_t *factor_ctx_new(prime_ctx_t *pctx, uint64_t num)
+factor_ctx_t *factor_ctx_new(prime_ctx_t *pctx, uint64_t num) {
+
+	factor_ctx_t *ctx;
+
+	if ((ctx = malloc(sizeof(factor_ctx_t))) == NULL) {
+		return NULL;
+	}
+
+	// a uint64_t rarely has more than a handful of distinct prime factors,
+	// which fit in the inline buffer
+	if ((ctx->factors = prime_factor_vector_new(4)) == NULL) {
+		factor_ctx_free(ctx);
+		return NULL;
+	}
+	
+	ctx->pctx = pctx;
+	ctx->num = num;
+	factor_ctx_set_effort(ctx, NULL);
+
+	return ctx;
+
+} // }}}
+// {{{ void factor_ctx_free(factor_ctx_t *ctx) 
+void factor_ctx_free(factor_ctx_t *ctx) {
+	
+	if (ctx != NULL) {
+		simple_vector_free(ctx->factors, 0, NULL);
+		free(ctx);
+	}
+
+} // }}}
+
+// {{{ static void factor_effort_init(factor_effort_t *dst, const factor_effort_t *effort)
+static void factor_effort_init(factor_effort_t *dst, const factor_effort_t *effort) {
+
+	if (effort != NULL) {
+		*dst = *effort;
+	} else {
+		memset(dst, 0, sizeof(factor_effort_t));
+	}
+
+	if (dst->rho_iterations == 0) {
+		dst->rho_iterations = FACTOR_CTX_RHO_ITERATIONS;
+	}
+	if (dst->squfof_iterations == 0) {
+		dst->squfof_iterations = FACTOR_CTX_SQUFOF_ITERATIONS;
+	}
+	if (dst->ecm_curves == 0) {
+		dst->ecm_curves = FACTOR_CTX_ECM_CURVES;
+	}
+
+} // }}}
+// {{{ void factor_ctx_set_effort(factor_ctx_t *ctx, const factor_effort_t *effort)
+void factor_ctx_set_effort(factor_ctx_t *ctx, const factor_effort_t *effort) {
+	factor_effort_init(&ctx->effort, effort);
+} // }}}
+// {{{ static inline int factor_ctx_divide(simple_vector_t *factors, uint64_t prime, uint64_t *remaining)
+static inline int factor_ctx_divide(simple_vector_t *factors, uint64_t prime, uint64_t *remaining) {
+
+	prime_factor_t pf;
+
+	pf.prime = prime;
+	pf.power = 0;
+
+	while (*remaining % prime == 0) {
+		pf.power += 1;
+		*remaining /= prime;
+	}
+
+	if (pf.power != 0 && prime_factor_vector_append(factors, pf) == -1) {
+		return -1;
+	}
+
+	// once prime^2 passes what is left, that is prime (or 1)
+	return prime >= ((uint64_t) 1 << 32) || prime * prime > *remaining;
+
+} // }}}
+// {{{ static inline int factor_ctx_divide_trial(simple_vector_t *factors, const struct factor_trial *trial, uint64_t *remaining)
+static inline int factor_ctx_divide_trial(simple_vector_t *factors, const struct factor_trial *trial,
+		uint64_t *remaining) {
+
+	prime_factor_t pf;
+	uint64_t q;
+
+	pf.prime = trial->prime;
+	pf.power = 0;
+
+	// as factor_ctx_divide, but multiplying by the inverse, which only
+	// gives a result this small when the division is exact
+	while ((q = *remaining * trial->inverse) <= trial->limit) {
+		pf.power += 1;
+		*remaining = q;
+	}
+
+	if (pf.power != 0 && prime_factor_vector_append(factors, pf) == -1) {
+		return -1;
+	}
+
+	// once prime^2 passes what is left, that is prime (or 1)
+	return trial->prime * trial->prime > *remaining;
+
+} // }}}
+// {{{ static int factor_ctx_split(const factor_effort_t *effort, uint64_t remaining, simple_vector_t *factors)
+static int factor_ctx_split(const factor_effort_t *effort, uint64_t remaining, simple_vector_t *factors) {
+
+	// a uint64_t has at most 64 prime factors, counted with multiplicity
+	uint64_t pending[64], primes[64], d, n;
+	size_t i, j, npending = 0, nprimes = 0;
+	prime_factor_t pf;
+
+	pending[npending++] = remaining;
+	while (npending > 0) {
+		n = pending[--npending];
+		if (factor64_is_prime(n)) {
+			primes[nprimes++] = n;
+		} else {
+			d = factor64_split(n, effort);
+			pending[npending++] = d;
+			pending[npending++] = n / d;
+		}
+	}
+
+	// sorted, with repeats folded into powers
+	for (i = 1; i < nprimes; i++) {
+		for (j = i; j > 0 && primes[j - 1] > primes[j]; j--) {
+			d = primes[j];
+			primes[j] = primes[j - 1];
+			primes[j - 1] = d;
+		}
+	}
+	for (i = 0; i < nprimes; i = j) {
+		for (j = i; j < nprimes && primes[j] == primes[i]; j++) {
+		}
+		pf.prime = primes[i];
+		pf.power = j - i;
+		if (prime_factor_vector_append(factors, pf) == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int factor_ctx_factor(prime_ctx_t *pctx, const factor_effort_t *effort, uint64_t num, simple_vector_t *factors)
+static int factor_ctx_factor(prime_ctx_t *pctx, const factor_effort_t *effort,
+		uint64_t num, simple_vector_t *factors) {
+
+	prime_factor_t pf;
+	size_t i;
+	int done = 0;
+
+	uint64_t remaining = num;
+
+	if (remaining == 0) {
+		return 0;
+	}
+
+	// trial division: twos by shifting, then the odd primes below the
+	// limit by their inverses
+	if ((pf.power = __builtin_ctzll(remaining)) != 0) {
+		pf.prime = 2;
+		if (prime_factor_vector_append(factors, pf) == -1) {
+			return -1;
+		}
+		remaining >>= pf.power;
+	}
+	for (i = 0; i < pctx->trial_count && !done && remaining != 1; i++) {
+		if ((done = factor_ctx_divide_trial(factors, &pctx->trial[i], &remaining)) == -1) {
+			return -1;
+		}
+	}
+	done |= remaining == 1;
+
+	// what is left has no factors below the limit, so below the limit
+	// squared it is prime; past that, split it by Miller-Rabin and rho
+	if (remaining != 1 && !done && remaining / FACTOR_CTX_TRIAL_LIMIT >= FACTOR_CTX_TRIAL_LIMIT) {
+		return factor_ctx_split(effort, remaining, factors);
+	} else if (remaining != 1) {
+		pf.prime = remaining;
+		pf.power = 1;
+		return prime_factor_vector_append(factors, pf);
+	}
+
+	return 0;
+
+} // }}}
+// {{{ int factor_ctx_finish(factor_ctx_t *ctx)
+int factor_ctx_finish(factor_ctx_t *ctx) {
+	return factor_ctx_factor(ctx->pctx, &ctx->effort, ctx->num, ctx->factors);
+} // }}}
+
+// {{{ void factor_ctx_print(factor_ctx_t *ctx)
+void factor_ctx_print(factor_ctx_t *ctx) {
+
+	printf("%llu =", ctx->num);
+	
+	size_t i;
+	prime_factor_t pf;
+	for (i = 0; i < prime_factor_vector_size(ctx->factors) - 1; i++) {
+		
+		pf = prime_factor_vector_at(ctx->factors, i);
+
+		if (pf.power == 1) {
+			printf(" %llu *", pf.prime);
+		} else {
+			printf(" %llu^%lu *", pf.prime, pf.power);
+		}
+
+	}
+
+	pf = prime_factor_vector_at(ctx->factors, i);
+	if (pf.power == 1) {
+		printf(" %llu\n", pf.prime);
+	} else {
+		printf(" %llu^%lu\n", pf.prime, pf.power);
+	}
+
+} // }}}
+
+// {{{ static void factor_batch_task(void *arg, size_t task, unsigned int worker)
+static void factor_batch_task(void *arg, size_t task, unsigned int worker) {
+
+	struct factor_batch_job *job = arg;
+	size_t i, begin = task * FACTOR_BATCH_CHUNK, end = begin + FACTOR_BATCH_CHUNK, before;
+	simple_vector_t *found;
+
+	(void) worker;
+
+	if (end > job->n) {
+		end = job->n;
+	}
+
+	// a few factors per number to start with, grown as needed
+	if ((found = prime_factor_vector_new(4 * (end - begin))) == NULL) {
+		atomic_store_explicit(&job->failed, 1, memory_order_relaxed);
+		return;
+	}
+	job->found[task] = found;
+
+	// the counts go into offsets for now, and become offsets once every
+	// chunk is done
+	for (i = begin; i < end; i++) {
+		before = prime_factor_vector_size(found);
+		if (factor_ctx_factor(job->pctx, &job->effort, job->nums[i], found) == -1) {
+			atomic_store_explicit(&job->failed, 1, memory_order_relaxed);
+			return;
+		}
+		job->offsets[i + 1] = prime_factor_vector_size(found) - before;
+	}
+
+} // }}}
+// {{{ int factor_batch(prime_ctx_t *pctx, const uint64_t *nums, size_t n, const factor_effort_t *effort, factor_batch_t *results_r)
+int factor_batch(prime_ctx_t *pctx, const uint64_t *nums, size_t n,
+		const factor_effort_t *effort, factor_batch_t *results_r) {
+
+	struct factor_batch_job job;
+	size_t i, task, tasks = (n + FACTOR_BATCH_CHUNK - 1) / FACTOR_BATCH_CHUNK, count;
+	int failed = 0;
+
+	memset(results_r, 0, sizeof(factor_batch_t));
+
+	// the workers share pctx, but only ever read its trial primes
+	job.pctx = pctx;
+	job.nums = nums;
+	job.n = n;
+	atomic_init(&job.failed, 0);
+	factor_effort_init(&job.effort, effort);
+	job.offsets = calloc(n + 1, sizeof(size_t));
+	job.found = calloc(tasks + 1, sizeof(simple_vector_t *));
+	if (job.offsets == NULL || job.found == NULL) {
+		free(job.offsets);
+		free(job.found);
+		return -1;
+	}
+
+	// chunks over the pool of pctx, or inline when it has none
+	if (pctx->pool != NULL) {
+		work_pool_run(pctx->pool, tasks, factor_batch_task, &job);
+	} else {
+		for (task = 0; task < tasks; task++) {
+			factor_batch_task(&job, task, 0);
+		}
+	}
+
+	// counts to offsets, then the chunks into one buffer in input order;
+	// work_pool_run has waited for every task, so the flag is final
+	failed = atomic_load_explicit(&job.failed, memory_order_relaxed);
+	for (i = 0; !failed && i < n; i++) {
+		job.offsets[i + 1] += job.offsets[i];
+	}
+	if (!failed && (results_r->factors = malloc((job.offsets[n] + 1) * sizeof(prime_factor_t))) == NULL) {
+		failed = 1;
+	}
+	for (task = 0, count = 0; task < tasks; task++) {
+		if (!failed) {
+			memcpy(results_r->factors + count, prime_factor_vector_data(job.found[task]),
+					prime_factor_vector_size(job.found[task]) * sizeof(prime_factor_t));
+			count += prime_factor_vector_size(job.found[task]);
+		}
+		simple_vector_free(job.found[task], 0, NULL);
+	}
+	free(job.found);
+
+	if (failed) {
+		free(job.offsets);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	results_r->offsets = job.offsets;
+	results_r->count = n;
+
+	return 0;
+
+} // }}}
+// {{{ void factor_batch_free(factor_batch_t *results)
+void factor_batch_free(factor_batch_t *results) {
+
+	free(results->factors);
+	free(results->offsets);
+	memset(results, 0, sizeof(factor_batch_t));
+
+} // }}}
+
+// {{{ integer_factor_ctx_t *integer_factor_ctx_new(prime_ctx_t *pctx, integer_t *num)
+integer_factor_ctx_t *integer_factor_ctx_new(prime_ctx_t *pctx, integer_t *num) {
+
+	integer_factor_ctx_t *ctx;
+
+	if ((ctx = calloc(1, sizeof(integer_factor_ctx_t))) == NULL) {
+		return NULL;
+	}
+
+	if ((ctx->factors = integer_prime_factor_vector_new(4)) == NULL
+			|| (ctx->num = integer_new_zero()) == NULL) {
+		integer_factor_ctx_free(ctx);
+		return NULL;
+	}
+
+	integer_copy(ctx->num, num);
+	ctx->pctx = pctx;
+	factor_effort_init(&ctx->effort, NULL);
+
+	return ctx;
+
+} // }}}
+// {{{ static void integer_factor_ctx_clear(integer_factor_ctx_t *ctx)
+static void integer_factor_ctx_clear(integer_factor_ctx_t *ctx) {
+
+	size_t i;
+
+	for (i = 0; i < integer_prime_factor_vector_size(ctx->factors); i++) {
+		integer_free(integer_prime_factor_vector_at(ctx->factors, i).prime);
+	}
+	simple_vector_clear(ctx->factors);
+
+} // }}}
+// {{{ void integer_factor_ctx_free(integer_factor_ctx_t *ctx)
+void integer_factor_ctx_free(integer_factor_ctx_t *ctx) {
+
+	if (ctx != NULL) {
+		if (ctx->factors != NULL) {
+			integer_factor_ctx_clear(ctx);
+			simple_vector_free(ctx->factors, 0, NULL);
+		}
+		integer_free(ctx->num);
+		free(ctx);
+	}
+
+} // }}}
+
+// {{{ void integer_factor_ctx_set_effort(integer_factor_ctx_t *ctx, const factor_effort_t *effort)
+void integer_factor_ctx_set_effort(integer_factor_ctx_t *ctx, const factor_effort_t *effort) {
+	factor_effort_init(&ctx->effort, effort);
+} // }}}
+// {{{ static int integer_factor_ctx_append(integer_factor_ctx_t *ctx, integer_t *prime, uint32_t power)
+static int integer_factor_ctx_append(integer_factor_ctx_t *ctx, integer_t *prime, uint32_t power) {
+
+	integer_prime_factor_t pf;
+
+	// takes prime over, or frees it on failure
+	pf.prime = prime;
+	pf.power = power;
+	if (prime == NULL || integer_prime_factor_vector_append(ctx->factors, pf) == -1) {
+		integer_free(prime);
+		return -1;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int integer_factor_ctx_append_small(integer_factor_ctx_t *ctx, simple_vector_t *small)
+static int integer_factor_ctx_append_small(integer_factor_ctx_t *ctx, simple_vector_t *small) {
+
+	prime_factor_t pf;
+	size_t i;
+
+	for (i = 0; i < prime_factor_vector_size(small); i++) {
+		pf = prime_factor_vector_at(small, i);
+		if (integer_factor_ctx_append(ctx, integer_new_from_u64(pf.prime), pf.power) == -1) {
+			return -1;
+		}
+	}
+	simple_vector_clear(small);
+
+	return 0;
+
+} // }}}
+// {{{ static int integer_factor_ctx_trial(integer_factor_ctx_t *ctx, integer_t *remaining, simple_vector_t *small)
+static int integer_factor_ctx_trial(integer_factor_ctx_t *ctx, integer_t *remaining, simple_vector_t *small) {
+
+	prime_factor_t pf;
+	prime_table_iter_t it;
+	uint64_t p, r;
+	int more, done = 0;
+
+	if (prime_ctx_grow(ctx->pctx, INTEGER_FACTOR_TRIAL_LIMIT) == -1) {
+		return -1;
+	}
+
+	// trial division on the integer while it is wider than a word...
+	prime_table_iter_init(ctx->pctx->primes, 0, &it);
+	more = prime_table_iter_next(&it, &p);
+	for (; more && p < INTEGER_FACTOR_TRIAL_LIMIT && integer_bit_length(remaining) > 64;
+			more = prime_table_iter_next(&it, &p)) {
+		pf.prime = p;
+		pf.power = 0;
+		while (integer_div_u64(remaining, p, NULL) == 0) {
+			integer_div_u64(remaining, p, remaining);
+			pf.power += 1;
+		}
+		if (pf.power != 0 && prime_factor_vector_append(small, pf) == -1) {
+			return -1;
+		}
+	}
+
+	if (integer_bit_length(remaining) > 64) {
+		return 0;
+	}
+
+	// ...and on a uint64_t as factor_ctx_finish does once it fits, leaving
+	// remaining at 1
+	r = integer_to_u64(remaining);
+	for (; !done && more && p < INTEGER_FACTOR_TRIAL_LIMIT; more = prime_table_iter_next(&it, &p)) {
+		if ((done = factor_ctx_divide(small, p, &r)) == -1) {
+			return -1;
+		}
+	}
+	if (r != 1 && !done && r / INTEGER_FACTOR_TRIAL_LIMIT >= INTEGER_FACTOR_TRIAL_LIMIT) {
+		if (factor_ctx_split(&ctx->effort, r, small) == -1) {
+			return -1;
+		}
+	} else if (r != 1) {
+		pf.prime = r;
+		pf.power = 1;
+		if (prime_factor_vector_append(small, pf) == -1) {
+			return -1;
+		}
+	}
+	integer_set_u64(remaining, 1);
+
+	return 0;
+
+} // }}}
+// {{{ static int integer_factor_ctx_split(integer_factor_ctx_t *ctx, simple_vector_t *pending, simple_vector_t *small)
+static int integer_factor_ctx_split(integer_factor_ctx_t *ctx, simple_vector_t *pending, simple_vector_t *small) {
+
+	integer_t *n, *d, *q;
+	int prime;
+
+	// the table must not grow under ECM's iterators, so grow it up front
+	if (prime_ctx_grow(ctx->pctx, INTEGER_FACTOR_ECM_PRIMES) == -1) {
+		return -1;
+	}
+
+	// every cofactor here is odd, with no factors below the trial limit
+	while (integer_vector_size(pending) > 0) {
+
+		n = integer_vector_at(pending, integer_vector_size(pending) - 1);
+
+		if (integer_bit_length(n) <= 64) {
+			if (factor_ctx_split(&ctx->effort, integer_to_u64(n), small) == -1) {
+				return -1;
+			}
+			simple_vector_truncate(pending, integer_vector_size(pending) - 1);
+			integer_free(n);
+			continue;
+		}
+
+		if ((prime = factor_integer_is_prime(n)) == -1) {
+			return -1;
+		}
+		if (prime) {
+			simple_vector_truncate(pending, integer_vector_size(pending) - 1);
+			if (integer_factor_ctx_append(ctx, n, 1) == -1) {
+				return -1;
+			}
+			continue;
+		}
+
+		// n stays pending until both of its parts are
+		if ((d = integer_new_zero()) == NULL) {
+			return -1;
+		}
+		if ((q = integer_new_zero()) == NULL) {
+			integer_free(d);
+			return -1;
+		}
+		if (factor_integer_split(n, ctx->pctx->primes, &ctx->effort, d) == -1
+				|| integer_div(n, d, q, n) == -1) {
+			integer_free(d);
+			integer_free(q);
+			return -1;
+		}
+		integer_free(n);
+		integer_vector_set(pending, integer_vector_size(pending) - 1, d);
+		if (integer_vector_append(pending, q) == -1) {
+			integer_free(q);
+			return -1;
+		}
+
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static void integer_factor_ctx_sort(integer_factor_ctx_t *ctx)
+static void integer_factor_ctx_sort(integer_factor_ctx_t *ctx) {
+
+	integer_prime_factor_t *f = integer_prime_factor_vector_data(ctx->factors), t;
+	size_t i, j, count = integer_prime_factor_vector_size(ctx->factors);
+
+	// a handful of factors: insertion sort, then fold repeats into powers
+	for (i = 1; i < count; i++) {
+		for (j = i; j > 0 && integer_cmp(f[j - 1].prime, f[j].prime) > 0; j--) {
+			t = f[j];
+			f[j] = f[j - 1];
+			f[j - 1] = t;
+		}
+	}
+	for (i = 0, j = 0; i < count; i++) {
+		if (j > 0 && integer_cmp(f[j - 1].prime, f[i].prime) == 0) {
+			f[j - 1].power += f[i].power;
+			integer_free(f[i].prime);
+		} else {
+			f[j++] = f[i];
+		}
+	}
+	simple_vector_truncate(ctx->factors, j);
+
+} // }}}
+// {{{ static int integer_factor_ctx_run(integer_factor_ctx_t *ctx, integer_t **remaining, simple_vector_t *small, simple_vector_t *pending)
+static int integer_factor_ctx_run(integer_factor_ctx_t *ctx, integer_t **remaining, simple_vector_t *small,
+		simple_vector_t *pending) {
+
+	// small factors first; what is left is 1 or has only factors past
+	// the trial limit, and goes over to pending for factor_integer_split
+	integer_copy(*remaining, ctx->num);
+	if (integer_factor_ctx_trial(ctx, *remaining, small) == -1) {
+		return -1;
+	}
+	if (integer_bit_length(*remaining) > 1) {
+		if (integer_vector_append(pending, *remaining) == -1) {
+			return -1;
+		}
+		*remaining = NULL;
+		if (integer_factor_ctx_split(ctx, pending, small) == -1) {
+			return -1;
+		}
+	}
+
+	if (integer_factor_ctx_append_small(ctx, small) == -1) {
+		return -1;
+	}
+	integer_factor_ctx_sort(ctx);
+
+	return 0;
+
+} // }}}
+// {{{ int integer_factor_ctx_finish(integer_factor_ctx_t *ctx)
+int integer_factor_ctx_finish(integer_factor_ctx_t *ctx) {
+
+	simple_vector_t *small, *pending;
+	integer_t *remaining;
+	size_t i;
+	int ret = -1;
+
+	integer_factor_ctx_clear(ctx);
+	if (integer_bit_length(ctx->num) == 0) {
+		return 0;
+	}
+
+	// pending owns the cofactors still to split, which is how far it got
+	// when something fails
+	small = prime_factor_vector_new(4);
+	pending = integer_vector_new(4);
+	remaining = integer_new_zero();
+	if (small != NULL && pending != NULL && remaining != NULL) {
+		ret = integer_factor_ctx_run(ctx, &remaining, small, pending);
+	}
+
+	for (i = 0; pending != NULL && i < integer_vector_size(pending); i++) {
+		integer_free(integer_vector_at(pending, i));
+	}
+	simple_vector_free(pending, 0, NULL);
+	simple_vector_free(small, 0, NULL);
+	integer_free(remaining);
+
+	if (ret == -1) {
+		integer_factor_ctx_clear(ctx);
+	}
+	return ret;
+
+} // }}}
+// {{{ const integer_prime_factor_t *integer_factor_ctx_factors(integer_factor_ctx_t *ctx, size_t *count_r)
+const integer_prime_factor_t *integer_factor_ctx_factors(integer_factor_ctx_t *ctx, size_t *count_r) {
+
+	*count_r = integer_prime_factor_vector_size(ctx->factors);
+	return integer_prime_factor_vector_data(ctx->factors);
+
+} // }}}
+
+// {{{ void integer_factor_ctx_print(integer_factor_ctx_t *ctx)
+void integer_factor_ctx_print(integer_factor_ctx_t *ctx) {
+
+	integer_prime_factor_t pf;
+	size_t i;
+	char *s;
+
+	if ((s = integer_to_hex_string(ctx->num)) == NULL) {
+		return;
+	}
+	printf("%s =", s);
+	free(s);
+
+	for (i = 0; i < integer_prime_factor_vector_size(ctx->factors); i++) {
+
+		pf = integer_prime_factor_vector_at(ctx->factors, i);
+		if ((s = integer_to_hex_string(pf.prime)) == NULL) {
+			break;
+		}
+
+		printf(i == 0 ? " %s" : " * %s", s);
+		if (pf.power != 1) {
+			printf("^%u", pf.power);
+		}
+		free(s);
+
 	}
+	printf("\n");
 
 } // }}}
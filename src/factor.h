@@ -4,30 +4,117 @@
 #include <stdint.h>
 
 #include "simple_vector.h"
+#include "integer.h"
 
 struct prime_ctx;
 typedef struct prime_ctx prime_ctx_t;
 
+struct prime_iter;
+typedef struct prime_iter prime_iter_t;
+
 struct factor_ctx;
 typedef struct factor_ctx factor_ctx_t;
 
+struct integer_factor_ctx;
+typedef struct integer_factor_ctx integer_factor_ctx_t;
+
 struct prime_factor {
 	uint64_t prime;
 	uint32_t power;
 };
 typedef struct prime_factor prime_factor_t;
 
+// the primes belong to the integer_factor_ctx_t they came from
+struct integer_prime_factor {
+	integer_t *prime;
+	uint32_t power;
+};
+typedef struct integer_prime_factor integer_prime_factor_t;
+
+// how long each stage of factor_ctx_finish runs on a cofactor before
+// handing over to the next; zero fields take the defaults
+struct factor_effort {
+	uint64_t rho_iterations;
+	uint64_t squfof_iterations;
+	uint32_t ecm_curves;
+	uint32_t ecm_b1;	// default picked by cofactor size
+	uint32_t ecm_b2;	// default 25 * ecm_b1
+};
+typedef struct factor_effort factor_effort_t;
+
 prime_ctx_t *prime_ctx_new();
+// grows the prime table on threads threads, 0 for one per online CPU
+prime_ctx_t *prime_ctx_new_threads(unsigned int threads);
+// a context whose table comes from a file prime_ctx_save wrote, mapped
+// read only and shared between processes until it has to grow
+prime_ctx_t *prime_ctx_new_file(const char *path, unsigned int threads);
 void prime_ctx_free(prime_ctx_t *ctx);
 
+int prime_ctx_save(prime_ctx_t *ctx, const char *path);
+
+// exact for every uint64_t (Miller-Rabin), never grows the table
 int prime_ctx_check(prime_ctx_t *ctx, uint64_t num);
 int prime_ctx_check_next(prime_ctx_t *ctx, uint64_t *num_r);
+// sieve until every prime <= limit is in the table
+int prime_ctx_grow(prime_ctx_t *ctx, uint64_t limit);
+
+// *count_r = the number of primes <= x, for x up to 2^53, in about
+// x^(3/4) steps and sqrt(x) memory, on the threads of ctx; grows the
+// table to sqrt(x)
+int prime_ctx_count(prime_ctx_t *ctx, uint64_t x, uint64_t *count_r);
+
+// the primes in [from, to] in order, sieved a segment at a time with the
+// primes up to sqrt(to), which is as far as the table of ctx grows; past
+// 2^48 the sieve stops at the primes below 2^24 and Miller-Rabin checks
+// what it leaves, some 25 times slower, but in bounded memory. skip moves
+// the iterator to the first prime >= from, either way
+prime_iter_t *prime_iter_new(prime_ctx_t *ctx, uint64_t from, uint64_t to);
+void prime_iter_free(prime_iter_t *it);
+int prime_iter_next(prime_iter_t *it, uint64_t *prime_r);
+void prime_iter_skip(prime_iter_t *it, uint64_t from);
+
+// r = product of all primes <= n; -1 with errno set if the table could
+// not grow that far
+int integer_primorial(prime_ctx_t *ctx, uint64_t n, integer_t *r);
 
 factor_ctx_t *factor_ctx_new(prime_ctx_t *pctx, uint64_t number);
 void factor_ctx_free(factor_ctx_t *ctx);
 
-void factor_ctx_finish(factor_ctx_t *ctx);
+void factor_ctx_set_effort(factor_ctx_t *ctx, const factor_effort_t *effort);
+
+// -1 with errno set when a factor could not be stored
+int factor_ctx_finish(factor_ctx_t *ctx);
 
 void factor_ctx_print(factor_ctx_t *ctx);
 
+// the factors of nums[i] are factors[offsets[i]] up to
+// factors[offsets[i + 1]], in increasing order, for i below count
+struct factor_batch {
+	prime_factor_t *factors;
+	size_t *offsets;
+	size_t count;
+};
+typedef struct factor_batch factor_batch_t;
+
+// factors n numbers at once, on the threads pctx was created with, all
+// reading its prime table; effort may be NULL for the defaults
+int factor_batch(prime_ctx_t *pctx, const uint64_t *nums, size_t n,
+		const factor_effort_t *effort, factor_batch_t *results_r);
+void factor_batch_free(factor_batch_t *results);
+
+// factors a positive integer_t of any size, handing cofactors that fit in
+// a uint64_t to factor_ctx; number is copied
+integer_factor_ctx_t *integer_factor_ctx_new(prime_ctx_t *pctx, integer_t *number);
+void integer_factor_ctx_free(integer_factor_ctx_t *ctx);
+
+void integer_factor_ctx_set_effort(integer_factor_ctx_t *ctx, const factor_effort_t *effort);
+
+// grows the prime table of pctx as it goes, for trial division and ECM
+int integer_factor_ctx_finish(integer_factor_ctx_t *ctx);
+
+// the prime factors found by finish, in increasing order
+const integer_prime_factor_t *integer_factor_ctx_factors(integer_factor_ctx_t *ctx, size_t *count_r);
+
+void integer_factor_ctx_print(integer_factor_ctx_t *ctx);
+
 #endif
@@ -0,0 +1,528 @@
+#include "factor64.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "mont64.h"
+
+// differences multiplied together between gcds in rho
+#define FACTOR64_RHO_BATCH 128
+
+// below FACTOR64_ECM_BITS rho finds the (at most 21 bit) factor
+// quickest; from there on ECM goes first, and is several times faster
+// than rho by 64 bits; SQUFOF backs both up from FACTOR64_SQUFOF_BITS
+#define FACTOR64_SQUFOF_BITS 40
+#define FACTOR64_ECM_BITS 42
+
+// ECM draws its primes from a table built once; stage 2 never looks past it
+#define FACTOR64_ECM_MAX_B2 65536
+
+// the stage 2 giant step, and the baby steps j < D / 2 coprime to it
+#define FACTOR64_ECM_D 210
+static const unsigned char ecm_baby_steps[] = {
+	1, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47,
+	53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103
+};
+
+// primes below FACTOR64_ECM_MAX_B2: in order, and as a bitmap of odd numbers
+static uint32_t ecm_primes[6542];
+static size_t ecm_prime_count;
+static uint64_t ecm_prime_bits[FACTOR64_ECM_MAX_B2 / 128];
+static pthread_once_t ecm_primes_once = PTHREAD_ONCE_INIT;
+
+// a point on a Montgomery curve, as X:Z in Montgomery form
+struct ecm_point {
+	uint64_t x;
+	uint64_t z;
+};
+
+// {{{ int factor64_is_prime(uint64_t n)
+int factor64_is_prime(uint64_t n) {
+
+	// no strong pseudoprime below 2^64 passes all of bases (Sinclair),
+	// nor one below 4759123141 all of small_bases (Jaeschke)
+	static const uint64_t bases[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+	static const uint64_t small_bases[] = { 2, 7, 61 };
+	const uint64_t *base = bases;
+	int count = sizeof(bases) / sizeof(bases[0]);
+	mont64_t m;
+	uint64_t d, x, minus_one;
+	int i, r, s;
+
+	if (n < 4759123141ULL) {
+		base = small_bases;
+		count = sizeof(small_bases) / sizeof(small_bases[0]);
+	}
+
+	s = __builtin_ctzll(n - 1);
+	d = (n - 1) >> s;
+
+	mont64_init(&m, n);
+	minus_one = m.n - m.one;
+
+	for (i = 0; i < count; i++) {
+
+		if (base[i] % n == 0) {
+			continue;
+		}
+
+		x = mont64_pow(&m, mont64_to(&m, base[i]), d);
+		if (x == m.one || x == minus_one) {
+			continue;
+		}
+
+		for (r = 1; r < s && x != minus_one; r++) {
+			x = mont64_mul(&m, x, x);
+		}
+		if (x != minus_one) {
+			return 0;
+		}
+
+	}
+
+	return 1;
+
+} // }}}
+// {{{ uint64_t factor64_gcd(uint64_t a, uint64_t b)
+uint64_t factor64_gcd(uint64_t a, uint64_t b) {
+
+	int shift;
+
+	if (a == 0 || b == 0) {
+		return a | b;
+	}
+
+	// binary gcd, no divisions
+	shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+	while (b != 0) {
+		b >>= __builtin_ctzll(b);
+		if (a > b) {
+			uint64_t t = a;
+			a = b;
+			b = t;
+		}
+		b -= a;
+	}
+
+	return a << shift;
+
+} // }}}
+// {{{ static uint64_t factor64_isqrt(uint64_t n)
+static uint64_t factor64_isqrt(uint64_t n) {
+
+	uint64_t x, y;
+
+	if (n < 2) {
+		return n;
+	}
+
+	// Newton from above: a power of two at least sqrt(n)
+	x = (uint64_t) 1 << ((64 - __builtin_clzll(n) + 1) / 2);
+	for (y = (x + n / x) / 2; y < x; y = (x + n / x) / 2) {
+		x = y;
+	}
+
+	return x;
+
+} // }}}
+// {{{ static uint64_t factor64_isqrt128(unsigned __int128 n)
+static uint64_t factor64_isqrt128(unsigned __int128 n) {
+
+	unsigned __int128 x, y;
+
+	if (n >> 64 == 0) {
+		return factor64_isqrt(n);
+	}
+
+	// as above; n is below 2^76 here, so x is below 2^39
+	x = (unsigned __int128) 1 << ((128 - __builtin_clzll(n >> 64) + 1) / 2);
+	for (y = (x + n / x) / 2; y < x; y = (x + n / x) / 2) {
+		x = y;
+	}
+
+	return x;
+
+} // }}}
+
+// {{{ uint64_t factor64_rho(uint64_t n, uint64_t iterations)
+uint64_t factor64_rho(uint64_t n, uint64_t iterations) {
+
+	mont64_t m;
+	uint64_t c, x, y, ys, q, g, r, k, i, steps = 0;
+
+	// Brent's cycle finding on y -> y^2 + c, multiplying
+	// FACTOR64_RHO_BATCH differences together per gcd
+	mont64_init(&m, n);
+
+	for (c = 1; ; c++) {
+
+		uint64_t cm = mont64_to(&m, c);
+
+		y = mont64_to(&m, 2);
+		ys = y;
+		x = y;
+		q = m.one;
+		g = 1;
+
+		for (r = 1; g == 1; r *= 2) {
+			if (iterations != 0 && steps >= iterations) {
+				return 0;
+			}
+			x = y;
+			for (i = 0; i < r; i++) {
+				y = mont64_add(&m, mont64_mul(&m, y, y), cm);
+			}
+			for (k = 0; k < r && g == 1; k += FACTOR64_RHO_BATCH) {
+				ys = y;
+				for (i = 0; i < FACTOR64_RHO_BATCH && i < r - k; i++) {
+					y = mont64_add(&m, mont64_mul(&m, y, y), cm);
+					q = mont64_mul(&m, q, x > y ? x - y : y - x);
+				}
+				g = factor64_gcd(q, n);
+			}
+			steps += 2 * r;
+		}
+
+		// the batch overshot, step through it again one at a time
+		if (g == n) {
+			do {
+				ys = mont64_add(&m, mont64_mul(&m, ys, ys), cm);
+				g = factor64_gcd(x > ys ? x - ys : ys - x, n);
+			} while (g == 1);
+		}
+
+		if (g != n) {
+			return g;
+		}
+
+	}
+
+} // }}}
+
+// {{{ uint64_t factor64_squfof(uint64_t n, uint64_t iterations)
+uint64_t factor64_squfof(uint64_t n, uint64_t iterations) {
+
+	// small square free multipliers, tried in turn
+	static const uint32_t multipliers[] = {
+		1, 3, 5, 7, 11, 3 * 5, 3 * 7, 3 * 11, 5 * 7, 5 * 11, 7 * 11,
+		3 * 5 * 7, 3 * 5 * 11, 3 * 7 * 11, 5 * 7 * 11, 3 * 5 * 7 * 11
+	};
+	uint64_t p0, p, pp, q, qp, b, r, g, s, t, i, bound, spent = 0;
+	unsigned __int128 kn;
+	size_t k;
+
+	s = factor64_isqrt(n);
+	if (s * s == n) {
+		return s;
+	}
+
+	for (k = 0; k < sizeof(multipliers) / sizeof(multipliers[0]); k++) {
+
+		// kn takes up to 75 bits, but P and Q stay below 2 sqrt(kn), so
+		// only it and P0^2 need more than a uint64_t
+		kn = (unsigned __int128) multipliers[k] * n;
+
+		// forward along the continued fraction of sqrt(kn), looking for
+		// a square Q at an even step
+		p0 = pp = p = factor64_isqrt128(kn);
+		qp = 1;
+		q = kn - (unsigned __int128) p0 * p0;
+		if (q == 0) {
+			continue;
+		}
+		bound = 6 * factor64_isqrt(2 * p0);
+
+		for (i = 2; i < bound; i++) {
+			b = (p0 + p) / q;
+			p = b * q - p;
+			t = q;
+			q = qp + b * (pp - p);
+			// squares mod 64 before the square root
+			if ((i & 1) == 0 && (0x0202021202030213ULL >> (q & 63)) & 1) {
+				r = factor64_isqrt(q);
+				if (r * r == q) {
+					break;
+				}
+			}
+			qp = t;
+			pp = p;
+		}
+
+		spent += i;
+		if (i >= bound) {
+			if (iterations != 0 && spent >= iterations) {
+				return 0;
+			}
+			continue;
+		}
+
+		// then the reverse cycle from the square root, until P repeats
+		b = (p0 - p) / r;
+		pp = p = b * r + p;
+		qp = r;
+		q = (kn - (unsigned __int128) pp * pp) / qp;
+		do {
+			b = (p0 + p) / q;
+			pp = p;
+			p = b * q - p;
+			t = q;
+			q = qp + b * (pp - p);
+			qp = t;
+		} while (p != pp);
+
+		g = factor64_gcd(n, qp);
+		if (g != 1 && g != n) {
+			return g;
+		}
+		if (iterations != 0 && spent >= iterations) {
+			return 0;
+		}
+
+	}
+
+	return 0;
+
+} // }}}
+
+// {{{ static void factor64_ecm_primes_init(void)
+static void factor64_ecm_primes_init(void) {
+
+	uint32_t i, j;
+
+	// a plain sieve of odd numbers; set bits are composite for now
+	for (i = 3; i * i < FACTOR64_ECM_MAX_B2; i += 2) {
+		if ((ecm_prime_bits[i / 128] >> (i / 2 % 64) & 1) == 0) {
+			for (j = i * i; j < FACTOR64_ECM_MAX_B2; j += 2 * i) {
+				ecm_prime_bits[j / 128] |= (uint64_t) 1 << (j / 2 % 64);
+			}
+		}
+	}
+
+	ecm_primes[ecm_prime_count++] = 2;
+	for (i = 0; i < FACTOR64_ECM_MAX_B2 / 128; i++) {
+		ecm_prime_bits[i] = ~ecm_prime_bits[i];
+	}
+	ecm_prime_bits[0] &= ~(uint64_t) 1;
+	for (i = 3; i < FACTOR64_ECM_MAX_B2; i += 2) {
+		if (ecm_prime_bits[i / 128] >> (i / 2 % 64) & 1) {
+			ecm_primes[ecm_prime_count++] = i;
+		}
+	}
+
+} // }}}
+// {{{ static inline int factor64_ecm_is_prime(uint64_t q)
+static inline int factor64_ecm_is_prime(uint64_t q) {
+	return q % 2 == 1 && (ecm_prime_bits[q / 128] >> (q / 2 % 64) & 1);
+} // }}}
+// {{{ static uint64_t factor64_inverse(uint64_t a, uint64_t n, uint64_t *inv_r)
+static uint64_t factor64_inverse(uint64_t a, uint64_t n, uint64_t *inv_r) {
+
+	__int128 t = 0, nt = 1, tmp;
+	uint64_t r = n, nr = a % n, q, tmpr;
+
+	// extended Euclid; the gcd comes back, the inverse only if it is 1
+	while (nr != 0) {
+		q = r / nr;
+		tmp = t - (__int128) q * nt;
+		t = nt;
+		nt = tmp;
+		tmpr = r - q * nr;
+		r = nr;
+		nr = tmpr;
+	}
+
+	*inv_r = t < 0 ? (uint64_t) (t + n) : (uint64_t) t;
+	return r;
+
+} // }}}
+// {{{ static inline void ecm_dbl(const mont64_t *m, uint64_t a24, struct ecm_point *p)
+static inline void ecm_dbl(const mont64_t *m, uint64_t a24, struct ecm_point *p) {
+
+	uint64_t s = mont64_mul(m, mont64_add(m, p->x, p->z), mont64_add(m, p->x, p->z));
+	uint64_t d = mont64_mul(m, mont64_sub(m, p->x, p->z), mont64_sub(m, p->x, p->z));
+	uint64_t t = mont64_sub(m, s, d);
+
+	p->x = mont64_mul(m, s, d);
+	p->z = mont64_mul(m, t, mont64_add(m, d, mont64_mul(m, a24, t)));
+
+} // }}}
+// {{{ static inline void ecm_add(const mont64_t *m, struct ecm_point *p, const struct ecm_point *q, const struct ecm_point *diff)
+static inline void ecm_add(const mont64_t *m, struct ecm_point *p, const struct ecm_point *q,
+		const struct ecm_point *diff) {
+
+	// p += q, given p - q
+	uint64_t u = mont64_mul(m, mont64_sub(m, p->x, p->z), mont64_add(m, q->x, q->z));
+	uint64_t v = mont64_mul(m, mont64_add(m, p->x, p->z), mont64_sub(m, q->x, q->z));
+	uint64_t plus = mont64_add(m, u, v), minus = mont64_sub(m, u, v);
+
+	p->x = mont64_mul(m, diff->z, mont64_mul(m, plus, plus));
+	p->z = mont64_mul(m, diff->x, mont64_mul(m, minus, minus));
+
+} // }}}
+// {{{ static void ecm_ladder(const mont64_t *m, uint64_t a24, uint64_t k, struct ecm_point *p)
+static void ecm_ladder(const mont64_t *m, uint64_t a24, uint64_t k, struct ecm_point *p) {
+
+	struct ecm_point r0 = *p, r1 = *p, base = *p;
+	int bit;
+
+	// p = k * p, keeping r1 - r0 = p throughout; k >= 1
+	ecm_dbl(m, a24, &r1);
+	for (bit = 62 - __builtin_clzll(k); bit >= 0; bit--) {
+		if (k >> bit & 1) {
+			ecm_add(m, &r0, &r1, &base);
+			ecm_dbl(m, a24, &r1);
+		} else {
+			ecm_add(m, &r1, &r0, &base);
+			ecm_dbl(m, a24, &r0);
+		}
+	}
+
+	*p = r0;
+
+} // }}}
+// {{{ static uint64_t factor64_ecm_curve(const mont64_t *m, uint64_t sigma, uint32_t b1, uint32_t b2)
+static uint64_t factor64_ecm_curve(const mont64_t *m, uint64_t sigma, uint32_t b1, uint32_t b2) {
+
+	struct ecm_point p, d, baby[sizeof(ecm_baby_steps)], r, rp, step, t;
+	uint64_t u, v, a24, num, den, inv, g, pk, acc;
+	size_t i, j;
+
+	// Suyama's parametrisation: a curve with a point of known order 12
+	// component, from u = sigma^2 - 5 and v = 4 sigma
+	u = mont64_sub(m, mont64_mul(m, mont64_to(m, sigma), mont64_to(m, sigma)), mont64_to(m, 5));
+	v = mont64_to(m, 4 * sigma);
+	p.x = mont64_mul(m, mont64_mul(m, u, u), u);
+	p.z = mont64_mul(m, mont64_mul(m, v, v), v);
+
+	// (A + 2) / 4 = (v - u)^3 (3u + v) / (16 u^3 v)
+	t.x = mont64_sub(m, v, u);
+	num = mont64_mul(m, mont64_mul(m, mont64_mul(m, t.x, t.x), t.x),
+			mont64_add(m, mont64_add(m, mont64_add(m, u, u), u), v));
+	den = mont64_mul(m, mont64_mul(m, mont64_to(m, 16), p.x), v);
+	if ((g = factor64_inverse(mont64_from(m, den), m->n, &inv)) != 1) {
+		return g == m->n ? 0 : g;
+	}
+	a24 = mont64_mul(m, num, mont64_to(m, inv));
+
+	// stage 1: every prime power up to b1
+	for (i = 0; i < ecm_prime_count && ecm_primes[i] <= b1; i++) {
+		for (pk = ecm_primes[i]; pk * ecm_primes[i] <= b1; pk *= ecm_primes[i]) {
+		}
+		ecm_ladder(m, a24, pk, &p);
+	}
+
+	g = factor64_gcd(mont64_from(m, p.z), m->n);
+	if (g != 1) {
+		return g == m->n ? 0 : g;
+	}
+
+	// stage 2: one more prime q in (b1, b2]; q = kD +- j lands p on
+	// the same x as j p, which the cross products below catch
+	d = p;
+	ecm_dbl(m, a24, &d);
+	r = p;						// odd multiples j p, with (j - 2) p in r
+	t = d;
+	ecm_add(m, &t, &p, &p);
+	baby[0] = p;
+	for (j = 3, i = 1; i < sizeof(ecm_baby_steps); j += 2) {
+		if (j == ecm_baby_steps[i]) {
+			baby[i++] = t;
+		}
+		rp = t;
+		ecm_add(m, &t, &d, &r);
+		r = rp;
+	}
+
+	step = p;
+	ecm_ladder(m, a24, FACTOR64_ECM_D, &step);
+	u = (b1 + FACTOR64_ECM_D / 2) / FACTOR64_ECM_D;
+	if (u == 0) {
+		u = 1;
+	}
+	r = p;
+	ecm_ladder(m, a24, u * FACTOR64_ECM_D, &r);
+	rp = p;
+	ecm_ladder(m, a24, (u + 1) * FACTOR64_ECM_D, &rp);
+
+	acc = m->one;
+	for (; (u - 1) * FACTOR64_ECM_D < b2; u++) {
+		for (i = 0; i < sizeof(ecm_baby_steps); i++) {
+			num = u * FACTOR64_ECM_D - ecm_baby_steps[i];
+			den = u * FACTOR64_ECM_D + ecm_baby_steps[i];
+			if ((num > b1 && num <= b2 && factor64_ecm_is_prime(num))
+					|| (den > b1 && den <= b2 && factor64_ecm_is_prime(den))) {
+				acc = mont64_mul(m, acc, mont64_sub(m, mont64_mul(m, r.x, baby[i].z),
+						mont64_mul(m, baby[i].x, r.z)));
+			}
+		}
+		t = rp;
+		ecm_add(m, &t, &step, &r);
+		r = rp;
+		rp = t;
+	}
+
+	g = factor64_gcd(mont64_from(m, acc), m->n);
+	return g == 1 || g == m->n ? 0 : g;
+
+} // }}}
+// {{{ uint64_t factor64_ecm(uint64_t n, uint32_t curves, uint32_t b1, uint32_t b2)
+uint64_t factor64_ecm(uint64_t n, uint32_t curves, uint32_t b1, uint32_t b2) {
+
+	mont64_t m;
+	uint64_t g;
+	uint32_t c;
+
+	pthread_once(&ecm_primes_once, factor64_ecm_primes_init);
+
+	if (b2 >= FACTOR64_ECM_MAX_B2) {
+		b2 = FACTOR64_ECM_MAX_B2 - 1;
+	}
+	if (b1 > b2) {
+		b1 = b2;
+	}
+
+	mont64_init(&m, n);
+	for (c = 0; c < curves; c++) {
+		if ((g = factor64_ecm_curve(&m, 6 + c, b1, b2)) != 0) {
+			return g;
+		}
+	}
+
+	return 0;
+
+} // }}}
+
+// {{{ uint64_t factor64_split(uint64_t n, const factor_effort_t *effort)
+uint64_t factor64_split(uint64_t n, const factor_effort_t *effort) {
+
+	int bits = 64 - __builtin_clzll(n);
+	uint32_t b1;
+	uint64_t d;
+
+	if (bits < FACTOR64_ECM_BITS) {
+		if ((d = factor64_rho(n, effort->rho_iterations)) != 0) {
+			return d;
+		}
+	}
+
+	// bigger cofactors can have bigger smallest factors: ECM with
+	// bounds to match
+	if (bits >= FACTOR64_ECM_BITS) {
+		b1 = effort->ecm_b1 != 0 ? effort->ecm_b1 : bits <= 52 ? 85 : bits <= 58 ? 125 : 165;
+		if ((d = factor64_ecm(n, effort->ecm_curves, b1,
+				effort->ecm_b2 != 0 ? effort->ecm_b2 : 25 * b1)) != 0) {
+			return d;
+		}
+	}
+
+	if (bits >= FACTOR64_SQUFOF_BITS) {
+		if ((d = factor64_squfof(n, effort->squfof_iterations)) != 0) {
+			return d;
+		}
+	}
+
+	// always succeeds in the end
+	return factor64_rho(n, 0);
+
+} // }}}
@@ -0,0 +1,26 @@
+#ifndef factor64_h
+#define factor64_h
+
+#include <stdint.h>
+
+#include "factor.h"
+
+// the stages factor_ctx_finish uses on cofactors that survive trial
+// division, each working on a single uint64_t
+
+// exact for every uint64_t; n odd and > 1
+int factor64_is_prime(uint64_t n);
+
+uint64_t factor64_gcd(uint64_t a, uint64_t b);
+
+// each returns a nontrivial factor of the odd composite n, or 0 once it
+// has spent its effort without finding one (0 effort: no limit for rho)
+uint64_t factor64_rho(uint64_t n, uint64_t iterations);
+uint64_t factor64_squfof(uint64_t n, uint64_t iterations);
+uint64_t factor64_ecm(uint64_t n, uint32_t curves, uint32_t b1, uint32_t b2);
+
+// a nontrivial factor of the odd composite n, trying the stages that suit
+// its size in turn within effort, then rho without limit
+uint64_t factor64_split(uint64_t n, const factor_effort_t *effort);
+
+#endif
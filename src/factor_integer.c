@@ -0,0 +1,610 @@
+#include "factor_integer.h"
+
+#include <string.h>
+
+#include "factor64.h"
+#include "factor_siqs.h"
+
+// differences multiplied together between gcds in rho
+#define FACTOR_INTEGER_RHO_BATCH 128
+
+// B1 grows by this much each time a full set of curves comes up empty
+#define FACTOR_INTEGER_ECM_GROWTH 4
+
+// the short ECM pass ahead of SIQS looks for factors well below half the
+// size of n at this B1, with one curve per this many bits past
+// FACTOR_SIQS_MIN_BITS
+#define FACTOR_INTEGER_SIQS_B1 2000
+#define FACTOR_INTEGER_SIQS_CURVE_BITS 8
+
+// the stage 2 giant step, and how many j < D / 2 are coprime to it
+#define FACTOR_INTEGER_ECM_D 210
+#define FACTOR_INTEGER_ECM_BABY 24
+
+// points ECM keeps per curve: P, 2P, the ladder's three, the giant
+// step and three giant points, two odd multiples, and the baby steps
+#define FACTOR_INTEGER_ECM_POINTS (13 + FACTOR_INTEGER_ECM_BABY)
+
+// arithmetic modulo n on reduced operands, through the temporaries kept
+// here, so results may alias operands
+struct mod_ctx {
+	integer_t *n;
+	integer_t *prod;
+	integer_t *quot;
+	integer_t *t;
+};
+
+// a point on a Montgomery curve, as X:Z
+struct ecm_point {
+	integer_t *x;
+	integer_t *z;
+};
+
+// a curve, by (A + 2) / 4 kept as a fraction so it never needs inverting,
+// and everything its arithmetic works in
+struct ecm_ctx {
+	struct mod_ctx m;
+	integer_t *a24n;
+	integer_t *a24d;
+	integer_t *acc;
+	integer_t *t[5];
+	struct ecm_point pt[FACTOR_INTEGER_ECM_POINTS];
+};
+
+// {{{ static void integers_free(integer_t **v, size_t count)
+static void integers_free(integer_t **v, size_t count) {
+
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		integer_free(v[i]);
+		v[i] = NULL;
+	}
+
+} // }}}
+// {{{ static int integers_new(integer_t **v, size_t count)
+static int integers_new(integer_t **v, size_t count) {
+
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if ((v[i] = integer_new_zero()) == NULL) {
+			integers_free(v, i);
+			return -1;
+		}
+	}
+
+	return 0;
+
+} // }}}
+
+// {{{ static void mod_free(struct mod_ctx *m)
+static void mod_free(struct mod_ctx *m) {
+
+	integer_free(m->prod);
+	integer_free(m->quot);
+	integer_free(m->t);
+
+} // }}}
+// {{{ static int mod_init(struct mod_ctx *m, integer_t *n)
+static int mod_init(struct mod_ctx *m, integer_t *n) {
+
+	m->n = n;
+	m->prod = integer_new_zero();
+	m->quot = integer_new_zero();
+	m->t = integer_new_zero();
+
+	if (m->prod == NULL || m->quot == NULL || m->t == NULL) {
+		mod_free(m);
+		return -1;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static inline void mod_mul(struct mod_ctx *m, integer_t *a, integer_t *b, integer_t *r)
+static inline void mod_mul(struct mod_ctx *m, integer_t *a, integer_t *b, integer_t *r) {
+
+	integer_mult(a, b, m->prod);
+	integer_div(m->prod, m->n, m->quot, r);
+
+} // }}}
+// {{{ static inline void mod_add(struct mod_ctx *m, integer_t *a, integer_t *b, integer_t *r)
+static inline void mod_add(struct mod_ctx *m, integer_t *a, integer_t *b, integer_t *r) {
+
+	integer_add(a, b, m->t);
+	if (integer_cmp(m->t, m->n) >= 0) {
+		integer_sub(m->t, m->n, r);
+	} else {
+		integer_copy(r, m->t);
+	}
+
+} // }}}
+// {{{ static inline void mod_sub(struct mod_ctx *m, integer_t *a, integer_t *b, integer_t *r)
+static inline void mod_sub(struct mod_ctx *m, integer_t *a, integer_t *b, integer_t *r) {
+
+	if (integer_cmp(a, b) >= 0) {
+		integer_sub(a, b, m->t);
+	} else {
+		integer_add(a, m->n, m->prod);
+		integer_sub(m->prod, b, m->t);
+	}
+	integer_copy(r, m->t);
+
+} // }}}
+// {{{ static void mod_pow(struct mod_ctx *m, integer_t *a, integer_t *e, integer_t *r)
+static void mod_pow(struct mod_ctx *m, integer_t *a, integer_t *e, integer_t *r) {
+
+	size_t bit;
+
+	// left to right; r must not be a
+	integer_set_u64(r, 1);
+	for (bit = integer_bit_length(e); bit > 0; bit--) {
+		mod_mul(m, r, r, r);
+		if (integer_test_bit(e, bit - 1)) {
+			mod_mul(m, r, a, r);
+		}
+	}
+
+} // }}}
+// {{{ static void mod_gcd(struct mod_ctx *m, integer_t *a, integer_t *g_r)
+static void mod_gcd(struct mod_ctx *m, integer_t *a, integer_t *g_r) {
+
+	integer_t *x = g_r, *y = m->t, *z = m->prod, *w;
+
+	// Euclid, rotating the remainders through g_r and the temporaries;
+	// gcd(0, n) is n
+	integer_copy(y, a);
+	integer_copy(x, m->n);
+	while (integer_bit_length(y) != 0) {
+		integer_div(x, y, m->quot, z);
+		w = x;
+		x = y;
+		y = z;
+		z = w;
+	}
+
+	if (x != g_r) {
+		integer_copy(g_r, x);
+	}
+
+} // }}}
+
+// {{{ int factor_integer_is_prime(integer_t *n)
+int factor_integer_is_prime(integer_t *n) {
+
+	// together these leave no strong pseudoprime below 3.3 * 10^24
+	static const uint64_t bases[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+	struct mod_ctx m;
+	integer_t *v[4];
+	int i, r, s, prime = 1;
+
+	if (mod_init(&m, n) == -1) {
+		return -1;
+	}
+	if (integers_new(v, 4) == -1) {
+		mod_free(&m);
+		return -1;
+	}
+
+	integer_t *d = v[0], *a = v[1], *x = v[2], *minus_one = v[3];
+
+	// n - 1 = d * 2^s
+	integer_set_u64(a, 1);
+	integer_sub(n, a, minus_one);
+	integer_copy(d, minus_one);
+	for (s = 0; !integer_test_bit(d, 0); s++) {
+		integer_div_u64(d, 2, d);
+	}
+
+	for (i = 0; prime && i < (int) (sizeof(bases) / sizeof(bases[0])); i++) {
+
+		integer_set_u64(a, bases[i]);
+		mod_pow(&m, a, d, x);
+		if (integer_bit_length(x) == 1 || integer_cmp(x, minus_one) == 0) {
+			continue;
+		}
+
+		for (r = 1; r < s && integer_cmp(x, minus_one) != 0; r++) {
+			mod_mul(&m, x, x, x);
+		}
+		prime = integer_cmp(x, minus_one) == 0;
+
+	}
+
+	integers_free(v, 4);
+	mod_free(&m);
+	return prime;
+
+} // }}}
+
+// {{{ static int factor_integer_rho(struct mod_ctx *m, uint64_t iterations, integer_t *d_r)
+static int factor_integer_rho(struct mod_ctx *m, uint64_t iterations, integer_t *d_r) {
+
+	integer_t *v[6];
+	uint64_t c, r, k, i, steps = 0;
+	int found = 0;
+
+	if (integers_new(v, 6) == -1) {
+		return -1;
+	}
+
+	integer_t *cv = v[0], *x = v[1], *y = v[2], *ys = v[3], *q = v[4], *diff = v[5];
+
+	// Brent's cycle finding on y -> y^2 + c, as in factor64_rho; a c
+	// whose cycle closes without a factor moves on to the next
+	for (c = 1; !found; c++) {
+
+		integer_set_u64(cv, c);
+		integer_set_u64(y, 2);
+		integer_set_u64(q, 1);
+		integer_set_u64(d_r, 1);
+
+		for (r = 1; integer_bit_length(d_r) == 1; r *= 2) {
+			if (iterations != 0 && steps >= iterations) {
+				integers_free(v, 6);
+				return 1;
+			}
+			integer_copy(x, y);
+			for (i = 0; i < r; i++) {
+				mod_mul(m, y, y, y);
+				mod_add(m, y, cv, y);
+			}
+			for (k = 0; k < r && integer_bit_length(d_r) == 1; k += FACTOR_INTEGER_RHO_BATCH) {
+				integer_copy(ys, y);
+				for (i = 0; i < FACTOR_INTEGER_RHO_BATCH && i < r - k; i++) {
+					mod_mul(m, y, y, y);
+					mod_add(m, y, cv, y);
+					if (integer_cmp(x, y) > 0) {
+						integer_sub(x, y, diff);
+					} else {
+						integer_sub(y, x, diff);
+					}
+					mod_mul(m, q, diff, q);
+				}
+				mod_gcd(m, q, d_r);
+			}
+			steps += 2 * r;
+		}
+
+		// the batch overshot, step through it again one at a time
+		if (integer_cmp(d_r, m->n) == 0) {
+			do {
+				mod_mul(m, ys, ys, ys);
+				mod_add(m, ys, cv, ys);
+				if (integer_cmp(x, ys) > 0) {
+					integer_sub(x, ys, diff);
+				} else {
+					integer_sub(ys, x, diff);
+				}
+				mod_gcd(m, diff, d_r);
+			} while (integer_bit_length(d_r) == 1);
+		}
+
+		found = integer_cmp(d_r, m->n) != 0;
+
+	}
+
+	integers_free(v, 6);
+	return 0;
+
+} // }}}
+
+// {{{ static void ecm_free(struct ecm_ctx *e)
+static void ecm_free(struct ecm_ctx *e) {
+
+	size_t i;
+
+	mod_free(&e->m);
+	integer_free(e->a24n);
+	integer_free(e->a24d);
+	integer_free(e->acc);
+	integers_free(e->t, 5);
+	for (i = 0; i < FACTOR_INTEGER_ECM_POINTS; i++) {
+		integer_free(e->pt[i].x);
+		integer_free(e->pt[i].z);
+	}
+
+} // }}}
+// {{{ static int ecm_init(struct ecm_ctx *e, integer_t *n)
+static int ecm_init(struct ecm_ctx *e, integer_t *n) {
+
+	size_t i;
+
+	memset(e, 0, sizeof(struct ecm_ctx));
+	if (mod_init(&e->m, n) == -1) {
+		return -1;
+	}
+
+	e->a24n = integer_new_zero();
+	e->a24d = integer_new_zero();
+	e->acc = integer_new_zero();
+	if (e->a24n == NULL || e->a24d == NULL || e->acc == NULL
+			|| integers_new(e->t, 5) == -1) {
+		ecm_free(e);
+		return -1;
+	}
+	for (i = 0; i < FACTOR_INTEGER_ECM_POINTS; i++) {
+		if ((e->pt[i].x = integer_new_zero()) == NULL
+				|| (e->pt[i].z = integer_new_zero()) == NULL) {
+			ecm_free(e);
+			return -1;
+		}
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static inline void ecm_copy(struct ecm_point *p, const struct ecm_point *q)
+static inline void ecm_copy(struct ecm_point *p, const struct ecm_point *q) {
+
+	integer_copy(p->x, q->x);
+	integer_copy(p->z, q->z);
+
+} // }}}
+// {{{ static void ecm_dbl(struct ecm_ctx *e, struct ecm_point *p)
+static void ecm_dbl(struct ecm_ctx *e, struct ecm_point *p) {
+
+	struct mod_ctx *m = &e->m;
+	integer_t **t = e->t;
+
+	// as in factor64's ecm_dbl, with both coordinates scaled by the
+	// denominator of (A + 2) / 4
+	mod_add(m, p->x, p->z, t[0]);
+	mod_mul(m, t[0], t[0], t[0]);
+	mod_sub(m, p->x, p->z, t[1]);
+	mod_mul(m, t[1], t[1], t[1]);
+	mod_sub(m, t[0], t[1], t[2]);
+
+	mod_mul(m, t[0], t[1], p->x);
+	mod_mul(m, p->x, e->a24d, p->x);
+	mod_mul(m, t[1], e->a24d, t[3]);
+	mod_mul(m, t[2], e->a24n, t[4]);
+	mod_add(m, t[3], t[4], t[3]);
+	mod_mul(m, t[2], t[3], p->z);
+
+} // }}}
+// {{{ static void ecm_add(struct ecm_ctx *e, struct ecm_point *p, const struct ecm_point *q, const struct ecm_point *diff)
+static void ecm_add(struct ecm_ctx *e, struct ecm_point *p, const struct ecm_point *q,
+		const struct ecm_point *diff) {
+
+	struct mod_ctx *m = &e->m;
+	integer_t **t = e->t;
+
+	// p += q, given p - q
+	mod_sub(m, p->x, p->z, t[0]);
+	mod_add(m, q->x, q->z, t[1]);
+	mod_mul(m, t[0], t[1], t[0]);
+	mod_add(m, p->x, p->z, t[1]);
+	mod_sub(m, q->x, q->z, t[2]);
+	mod_mul(m, t[1], t[2], t[1]);
+
+	mod_add(m, t[0], t[1], t[2]);
+	mod_sub(m, t[0], t[1], t[3]);
+	mod_mul(m, t[2], t[2], t[2]);
+	mod_mul(m, t[3], t[3], t[3]);
+	mod_mul(m, diff->z, t[2], p->x);
+	mod_mul(m, diff->x, t[3], p->z);
+
+} // }}}
+// {{{ static void ecm_ladder(struct ecm_ctx *e, uint64_t k, struct ecm_point *p)
+static void ecm_ladder(struct ecm_ctx *e, uint64_t k, struct ecm_point *p) {
+
+	struct ecm_point *r0 = &e->pt[2], *r1 = &e->pt[3], *base = &e->pt[4];
+	int bit;
+
+	// p = k * p, keeping r1 - r0 = p throughout; k >= 1
+	ecm_copy(r0, p);
+	ecm_copy(r1, p);
+	ecm_copy(base, p);
+	ecm_dbl(e, r1);
+	for (bit = 62 - __builtin_clzll(k); bit >= 0; bit--) {
+		if (k >> bit & 1) {
+			ecm_add(e, r0, r1, base);
+			ecm_dbl(e, r1);
+		} else {
+			ecm_add(e, r1, r0, base);
+			ecm_dbl(e, r0);
+		}
+	}
+
+	ecm_copy(p, r0);
+
+} // }}}
+// {{{ static int factor_integer_ecm_curve(struct ecm_ctx *e, prime_table_t *primes, uint64_t sigma, uint64_t b1, uint64_t b2, integer_t *d_r)
+static int factor_integer_ecm_curve(struct ecm_ctx *e, prime_table_t *primes, uint64_t sigma,
+		uint64_t b1, uint64_t b2, integer_t *d_r) {
+
+	struct mod_ctx *m = &e->m;
+	integer_t **t = e->t;
+	struct ecm_point *p = &e->pt[0], *d = &e->pt[1], *step = &e->pt[5];
+	struct ecm_point *odd = &e->pt[6], *giant = &e->pt[8], *baby = &e->pt[11];
+	struct ecm_point swap;
+	signed char baby_index[FACTOR_INTEGER_ECM_D / 2 + 1];
+	prime_table_iter_t it;
+	uint64_t q = 0, pk, u, j;
+	size_t i;
+	int more;
+
+	// Suyama's parametrisation, as in factor64_ecm_curve, but keeping
+	// (A + 2) / 4 = (v - u)^3 (3u + v) / (16 u^3 v) as a fraction
+	integer_set_u64(t[0], sigma * sigma - 5);
+	integer_set_u64(t[1], 4 * sigma);
+	mod_mul(m, t[0], t[0], p->x);
+	mod_mul(m, p->x, t[0], p->x);
+	mod_mul(m, t[1], t[1], p->z);
+	mod_mul(m, p->z, t[1], p->z);
+
+	mod_sub(m, t[1], t[0], t[2]);
+	mod_mul(m, t[2], t[2], e->a24n);
+	mod_mul(m, e->a24n, t[2], e->a24n);
+	mod_add(m, t[0], t[0], t[3]);
+	mod_add(m, t[3], t[0], t[3]);
+	mod_add(m, t[3], t[1], t[3]);
+	mod_mul(m, e->a24n, t[3], e->a24n);
+	integer_set_u64(t[3], 16);
+	mod_mul(m, p->x, t[1], e->a24d);
+	mod_mul(m, e->a24d, t[3], e->a24d);
+
+	// stage 1: every prime power up to b1
+	prime_table_iter_init(primes, 0, &it);
+	while ((more = prime_table_iter_next(&it, &q)) && q <= b1) {
+		for (pk = q; pk <= b1 / q; pk *= q) {
+		}
+		ecm_ladder(e, pk, p);
+	}
+
+	mod_gcd(m, p->z, d_r);
+	if (integer_bit_length(d_r) != 1) {
+		return integer_cmp(d_r, m->n) == 0;
+	}
+
+	// stage 2: one more prime q in (b1, b2], read from the table in order;
+	// q = uD +- j lands p on the same x as j p, which the cross product of
+	// giant[0] = uD p with baby j catches
+	memset(baby_index, -1, sizeof(baby_index));
+	ecm_copy(d, p);
+	ecm_dbl(e, d);
+	ecm_copy(&odd[0], p);			// odd multiples j p, (j - 2) p before them
+	ecm_copy(&odd[1], d);
+	ecm_add(e, &odd[1], p, p);
+	ecm_copy(&baby[0], p);
+	baby_index[1] = 0;
+	for (j = 3, i = 1; i < FACTOR_INTEGER_ECM_BABY; j += 2) {
+		if (factor64_gcd(j, FACTOR_INTEGER_ECM_D) == 1) {
+			baby_index[j] = i;
+			ecm_copy(&baby[i++], &odd[1]);
+		}
+		// (j + 2) p in giant[0], free until the giant steps start
+		ecm_copy(&giant[0], &odd[1]);
+		ecm_add(e, &giant[0], d, &odd[0]);
+		swap = odd[0];
+		odd[0] = odd[1];
+		odd[1] = giant[0];
+		giant[0] = swap;
+	}
+
+	ecm_copy(step, p);
+	ecm_ladder(e, FACTOR_INTEGER_ECM_D, step);
+	u = (b1 + FACTOR_INTEGER_ECM_D / 2) / FACTOR_INTEGER_ECM_D;
+	ecm_copy(&giant[0], p);
+	ecm_ladder(e, u * FACTOR_INTEGER_ECM_D, &giant[0]);
+	ecm_copy(&giant[1], p);
+	ecm_ladder(e, (u + 1) * FACTOR_INTEGER_ECM_D, &giant[1]);
+
+	integer_set_u64(e->acc, 1);
+	for (; more && q <= b2; more = prime_table_iter_next(&it, &q)) {
+
+		// giant[2] = giant[1] + step, from their difference giant[0]
+		for (; u < (q + FACTOR_INTEGER_ECM_D / 2) / FACTOR_INTEGER_ECM_D; u++) {
+			ecm_copy(&giant[2], &giant[1]);
+			ecm_add(e, &giant[2], step, &giant[0]);
+			swap = giant[0];
+			giant[0] = giant[1];
+			giant[1] = giant[2];
+			giant[2] = swap;
+		}
+
+		j = q > u * FACTOR_INTEGER_ECM_D ? q - u * FACTOR_INTEGER_ECM_D : u * FACTOR_INTEGER_ECM_D - q;
+		i = baby_index[j];
+		mod_mul(m, giant[0].x, baby[i].z, t[0]);
+		mod_mul(m, baby[i].x, giant[0].z, t[1]);
+		mod_sub(m, t[0], t[1], t[0]);
+		mod_mul(m, e->acc, t[0], e->acc);
+
+	}
+
+	mod_gcd(m, e->acc, d_r);
+	return integer_bit_length(d_r) == 1 || integer_cmp(d_r, m->n) == 0;
+
+} // }}}
+// {{{ static int factor_integer_ecm(integer_t *n, prime_table_t *primes, const factor_effort_t *effort, uint64_t b1, uint32_t rounds, integer_t *d_r)
+static int factor_integer_ecm(integer_t *n, prime_table_t *primes, const factor_effort_t *effort,
+		uint64_t b1, uint32_t rounds, integer_t *d_r) {
+
+	struct ecm_ctx e;
+	uint64_t b2, sigma = 6, limit = prime_table_last(primes);
+	uint32_t c, round;
+
+	if (ecm_init(&e, n) == -1) {
+		return -1;
+	}
+
+	// rounds of curves with B1 growing until the table runs out, then
+	// more curves at the largest bounds it allows; with rounds 0, never
+	// gives up
+	for (round = 0; rounds == 0 || round < rounds; round++) {
+		b2 = effort->ecm_b2 != 0 ? effort->ecm_b2 : 25 * b1;
+		if (b2 > limit) {
+			b2 = limit;
+		}
+		if (b1 > b2) {
+			b1 = b2;
+		}
+		for (c = 0; c < effort->ecm_curves; c++, sigma++) {
+			if (factor_integer_ecm_curve(&e, primes, sigma, b1, b2, d_r) == 0) {
+				ecm_free(&e);
+				return 0;
+			}
+		}
+		b1 *= FACTOR_INTEGER_ECM_GROWTH;
+	}
+
+	ecm_free(&e);
+	return 1;
+
+} // }}}
+
+// {{{ int factor_integer_split(integer_t *n, prime_table_t *primes, const factor_effort_t *effort, integer_t *d_r)
+int factor_integer_split(integer_t *n, prime_table_t *primes,
+		const factor_effort_t *effort, integer_t *d_r) {
+
+	struct mod_ctx m;
+	factor_effort_t brief;
+	size_t bits = integer_bit_length(n);
+	uint64_t b1;
+	int found;
+
+	// rho for the small factors that trial division did not reach...
+	if (mod_init(&m, n) == -1) {
+		return -1;
+	}
+	found = factor_integer_rho(&m, effort->rho_iterations, d_r);
+	mod_free(&m);
+	if (found != 1) {
+		return found;
+	}
+
+	// ...then, in the range of SIQS, a few ECM curves for factors small
+	// enough that SIQS would be wasted on them, and SIQS itself, which
+	// does not care how the factors are sized...
+	if (bits >= FACTOR_SIQS_MIN_BITS && bits <= FACTOR_SIQS_MAX_BITS) {
+		brief = *effort;
+		brief.ecm_curves = (bits - FACTOR_SIQS_MIN_BITS) / FACTOR_INTEGER_SIQS_CURVE_BITS;
+		brief.ecm_b2 = 0;
+		found = factor_integer_ecm(n, primes, &brief, FACTOR_INTEGER_SIQS_B1, 1, d_r);
+		if (found != 1) {
+			return found;
+		}
+		found = factor_siqs(n, primes, d_r);
+		if (found != 1) {
+			return found;
+		}
+	}
+
+	// ...and ECM to the end, starting from bounds that suit a factor of
+	// half the size of n, at least D so stage 2 starts past the baby steps
+	if (effort->ecm_b1 != 0) {
+		b1 = effort->ecm_b1;
+	} else {
+		b1 = bits <= 80 ? 400 : bits <= 100 ? 2000 : bits <= 132 ? 11000 : 50000;
+	}
+	if (b1 < FACTOR_INTEGER_ECM_D) {
+		b1 = FACTOR_INTEGER_ECM_D;
+	}
+
+	return factor_integer_ecm(n, primes, effort, b1, 0, d_r);
+
+} // }}}
+
+// vim: fdm=marker ts=4
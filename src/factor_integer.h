@@ -0,0 +1,25 @@
+#ifndef factor_integer_h
+#define factor_integer_h
+
+#include <stdint.h>
+
+#include "factor.h"
+#include "integer.h"
+#include "prime_table.h"
+
+// the stages integer_factor_ctx_finish uses on cofactors too big for
+// factor64, each working on an odd n > 2^64 with no small factors; all
+// return -1 and set errno when they run out of memory
+
+// Miller-Rabin to the first twelve prime bases: exact below 3.3 * 10^24,
+// a strong probable prime test past that
+int factor_integer_is_prime(integer_t *n);
+
+// a nontrivial factor of the composite n in d_r: rho within effort, a
+// short ECM pass and SIQS between FACTOR_SIQS_MIN_BITS and
+// FACTOR_SIQS_MAX_BITS, then ECM with growing bounds until it succeeds;
+// ECM stage 2 and the SIQS factor base take their primes from primes
+int factor_integer_split(integer_t *n, prime_table_t *primes,
+		const factor_effort_t *effort, integer_t *d_r);
+
+#endif
@@ -0,0 +1,1145 @@
+#include "factor_siqs.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "typed_vector.h"
+
+// the sieve interval is worked through a block at a time, sized to L1
+#define SIQS_BLOCK 32768
+
+// relations gathered past the number of matrix columns, and how many
+// times to gather that many more when every dependency was trivial
+#define SIQS_EXTRA 64
+#define SIQS_RETRIES 3
+
+// factor base primes below this are trial divided but never sieved
+#define SIQS_SMALL_PRIME 40
+
+// how far below the size of g(x) at the ends of the interval, less a
+// large prime, the sieve reports: most g(x) are smaller than that, and
+// the small primes go unsieved
+#define SIQS_SLACK 14
+
+// A is the product of at most this many factor base primes
+#define SIQS_MAX_A_FACTORS 16
+
+// odd primes the Knuth-Schroeppel score looks at
+#define SIQS_KS_PRIMES 300
+
+// factor base size, sieve blocks either side of 0, and the large prime
+// bound as a multiple of the largest factor base prime, by size of kN;
+// the last row covers kN up to FACTOR_SIQS_MAX_BITS and the largest
+// multiplier, where the dense matrix is still only a couple of MiB
+struct siqs_params {
+	uint32_t bits;
+	uint32_t fb_size;
+	uint32_t blocks;
+	uint32_t large_mult;
+};
+
+static const struct siqs_params siqs_params[] = {
+	{ 100,   120, 1,  30 },
+	{ 133,   300, 1,  40 },
+	{ 166,   800, 1,  50 },
+	{ 199,  1800, 2,  64 },
+	{ 232,  3500, 3,  80 },
+};
+
+// squarefree multipliers k for kN
+static const unsigned char siqs_multipliers[] = {
+	1, 2, 3, 5, 6, 7, 10, 11, 13, 14, 15, 17, 19, 21, 22, 23, 26, 29, 30, 31,
+	33, 34, 35, 37, 38, 39, 41, 42, 43, 46, 47, 51, 53, 55, 57, 58, 59, 61,
+	62, 65, 66, 67, 69, 70, 71, 73
+};
+
+// y^2 = (-1)^e0 * prod p_i^e_i * large^2 (mod kN), with the factor base
+// indices i of the right hand side, repeats and all, at offset in the
+// shared index vector; index 0 stands for -1. A partial relation is the
+// same with large to the first power.
+struct siqs_relation {
+	integer_t *y;
+	uint32_t large;
+	uint32_t offset;
+	uint32_t count;
+};
+
+TYPED_VECTOR(u32, uint32_t)
+TYPED_VECTOR(u64, uint64_t)
+TYPED_VECTOR(relation, struct siqs_relation)
+
+// everything one run of the sieve keeps; the factor base arrays run from
+// 1 to fb_size, matching the matrix columns
+struct siqs {
+
+	integer_t *n;
+	integer_t *kn;
+	uint32_t k;
+	uint32_t divisor;			// a factor base prime dividing n, if any
+
+	uint32_t fb_size;
+	uint32_t *prime;
+	uint32_t *sqrt;				// of kN mod p
+	unsigned char *logp;
+	unsigned char *skip;		// not sieved: small, dividing k, or in A
+	uint32_t *ainv;
+	uint32_t *root[2];			// offsets x + M of the roots mod p
+	uint32_t *next[2];			// next offset to cross off, past the block
+	uint32_t *bainv;			// 2 B_l / A mod p, a row per factor of A
+	uint32_t sieve_start;
+
+	uint32_t m;
+	uint32_t blocks;
+	uint32_t large_max;
+	unsigned int threshold;
+	unsigned char *sieve;
+
+	// the current polynomial (A x + B)^2 - kN = A g(x), with A made of
+	// s primes drawn from [a_lo, a_hi) to come close to target
+	integer_t *target;
+	uint32_t s;
+	uint32_t a_lo;
+	uint32_t a_hi;
+	uint32_t a_idx[SIQS_MAX_A_FACTORS];
+	integer_t *a;
+	integer_t *b;
+	integer_t *bl[SIQS_MAX_A_FACTORS];
+	simple_vector_t *a_seen;
+
+	simple_vector_t *relations;
+	simple_vector_t *partials;
+	simple_vector_t *indices;
+	uint32_t *lp_keys;			// large prime -> partial, open addressing
+	uint32_t *lp_values;
+	size_t lp_size;
+
+	integer_rand_t rand;
+	integer_t *zero;
+	integer_t *t[6];
+
+};
+
+// {{{ static uint32_t siqs_powmod(uint64_t a, uint64_t e, uint32_t p)
+static uint32_t siqs_powmod(uint64_t a, uint64_t e, uint32_t p) {
+
+	uint64_t r = 1;
+
+	for (a %= p; e != 0; e >>= 1) {
+		if (e & 1) {
+			r = r * a % p;
+		}
+		a = a * a % p;
+	}
+
+	return r;
+
+} // }}}
+// {{{ static uint32_t siqs_inverse(uint32_t a, uint32_t p)
+static uint32_t siqs_inverse(uint32_t a, uint32_t p) {
+
+	int64_t t = 0, nt = 1, tmp;
+	uint32_t r = p, nr = a % p, q, tmpr;
+
+	while (nr != 0) {
+		q = r / nr;
+		tmp = t - (int64_t) q * nt;
+		t = nt;
+		nt = tmp;
+		tmpr = r - q * nr;
+		r = nr;
+		nr = tmpr;
+	}
+
+	return t < 0 ? t + p : t;
+
+} // }}}
+// {{{ static uint32_t siqs_sqrtmod(uint32_t a, uint32_t p)
+static uint32_t siqs_sqrtmod(uint32_t a, uint32_t p) {
+
+	uint64_t q, z, c, r, t, b;
+	int s, i, m;
+
+	if (p == 2 || a == 0) {
+		return a;
+	}
+
+	// Tonelli-Shanks: p - 1 = q 2^s, z a non-residue
+	for (q = p - 1, s = 0; q % 2 == 0; q /= 2, s++) {
+	}
+	for (z = 2; siqs_powmod(z, (p - 1) / 2, p) != p - 1; z++) {
+	}
+
+	m = s;
+	c = siqs_powmod(z, q, p);
+	t = siqs_powmod(a, q, p);
+	r = siqs_powmod(a, (q + 1) / 2, p);
+	while (t != 1) {
+		for (i = 1, b = t * t % p; b != 1; i++) {
+			b = b * b % p;
+		}
+		for (b = c; m - i - 1 > 0; m--) {
+			b = b * b % p;
+		}
+		m = i;
+		c = b * b % p;
+		t = t * c % p;
+		r = r * b % p;
+	}
+
+	return r;
+
+} // }}}
+// {{{ static double siqs_log2(double x)
+static double siqs_log2(double x) {
+
+	double r = 0, bit = 1;
+	int i;
+
+	// whole bits by halving, then fractional bits by squaring
+	for (; x >= 2; x /= 2) {
+		r += 1;
+	}
+	for (i = 0; i < 24; i++) {
+		bit /= 2;
+		x *= x;
+		if (x >= 2) {
+			x /= 2;
+			r += bit;
+		}
+	}
+
+	return r;
+
+} // }}}
+
+// {{{ static void siqs_mulmod(struct siqs *q, integer_t *a, integer_t *b, integer_t *r)
+static void siqs_mulmod(struct siqs *q, integer_t *a, integer_t *b, integer_t *r) {
+
+	// r = a b mod n; r may be a or b
+	integer_mult(a, b, q->t[4]);
+	integer_div(q->t[4], q->n, q->t[5], r);
+
+} // }}}
+// {{{ static void siqs_gcd(struct siqs *q, integer_t *a, integer_t *g_r)
+static void siqs_gcd(struct siqs *q, integer_t *a, integer_t *g_r) {
+
+	integer_t *x = g_r, *y = q->t[4], *z = q->t[3], *w;
+
+	integer_copy(y, a);
+	integer_copy(x, q->n);
+	while (integer_bit_length(y) != 0) {
+		integer_div(x, y, q->t[5], z);
+		w = x;
+		x = y;
+		y = z;
+		z = w;
+	}
+
+	if (x != g_r) {
+		integer_copy(g_r, x);
+	}
+
+} // }}}
+// {{{ static void siqs_isqrt(struct siqs *q, integer_t *n, integer_t *r)
+static void siqs_isqrt(struct siqs *q, integer_t *n, integer_t *r) {
+
+	integer_t *quot = q->t[4], *next = q->t[5];
+
+	// Newton from above
+	integer_set_u64(quot, 1);
+	integer_shift_left(quot, (integer_bit_length(n) + 1) / 2, r);
+	for (;;) {
+		integer_div(n, r, quot, next);
+		integer_add(quot, r, next);
+		integer_div_u64(next, 2, next);
+		if (integer_cmp(next, r) >= 0) {
+			break;
+		}
+		integer_copy(r, next);
+	}
+
+} // }}}
+
+// {{{ static uint32_t siqs_multiplier(integer_t *n, prime_table_t *primes)
+static uint32_t siqs_multiplier(integer_t *n, prime_table_t *primes) {
+
+	double score[sizeof(siqs_multipliers)], best;
+	prime_table_iter_t it;
+	uint64_t p, np, count;
+	uint32_t k, i, kn8, n8 = integer_to_u64(n) % 8;
+
+	// Knuth-Schroeppel: how much small primes are expected to contribute
+	// to Q(x) for kN, against the growth of kN itself
+	for (i = 0; i < sizeof(siqs_multipliers); i++) {
+		k = siqs_multipliers[i];
+		score[i] = -0.5 * siqs_log2(k);
+		kn8 = k * n8 % 8;
+		score[i] += kn8 == 1 ? 2 : kn8 == 5 ? 1 : kn8 % 2 == 1 ? 0.5 : 0;
+	}
+
+	prime_table_iter_init(primes, 1, &it);
+	for (count = 0; count < SIQS_KS_PRIMES && prime_table_iter_next(&it, &p); count++) {
+		np = integer_div_u64(n, p, NULL);
+		for (i = 0; i < sizeof(siqs_multipliers); i++) {
+			k = siqs_multipliers[i];
+			if (k % p == 0) {
+				score[i] += siqs_log2(p) / p;
+			} else if (siqs_powmod(k * np, (p - 1) / 2, p) == 1) {
+				score[i] += 2 * siqs_log2(p) / (p - 1);
+			}
+		}
+	}
+
+	for (i = 1, k = 0, best = score[0]; i < sizeof(siqs_multipliers); i++) {
+		if (score[i] > best) {
+			best = score[i];
+			k = i;
+		}
+	}
+
+	return siqs_multipliers[k];
+
+} // }}}
+
+// {{{ static void siqs_free(struct siqs *q)
+static void siqs_free(struct siqs *q) {
+
+	size_t i;
+	simple_vector_t *v[2] = { q->relations, q->partials };
+
+	for (i = 0; i < 2; i++) {
+		if (v[i] != NULL) {
+			size_t j;
+			for (j = 0; j < relation_vector_size(v[i]); j++) {
+				integer_free(relation_vector_at(v[i], j).y);
+			}
+			simple_vector_free(v[i], 0, NULL);
+		}
+	}
+	simple_vector_free(q->indices, 0, NULL);
+	simple_vector_free(q->a_seen, 0, NULL);
+
+	free(q->prime);
+	free(q->sqrt);
+	free(q->logp);
+	free(q->skip);
+	free(q->ainv);
+	free(q->root[0]);
+	free(q->root[1]);
+	free(q->next[0]);
+	free(q->next[1]);
+	free(q->bainv);
+	free(q->sieve);
+	free(q->lp_keys);
+	free(q->lp_values);
+
+	integer_free(q->kn);
+	integer_free(q->target);
+	integer_free(q->a);
+	integer_free(q->b);
+	integer_free(q->zero);
+	for (i = 0; i < SIQS_MAX_A_FACTORS; i++) {
+		integer_free(q->bl[i]);
+	}
+	for (i = 0; i < 6; i++) {
+		integer_free(q->t[i]);
+	}
+
+} // }}}
+// {{{ static int siqs_alloc(struct siqs *q)
+static int siqs_alloc(struct siqs *q) {
+
+	size_t i, fb = q->fb_size + 1;
+
+	q->prime = calloc(fb, sizeof(uint32_t));
+	q->sqrt = calloc(fb, sizeof(uint32_t));
+	q->logp = calloc(fb, 1);
+	q->skip = calloc(fb, 1);
+	q->ainv = calloc(fb, sizeof(uint32_t));
+	q->root[0] = calloc(fb, sizeof(uint32_t));
+	q->root[1] = calloc(fb, sizeof(uint32_t));
+	q->next[0] = calloc(fb, sizeof(uint32_t));
+	q->next[1] = calloc(fb, sizeof(uint32_t));
+	q->bainv = calloc(fb * SIQS_MAX_A_FACTORS, sizeof(uint32_t));
+	q->sieve = malloc(SIQS_BLOCK);
+	q->lp_size = 1024;
+	q->lp_keys = calloc(q->lp_size, sizeof(uint32_t));
+	q->lp_values = calloc(q->lp_size, sizeof(uint32_t));
+
+	q->relations = relation_vector_new(fb + SIQS_EXTRA);
+	q->partials = relation_vector_new(fb);
+	q->indices = u32_vector_new(16 * fb);
+	q->a_seen = u64_vector_new(64);
+
+	q->kn = integer_new_zero();
+	q->target = integer_new_zero();
+	q->a = integer_new_zero();
+	q->b = integer_new_zero();
+	q->zero = integer_new_zero();
+
+	if (q->prime == NULL || q->sqrt == NULL || q->logp == NULL || q->skip == NULL
+			|| q->ainv == NULL || q->root[0] == NULL || q->root[1] == NULL
+			|| q->next[0] == NULL || q->next[1] == NULL || q->bainv == NULL
+			|| q->sieve == NULL || q->lp_keys == NULL || q->lp_values == NULL
+			|| q->relations == NULL || q->partials == NULL || q->indices == NULL
+			|| q->a_seen == NULL || q->kn == NULL || q->target == NULL
+			|| q->a == NULL || q->b == NULL || q->zero == NULL) {
+		return -1;
+	}
+	for (i = 0; i < SIQS_MAX_A_FACTORS; i++) {
+		if ((q->bl[i] = integer_new_zero()) == NULL) {
+			return -1;
+		}
+	}
+	for (i = 0; i < 6; i++) {
+		if ((q->t[i] = integer_new_zero()) == NULL) {
+			return -1;
+		}
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int siqs_init(struct siqs *q, integer_t *n, prime_table_t *primes)
+static int siqs_init(struct siqs *q, integer_t *n, prime_table_t *primes) {
+
+	const struct siqs_params *params;
+	prime_table_iter_t it;
+	uint64_t p, r;
+	uint32_t i;
+	double gbits, b;
+
+	q->n = n;
+	q->k = siqs_multiplier(n, primes);
+
+	for (params = siqs_params; params + 1 < siqs_params + sizeof(siqs_params) / sizeof(siqs_params[0])
+			&& params->bits < integer_bit_length(n) + siqs_log2(q->k); params++) {
+	}
+	q->fb_size = params->fb_size;
+	q->blocks = params->blocks;
+	q->m = params->blocks * SIQS_BLOCK;
+
+	if (siqs_alloc(q) == -1) {
+		return -1;
+	}
+	integer_set_u64(q->t[0], q->k);
+	integer_mult(n, q->t[0], q->kn);
+
+	// the factor base: 2, then the odd primes kN is a square modulo
+	prime_table_iter_init(primes, 0, &it);
+	for (i = 1; i <= q->fb_size && prime_table_iter_next(&it, &p); ) {
+		r = integer_div_u64(q->kn, p, NULL);
+		if (p != 2 && r != 0 && siqs_powmod(r, (p - 1) / 2, p) != 1) {
+			continue;
+		}
+		if (r == 0 && q->k % p != 0) {
+			q->divisor = p;
+			return 0;
+		}
+		q->prime[i] = p;
+		q->sqrt[i] = siqs_sqrtmod(r, p);
+		q->logp[i] = siqs_log2(p) + 0.5;
+		q->skip[i] = p < SIQS_SMALL_PRIME || r == 0;
+		if (p < SIQS_SMALL_PRIME) {
+			q->sieve_start = i + 1;
+		}
+		i++;
+	}
+	if (i <= q->fb_size) {
+		errno = ERANGE;
+		return -1;
+	}
+	q->large_max = q->prime[q->fb_size] * params->large_mult;
+
+	// what is left of g(x) after the sieved primes may be a large prime
+	gbits = integer_bit_length(q->kn) / 2.0 + siqs_log2(q->m) - 0.5;
+	b = gbits - siqs_log2(q->large_max) - SIQS_SLACK;
+	q->threshold = b < 8 ? 8 : b > 255 ? 255 : b;
+
+	// A near sqrt(2 kN) / M, from s primes of about equal size, as few as
+	// keep them in the bottom half of the factor base
+	integer_shift_left(q->kn, 1, q->t[0]);
+	siqs_isqrt(q, q->t[0], q->t[1]);
+	integer_div_u64(q->t[1], q->m, q->target);
+	gbits = integer_bit_length(q->target);
+	for (q->s = 2; q->s < SIQS_MAX_A_FACTORS
+			&& gbits / q->s > siqs_log2(q->prime[q->fb_size / 2]); q->s++) {
+	}
+	b = gbits / q->s;
+	for (q->a_lo = q->sieve_start; q->a_lo < q->fb_size
+			&& siqs_log2(q->prime[q->a_lo]) < b - 1; q->a_lo++) {
+	}
+	for (q->a_hi = q->a_lo; q->a_hi <= q->fb_size
+			&& siqs_log2(q->prime[q->a_hi]) < b + 1; q->a_hi++) {
+	}
+	while (q->a_hi - q->a_lo < 4 * q->s && (q->a_lo > q->sieve_start || q->a_hi <= q->fb_size)) {
+		q->a_lo -= q->a_lo > q->sieve_start;
+		q->a_hi += q->a_hi <= q->fb_size;
+	}
+
+	integer_rand_seed(&q->rand, 1);
+	return 0;
+
+} // }}}
+
+// {{{ static uint32_t siqs_closest(struct siqs *q, uint64_t v)
+static uint32_t siqs_closest(struct siqs *q, uint64_t v) {
+
+	uint32_t lo = q->sieve_start, hi = q->fb_size, mid;
+
+	// the factor base index of the prime nearest v
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (q->prime[mid] < v) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo > q->sieve_start && v - q->prime[lo - 1] < q->prime[lo] - v) {
+		lo--;
+	}
+
+	return lo;
+
+} // }}}
+// {{{ static int siqs_choose_a(struct siqs *q)
+static int siqs_choose_a(struct siqs *q) {
+
+	integer_t *rest = q->t[0], *t = q->t[1];
+	uint32_t l, j, idx, span = q->a_hi - q->a_lo, tries;
+	uint64_t last, low;
+	int again;
+
+	for (tries = 0; tries < 1000; tries++) {
+
+		// s - 1 distinct primes at random, and the last to bring the
+		// product closest to the target
+		integer_set_u64(q->a, 1);
+		for (l = 0, again = 0; l + 1 < q->s && !again; l++) {
+			idx = q->a_lo + integer_rand_next(&q->rand) % span;
+			for (j = 0; j < l && q->a_idx[j] != idx; j++) {
+			}
+			again = j < l || q->sqrt[idx] == 0;
+			q->a_idx[l] = idx;
+			integer_set_u64(t, q->prime[idx]);
+			integer_mult(q->a, t, rest);
+			integer_copy(q->a, rest);
+		}
+		if (again) {
+			continue;
+		}
+
+		integer_div(q->target, q->a, rest, t);
+		if (integer_bit_length(rest) > 32) {
+			continue;
+		}
+		last = integer_to_u64(rest);
+		if (last > q->prime[q->fb_size]) {
+			continue;
+		}
+		idx = siqs_closest(q, last);
+		for (j = 0; j < l && q->a_idx[j] != idx; j++) {
+		}
+		if (j < l || q->sqrt[idx] == 0 || q->prime[idx] < SIQS_SMALL_PRIME) {
+			continue;
+		}
+		q->a_idx[l] = idx;
+		integer_set_u64(t, q->prime[idx]);
+		integer_mult(q->a, t, rest);
+		integer_copy(q->a, rest);
+
+		// each A only once, or its relations come out again
+		low = integer_to_u64(q->a);
+		for (j = 0; j < u64_vector_size(q->a_seen) && u64_vector_at(q->a_seen, j) != low; j++) {
+		}
+		if (j == u64_vector_size(q->a_seen)) {
+			return u64_vector_append(q->a_seen, low);
+		}
+
+	}
+
+	return 1;
+
+} // }}}
+// {{{ static int siqs_new_a(struct siqs *q)
+static int siqs_new_a(struct siqs *q) {
+
+	integer_t *t = q->t[0], *u = q->t[1];
+	uint32_t l, i, p, qp, gamma, bmod, ainv, r;
+	size_t stride = q->fb_size + 1;
+	int ret;
+
+	for (l = 0; l < q->s; l++) {
+		q->skip[q->a_idx[l]] = 0;
+	}
+	if ((ret = siqs_choose_a(q)) != 0) {
+		return ret;
+	}
+	for (l = 0; l < q->s; l++) {
+		q->skip[q->a_idx[l]] = 1;
+	}
+
+	// B_l = (A / q_l) gamma, gamma = sqrt(kN) (A / q_l)^-1 mod q_l, so
+	// that B = sum B_l has B^2 = kN mod A
+	integer_zero(q->b);
+	for (l = 0; l < q->s; l++) {
+		qp = q->prime[q->a_idx[l]];
+		integer_div_u64(q->a, qp, t);
+		gamma = (uint64_t) q->sqrt[q->a_idx[l]] * siqs_inverse(integer_div_u64(t, qp, NULL), qp) % qp;
+		if (gamma > qp / 2) {
+			gamma = qp - gamma;
+		}
+		integer_set_u64(u, gamma);
+		integer_mult(t, u, q->bl[l]);
+		integer_add(q->b, q->bl[l], u);
+		integer_copy(q->b, u);
+	}
+
+	// the roots of the first polynomial, and how each later B moves them
+	for (i = q->sieve_start; i <= q->fb_size; i++) {
+		if (q->skip[i]) {
+			continue;
+		}
+		p = q->prime[i];
+		ainv = q->ainv[i] = siqs_inverse(integer_div_u64(q->a, p, NULL), p);
+		bmod = integer_div_u64(q->b, p, NULL);
+		r = (uint64_t) ainv * ((q->sqrt[i] + p - bmod) % p) % p;
+		q->root[0][i] = (r + q->m) % p;
+		r = (uint64_t) ainv * ((2 * (uint64_t) p - q->sqrt[i] - bmod) % p) % p;
+		q->root[1][i] = (r + q->m) % p;
+		for (l = 0; l < q->s; l++) {
+			q->bainv[l * stride + i] = 2 * (uint64_t) integer_div_u64(q->bl[l], p, NULL) * ainv % p;
+		}
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static void siqs_next_b(struct siqs *q, uint32_t poly)
+static void siqs_next_b(struct siqs *q, uint32_t poly) {
+
+	integer_t *t = q->t[0], *u = q->t[1];
+	uint32_t v = __builtin_ctz(poly), i, p, *delta;
+	int down = ((poly >> v) + 1) / 2 % 2;
+
+	// Gray code order: B moves by 2 B_v one way or the other, and the
+	// roots by 2 B_v / A the opposite way
+	integer_shift_left(q->bl[v], 1, t);
+	if (down) {
+		integer_sub(q->b, t, u);
+	} else {
+		integer_add(q->b, t, u);
+	}
+	integer_copy(q->b, u);
+
+	delta = q->bainv + v * (q->fb_size + 1);
+	for (i = q->sieve_start; i <= q->fb_size; i++) {
+		p = q->prime[i];
+		if (down) {
+			q->root[0][i] = (q->root[0][i] + delta[i]) % p;
+			q->root[1][i] = (q->root[1][i] + delta[i]) % p;
+		} else {
+			q->root[0][i] = (q->root[0][i] + p - delta[i]) % p;
+			q->root[1][i] = (q->root[1][i] + p - delta[i]) % p;
+		}
+	}
+
+} // }}}
+
+// {{{ static int siqs_lp_insert(struct siqs *q, uint32_t large, uint32_t partial)
+static int siqs_lp_insert(struct siqs *q, uint32_t large, uint32_t partial) {
+
+	uint32_t *keys, *values;
+	size_t i, h, size;
+
+	// keep the table at most half full
+	if (2 * (relation_vector_size(q->partials) + 1) > q->lp_size) {
+		size = 2 * q->lp_size;
+		if ((keys = calloc(size, sizeof(uint32_t))) == NULL
+				|| (values = calloc(size, sizeof(uint32_t))) == NULL) {
+			free(keys);
+			return -1;
+		}
+		for (i = 0; i < q->lp_size; i++) {
+			if (q->lp_keys[i] != 0) {
+				for (h = q->lp_keys[i] * 2654435761u % size; keys[h] != 0; h = (h + 1) % size) {
+				}
+				keys[h] = q->lp_keys[i];
+				values[h] = q->lp_values[i];
+			}
+		}
+		free(q->lp_keys);
+		free(q->lp_values);
+		q->lp_keys = keys;
+		q->lp_values = values;
+		q->lp_size = size;
+	}
+
+	for (h = large * 2654435761u % q->lp_size; q->lp_keys[h] != 0; h = (h + 1) % q->lp_size) {
+	}
+	q->lp_keys[h] = large;
+	q->lp_values[h] = partial;
+
+	return 0;
+
+} // }}}
+// {{{ static int siqs_lp_find(struct siqs *q, uint32_t large, uint32_t *partial_r)
+static int siqs_lp_find(struct siqs *q, uint32_t large, uint32_t *partial_r) {
+
+	size_t h;
+
+	for (h = large * 2654435761u % q->lp_size; q->lp_keys[h] != 0; h = (h + 1) % q->lp_size) {
+		if (q->lp_keys[h] == large) {
+			*partial_r = q->lp_values[h];
+			return 1;
+		}
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int siqs_relation(struct siqs *q, integer_t *v, uint32_t large, uint32_t offset)
+static int siqs_relation(struct siqs *q, integer_t *v, uint32_t large, uint32_t offset) {
+
+	struct siqs_relation rel, other;
+	uint32_t i, partial;
+
+	// full relations go straight in; two partials with the same large
+	// prime make one more, their indices run together
+	rel.large = large;
+	rel.offset = offset;
+	rel.count = u32_vector_size(q->indices) - offset;
+	if ((rel.y = integer_new_zero()) == NULL) {
+		return -1;
+	}
+	integer_copy(rel.y, v);
+
+	if (large == 1) {
+		if (relation_vector_append(q->relations, rel) == -1) {
+			integer_free(rel.y);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!siqs_lp_find(q, large, &partial)) {
+		if (relation_vector_append(q->partials, rel) == -1) {
+			integer_free(rel.y);
+			return -1;
+		}
+		return siqs_lp_insert(q, large, relation_vector_size(q->partials) - 1);
+	}
+
+	other = relation_vector_at(q->partials, partial);
+	for (i = 0; i < other.count; i++) {
+		if (u32_vector_append(q->indices, u32_vector_at(q->indices, other.offset + i)) == -1) {
+			integer_free(rel.y);
+			return -1;
+		}
+	}
+	rel.count += other.count;
+	siqs_mulmod(q, rel.y, other.y, rel.y);
+	if (relation_vector_append(q->relations, rel) == -1) {
+		integer_free(rel.y);
+		return -1;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int siqs_check(struct siqs *q, uint32_t j)
+static int siqs_check(struct siqs *q, uint32_t j) {
+
+	integer_t *x = q->t[0], *v = q->t[1], *g = q->t[2], *t = q->t[3], *r = q->t[4];
+	int64_t xv = (int64_t) j - q->m;
+	uint32_t offset = u32_vector_size(q->indices), i, l, p, jm;
+
+	// v = A x + B, and Q(x) = v^2 - kN = A g(x)
+	integer_set_u64(x, xv < 0 ? -xv : xv);
+	integer_mult(q->a, x, t);
+	if (xv < 0) {
+		integer_sub(q->b, t, v);
+	} else {
+		integer_add(q->b, t, v);
+	}
+	integer_mult(v, v, t);
+	integer_sub(t, q->kn, r);
+	integer_div(r, q->a, g, t);
+
+	if (integer_cmp(g, q->zero) < 0) {
+		if (u32_vector_append(q->indices, 0) == -1) {
+			return -1;
+		}
+		integer_sub(q->zero, g, r);
+	} else {
+		integer_copy(r, g);
+	}
+	for (l = 0; l < q->s; l++) {
+		if (u32_vector_append(q->indices, q->a_idx[l]) == -1) {
+			return -1;
+		}
+	}
+
+	// the sieved primes divide g exactly when x sits on one of their
+	// roots; the rest are tried one by one
+	for (i = 1; i <= q->fb_size; i++) {
+		p = q->prime[i];
+		if (q->skip[i]) {
+			if (integer_div_u64(r, p, NULL) != 0) {
+				continue;
+			}
+		} else {
+			jm = j % p;
+			if (jm != q->root[0][i] && jm != q->root[1][i]) {
+				continue;
+			}
+		}
+		do {
+			integer_div_u64(r, p, r);
+			if (u32_vector_append(q->indices, i) == -1) {
+				return -1;
+			}
+		} while (integer_div_u64(r, p, NULL) == 0);
+	}
+
+	if (integer_bit_length(r) <= 32 && integer_to_u64(r) <= q->large_max) {
+		return siqs_relation(q, v, integer_to_u64(r), offset);
+	}
+
+	simple_vector_truncate(q->indices, offset);
+	return 0;
+
+} // }}}
+// {{{ static int siqs_sieve(struct siqs *q)
+static int siqs_sieve(struct siqs *q) {
+
+	uint32_t block, i, j, p, pos, lo, hi;
+	unsigned char lg;
+	int k;
+
+	for (i = q->sieve_start; i <= q->fb_size; i++) {
+		q->next[0][i] = q->root[0][i];
+		q->next[1][i] = q->root[1][i];
+	}
+
+	// one L1 sized block at a time over x in [-M, M), each prime carrying
+	// its next offset over from the block before
+	for (block = 0; block < 2 * q->blocks; block++) {
+
+		lo = block * SIQS_BLOCK;
+		hi = lo + SIQS_BLOCK;
+		memset(q->sieve, 0, SIQS_BLOCK);
+
+		for (i = q->sieve_start; i <= q->fb_size; i++) {
+			if (q->skip[i]) {
+				continue;
+			}
+			p = q->prime[i];
+			lg = q->logp[i];
+			for (k = 0; k < 2; k++) {
+				for (pos = q->next[k][i]; pos < hi; pos += p) {
+					q->sieve[pos - lo] += lg;
+				}
+				q->next[k][i] = pos;
+			}
+		}
+
+		for (j = 0; j < SIQS_BLOCK; j++) {
+			if (q->sieve[j] >= q->threshold && siqs_check(q, lo + j) == -1) {
+				return -1;
+			}
+		}
+
+	}
+
+	return 0;
+
+} // }}}
+
+// {{{ static int siqs_cmp_u32(const void *a, const void *b)
+static int siqs_cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+	return x < y ? -1 : x > y;
+} // }}}
+// {{{ static int siqs_sqrt(struct siqs *q, uint32_t *count, const uint32_t *rows, size_t nrows, integer_t *d_r)
+static int siqs_sqrt(struct siqs *q, uint32_t *count, const uint32_t *rows, size_t nrows, integer_t *d_r) {
+
+	integer_t *x = q->t[0], *y = q->t[1], *t = q->t[2];
+	struct siqs_relation rel;
+	uint32_t i, e;
+	size_t r;
+
+	// x = prod y_r, and y the square root of the product of the right
+	// hand sides, every exponent of which is even
+	memset(count, 0, (q->fb_size + 1) * sizeof(uint32_t));
+	integer_set_u64(x, 1);
+	integer_set_u64(y, 1);
+	for (r = 0; r < nrows; r++) {
+		rel = relation_vector_at(q->relations, rows[r]);
+		siqs_mulmod(q, x, rel.y, x);
+		for (i = 0; i < rel.count; i++) {
+			count[u32_vector_at(q->indices, rel.offset + i)]++;
+		}
+		if (rel.large != 1) {
+			integer_set_u64(t, rel.large);
+			siqs_mulmod(q, y, t, y);
+		}
+	}
+	for (i = 1; i <= q->fb_size; i++) {
+		for (e = 0; e < count[i] / 2; e++) {
+			integer_set_u64(t, q->prime[i]);
+			siqs_mulmod(q, y, t, y);
+		}
+	}
+
+	// x^2 = y^2 mod n; unless x = +-y, gcd(x - y, n) splits it
+	integer_sub(x, y, t);
+	integer_div(t, q->n, q->t[5], x);
+	siqs_gcd(q, x, d_r);
+
+	return integer_bit_length(d_r) == 1 || integer_cmp(d_r, q->n) == 0;
+
+} // }}}
+// the relation matrix over GF(2), from its sparse odd column lists down
+// to the dense rows that elimination works on
+struct siqs_matrix {
+	uint32_t *odd;
+	uint32_t *odd_at;
+	uint32_t *weight;
+	uint32_t *colmap;
+	unsigned char *active;
+	uint32_t *rows;
+	uint32_t *dep;
+	size_t ncols;
+	size_t nrows;
+	size_t words;
+	uint64_t *bits;
+	uint64_t **mat;
+};
+
+// {{{ static void siqs_matrix_free(struct siqs_matrix *mx)
+static void siqs_matrix_free(struct siqs_matrix *mx) {
+
+	free(mx->odd);
+	free(mx->odd_at);
+	free(mx->weight);
+	free(mx->colmap);
+	free(mx->active);
+	free(mx->rows);
+	free(mx->dep);
+	free(mx->bits);
+	free(mx->mat);
+
+} // }}}
+// {{{ static int siqs_matrix_build(struct siqs *q, struct siqs_matrix *mx)
+static int siqs_matrix_build(struct siqs *q, struct siqs_matrix *mx) {
+
+	size_t nrel = relation_vector_size(q->relations), cols = q->fb_size + 1;
+	size_t r, i, j, c;
+	struct siqs_relation rel;
+	uint32_t *run;
+	int changed;
+
+	mx->odd_at = malloc((nrel + 1) * sizeof(uint32_t));
+	mx->odd = malloc((u32_vector_size(q->indices) + 1) * sizeof(uint32_t));
+	mx->weight = calloc(cols, sizeof(uint32_t));
+	mx->colmap = malloc(cols * sizeof(uint32_t));
+	mx->active = malloc(nrel + 1);
+	mx->rows = malloc((nrel + 1) * sizeof(uint32_t));
+	mx->dep = malloc((nrel + 1) * sizeof(uint32_t));
+	if (mx->odd_at == NULL || mx->odd == NULL || mx->weight == NULL || mx->colmap == NULL
+			|| mx->active == NULL || mx->rows == NULL || mx->dep == NULL) {
+		return -1;
+	}
+
+	// the odd exponents of each relation, as sorted column lists
+	mx->odd_at[0] = 0;
+	for (r = 0; r < nrel; r++) {
+		rel = relation_vector_at(q->relations, r);
+		run = mx->odd + mx->odd_at[r];
+		memcpy(run, u32_vector_data(q->indices) + rel.offset, rel.count * sizeof(uint32_t));
+		qsort(run, rel.count, sizeof(uint32_t), siqs_cmp_u32);
+		for (i = 0, c = 0; i < rel.count; i = j) {
+			for (j = i; j < rel.count && run[j] == run[i]; j++) {
+			}
+			if ((j - i) % 2 == 1) {
+				run[c++] = run[i];
+			}
+		}
+		mx->odd_at[r + 1] = mx->odd_at[r] + c;
+		mx->active[r] = 1;
+	}
+
+	// a column only one relation touches can never cancel, so that
+	// relation goes, until none are left; with at most a few thousand
+	// columns, dense elimination takes the rest without merging or
+	// dropping heavy columns first
+	do {
+		changed = 0;
+		memset(mx->weight, 0, cols * sizeof(uint32_t));
+		for (r = 0; r < nrel; r++) {
+			for (i = mx->odd_at[r]; mx->active[r] && i < mx->odd_at[r + 1]; i++) {
+				mx->weight[mx->odd[i]]++;
+			}
+		}
+		for (r = 0; r < nrel; r++) {
+			for (i = mx->odd_at[r]; mx->active[r] && i < mx->odd_at[r + 1]; i++) {
+				if (mx->weight[mx->odd[i]] == 1) {
+					mx->active[r] = 0;
+					changed = 1;
+				}
+			}
+		}
+	} while (changed);
+
+	for (c = 0, mx->ncols = 0; c < cols; c++) {
+		mx->colmap[c] = mx->weight[c] != 0 ? mx->ncols++ : 0;
+	}
+	for (r = 0, mx->nrows = 0; r < nrel && mx->nrows < mx->ncols + SIQS_EXTRA; r++) {
+		if (mx->active[r]) {
+			mx->rows[mx->nrows++] = r;
+		}
+	}
+
+	// dense rows, each carrying the relations it is the sum of after its
+	// columns
+	mx->words = (mx->ncols + mx->nrows + 63) / 64;
+	mx->bits = calloc(mx->nrows * mx->words + 1, sizeof(uint64_t));
+	mx->mat = malloc((mx->nrows + 1) * sizeof(uint64_t *));
+	if (mx->bits == NULL || mx->mat == NULL) {
+		return -1;
+	}
+	for (r = 0; r < mx->nrows; r++) {
+		mx->mat[r] = mx->bits + r * mx->words;
+		for (i = mx->odd_at[mx->rows[r]]; i < mx->odd_at[mx->rows[r] + 1]; i++) {
+			c = mx->colmap[mx->odd[i]];
+			mx->mat[r][c / 64] |= (uint64_t) 1 << (c % 64);
+		}
+		c = mx->ncols + r;
+		mx->mat[r][c / 64] |= (uint64_t) 1 << (c % 64);
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static int siqs_matrix_solve(struct siqs *q, struct siqs_matrix *mx, integer_t *d_r)
+static int siqs_matrix_solve(struct siqs *q, struct siqs_matrix *mx, integer_t *d_r) {
+
+	uint64_t **mat = mx->mat, *swap;
+	size_t r, r2, c, i, rank, ndep;
+	int ret = 1;
+
+	// Gaussian elimination; every row past the rank is a dependency
+	for (c = 0, rank = 0; c < mx->ncols && rank < mx->nrows; c++) {
+		for (r = rank; r < mx->nrows && !(mat[r][c / 64] >> (c % 64) & 1); r++) {
+		}
+		if (r == mx->nrows) {
+			continue;
+		}
+		swap = mat[r];
+		mat[r] = mat[rank];
+		mat[rank] = swap;
+		for (r2 = rank + 1; r2 < mx->nrows; r2++) {
+			if (mat[r2][c / 64] >> (c % 64) & 1) {
+				for (i = c / 64; i < mx->words; i++) {
+					mat[r2][i] ^= mat[rank][i];
+				}
+			}
+		}
+		rank++;
+	}
+
+	for (r = rank; r < mx->nrows && ret == 1; r++) {
+		for (i = 0, ndep = 0; i < mx->nrows; i++) {
+			c = mx->ncols + i;
+			if (mat[r][c / 64] >> (c % 64) & 1) {
+				mx->dep[ndep++] = mx->rows[i];
+			}
+		}
+		ret = siqs_sqrt(q, mx->weight, mx->dep, ndep, d_r);
+	}
+
+	return ret;
+
+} // }}}
+// {{{ static int siqs_solve(struct siqs *q, integer_t *d_r)
+static int siqs_solve(struct siqs *q, integer_t *d_r) {
+
+	struct siqs_matrix mx;
+	int ret = -1;
+
+	memset(&mx, 0, sizeof(struct siqs_matrix));
+	if (siqs_matrix_build(q, &mx) == 0) {
+		ret = siqs_matrix_solve(q, &mx, d_r);
+	}
+	siqs_matrix_free(&mx);
+
+	return ret;
+
+} // }}}
+// {{{ static int siqs_gather(struct siqs *q, size_t wanted)
+static int siqs_gather(struct siqs *q, size_t wanted) {
+
+	uint32_t poly, polys;
+	int ret;
+
+	// A by A, each giving 2^(s - 1) values of B
+	while (relation_vector_size(q->relations) < wanted) {
+		if ((ret = siqs_new_a(q)) != 0) {
+			return ret;
+		}
+		polys = 1u << (q->s - 1);
+		for (poly = 0; poly < polys && relation_vector_size(q->relations) < wanted; poly++) {
+			if (poly != 0) {
+				siqs_next_b(q, poly);
+			}
+			if (siqs_sieve(q) == -1) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+
+} // }}}
+
+// {{{ int factor_siqs(integer_t *n, prime_table_t *primes, integer_t *d_r)
+int factor_siqs(integer_t *n, prime_table_t *primes, integer_t *d_r) {
+
+	struct siqs q;
+	size_t wanted;
+	uint32_t retry;
+	int ret;
+
+	if (integer_bit_length(n) < FACTOR_SIQS_MIN_BITS || integer_bit_length(n) > FACTOR_SIQS_MAX_BITS) {
+		return 1;
+	}
+
+	memset(&q, 0, sizeof(struct siqs));
+	if ((ret = siqs_init(&q, n, primes)) != 0 || q.divisor != 0) {
+		if (ret == 0) {
+			integer_set_u64(d_r, q.divisor);
+		}
+		siqs_free(&q);
+		return ret;
+	}
+
+	// a few more relations than columns, and a few more again each time
+	// the dependencies all come out trivial
+	wanted = q.fb_size + 1 + SIQS_EXTRA;
+	for (retry = 0, ret = 1; ret == 1 && retry <= SIQS_RETRIES; retry++, wanted += SIQS_EXTRA) {
+		if ((ret = siqs_gather(&q, wanted)) == 0) {
+			ret = siqs_solve(&q, d_r);
+		} else if (ret == 1) {
+			break;
+		}
+	}
+
+	siqs_free(&q);
+	return ret;
+
+} // }}}
+
+// vim: fdm=marker ts=4
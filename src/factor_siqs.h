@@ -0,0 +1,20 @@
+#ifndef factor_siqs_h
+#define factor_siqs_h
+
+#include "integer.h"
+#include "prime_table.h"
+
+// the self-initialising quadratic sieve, the last stage of
+// factor_integer_split for cofactors past FACTOR_SIQS_MIN_BITS: a
+// nontrivial factor of the odd composite n, with no factors below 2^16,
+// in d_r. The factor base comes from primes, which must reach about
+// 10^5 for the largest n. Returns 0, 1 when n is out of range or every
+// dependency comes out trivial (as for prime powers), or -1 with errno
+// set. The top of the range is where a balanced semiprime still takes
+// about a minute; past it factor_integer_split goes on to ECM.
+#define FACTOR_SIQS_MIN_BITS 100
+#define FACTOR_SIQS_MAX_BITS 220
+
+int factor_siqs(integer_t *n, prime_table_t *primes, integer_t *d_r);
+
+#endif
@@ -7,7 +7,8 @@ integer_t *integer_new();
 void integer_clear(integer_t *i);
 
 size_t integer_num_digits(integer_t *i);
-void integer_word_power(integer_t *i, size_t digit, WORD w);
+void integer_normalise(integer_t *i);
+int integer_word_power(integer_t *i, size_t digit, WORD w);
 
 integer_t *integer_new_word_power(WORD w, size_t shift);
 
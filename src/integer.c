@@ -1,23 +1,53 @@
 #include "integer.h"
 #include "integer-private.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "simple_vector.h"
+#include "typed_vector.h"
 
 #define WORD uint8_t
 #define DWORD uint16_t
 #define MAX_WORD 0xff
+#define WORD_BITS (sizeof(WORD) * 8)
 #define WORD_HEX_CODE "%hhx"
 #define WORD_HEX_CODE_PAD "%02hhx"
 
+// product trees multiply leaves of this many factors directly,
+// packing them into words below PRODUCT_LEAF_MAX
+#define PRODUCT_LEAF_SIZE 16
+#define PRODUCT_LEAF_MAX ((uint64_t) 1 << (64 - WORD_BITS))
+
+TYPED_VECTOR(word, WORD)
+
+// Canonical form, restored by integer_normalise at the end of every
+// operation: at least one digit, no leading zero digits, zero is positive,
+// and bits holds the bit length of the magnitude.
 struct integer {
 	int positive;
+	size_t bits;
 	simple_vector_t *digits;
+	simple_vector_allocator_t allocator;	// of the struct and its digits
+};
+
+// Per-thread workspace, created on first use and released by the key
+// destructor at thread exit. Each slot belongs to a single function, so
+// nested calls never hand out the same buffer twice.
+struct integer_scratch {
+	WORD *div_words;
+	size_t div_capacity;
+	integer_t *div_rem;
+	integer_t *sub_temp;
+	integer_t *sub_diff;
 };
 
+static pthread_key_t integer_scratch_key;
+static pthread_once_t integer_scratch_once = PTHREAD_ONCE_INIT;
+
 // {{{ static uint8_t convert_ascii_hex_to_number(char c) {
 static int8_t convert_ascii_hex_to_number(char c) {
 	
@@ -35,25 +65,34 @@ size_t integer_num_digits(integer_t *i) {
 	return simple_vector_size(i->digits);
 } // }}}
 
-// {{{ integer_t *integer_new() {
-integer_t *integer_new() {
+// {{{ static integer_t *integer_new_allocator(const simple_vector_allocator_t *allocator) {
+static integer_t *integer_new_allocator(const simple_vector_allocator_t *allocator) {
 
 	integer_t *i;
 	
-	if ((i = malloc(sizeof(integer_t))) == NULL) {
+	if ((i = allocator->alloc(allocator->ctx, sizeof(integer_t))) == NULL) {
 		return NULL;
 	}
 
-	if ((i->digits = simple_vector_new(2, sizeof(WORD))) == NULL) {
-		integer_free(i);
+	// small integers live in the vector's inline buffer; big ones
+	// grow by 1.5x to keep slack down
+	if ((i->digits = simple_vector_new_allocator(2, sizeof(WORD), allocator)) == NULL) {
+		allocator->free(allocator->ctx, i, sizeof(integer_t));
 		return NULL;
 	}
+	simple_vector_set_growth(i->digits, SIMPLE_VECTOR_GROW_HALF, 0);
 
+	i->allocator = *allocator;
 	i->positive = 1;
+	i->bits = 0;
 	
 	return i;
 
 } // }}}
+// {{{ integer_t *integer_new() {
+integer_t *integer_new() {
+	return integer_new_allocator(simple_vector_default_allocator());
+} // }}}
 // {{{ integer_t *integer_new_zero() {
 integer_t *integer_new_zero() {
 
@@ -66,6 +105,19 @@ integer_t *integer_new_zero() {
 	integer_zero(i);
 	return i;
 
+} // }}}
+// {{{ integer_t *integer_new_zero_allocator(const simple_vector_allocator_t *allocator) {
+integer_t *integer_new_zero_allocator(const simple_vector_allocator_t *allocator) {
+
+	integer_t *i;
+
+	if (allocator == NULL || (i = integer_new_allocator(allocator)) == NULL) {
+		return NULL;
+	}
+
+	integer_zero(i);
+	return i;
+
 } // }}}
 // {{{ integer_t *integer_new_from_hex(const char *str) {
 integer_t *integer_new_from_hex(const char *str) {
@@ -101,6 +153,9 @@ integer_t *integer_new_from_hex(const char *str) {
 		}
 	}
 
+	// two hex chars per byte of word, sized once
+	simple_vector_reserve(i->digits, (len - most_sig) / (2 * sizeof(WORD)) + 1);
+
 	// go through each digit in the string, starting with the least significant
 	for (hex_digit = len-1; hex_digit >= most_sig; ) {
 
@@ -127,7 +182,37 @@ integer_t *integer_new_from_hex(const char *str) {
 		}
 
 	}
-	
+
+	integer_normalise(i);
+	return i;
+
+} // }}}
+// {{{ void integer_set_u64(integer_t *i, uint64_t v) {
+void integer_set_u64(integer_t *i, uint64_t v) {
+
+	WORD w;
+
+	integer_clear(i);
+	i->positive = 1;
+	do {
+		w = v & MAX_WORD;
+		simple_vector_append(i->digits, &w);
+		v >>= WORD_BITS;
+	} while (v != 0);
+
+	integer_normalise(i);
+
+} // }}}
+// {{{ integer_t *integer_new_from_u64(uint64_t v) {
+integer_t *integer_new_from_u64(uint64_t v) {
+
+	integer_t *i;
+
+	if ((i = integer_new()) == NULL) {
+		return NULL;
+	}
+
+	integer_set_u64(i, v);
 	return i;
 
 } // }}}
@@ -143,37 +228,152 @@ integer_t *integer_new_word_power(WORD w, size_t shift) {
 // {{{ void integer_free(integer_t *i) {
 void integer_free(integer_t *i) {
 	if (i != NULL) {
+		simple_vector_allocator_t allocator = i->allocator;
 		simple_vector_free(i->digits, 0, NULL);
-		free(i);
+		allocator.free(allocator.ctx, i, sizeof(integer_t));
 	}
 } // }}}
+// {{{ static void integer_scratch_free(void *p) {
+static void integer_scratch_free(void *p) {
+
+	struct integer_scratch *scratch = p;
+
+	if (scratch != NULL) {
+		free(scratch->div_words);
+		integer_free(scratch->div_rem);
+		integer_free(scratch->sub_temp);
+		integer_free(scratch->sub_diff);
+		free(scratch);
+	}
+
+} // }}}
+// {{{ static void integer_scratch_init(void) {
+static void integer_scratch_init(void) {
+	pthread_key_create(&integer_scratch_key, integer_scratch_free);
+} // }}}
+// {{{ static struct integer_scratch *integer_scratch_get(void) {
+static struct integer_scratch *integer_scratch_get(void) {
+
+	struct integer_scratch *scratch;
+
+	pthread_once(&integer_scratch_once, integer_scratch_init);
+	if ((scratch = pthread_getspecific(integer_scratch_key)) != NULL) {
+		return scratch;
+	}
+
+	if ((scratch = calloc(1, sizeof(struct integer_scratch))) == NULL) {
+		return NULL;
+	}
+
+	scratch->div_rem = integer_new_zero();
+	scratch->sub_temp = integer_new_zero();
+	scratch->sub_diff = integer_new_zero();
+	if (scratch->div_rem == NULL || scratch->sub_temp == NULL || scratch->sub_diff == NULL
+			|| pthread_setspecific(integer_scratch_key, scratch) != 0) {
+		integer_scratch_free(scratch);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return scratch;
+
+} // }}}
+// {{{ static WORD *integer_scratch_words(struct integer_scratch *scratch, size_t words) {
+static WORD *integer_scratch_words(struct integer_scratch *scratch, size_t words) {
+
+	// zeroed, grown geometrically and kept for the life of the thread
+	if (words > scratch->div_capacity) {
+		size_t capacity = scratch->div_capacity * 2 > words ? scratch->div_capacity * 2 : words;
+		WORD *w;
+		if ((w = realloc(scratch->div_words, capacity * sizeof(WORD))) == NULL) {
+			return NULL;
+		}
+		scratch->div_words = w;
+		scratch->div_capacity = capacity;
+	}
+
+	memset(scratch->div_words, 0, words * sizeof(WORD));
+	return scratch->div_words;
+
+} // }}}
 // {{{ void integer_clear(integer_t *i) {
 void integer_clear(integer_t *i) {
 
 	simple_vector_clear(i->digits);
 
 } // }}}
-// {{{ void integer_zero(integer_t *i) {
-void integer_zero(integer_t *i) {
-	integer_clear(i);
+// {{{ int integer_zero(integer_t *i) {
+int integer_zero(integer_t *i) {
+	if (word_vector_set_size(i->digits, 1) == -1) {
+		return -1;
+	}
+	word_vector_set(i->digits, 0, 0);
 	i->positive = 1;
-	integer_word_power(i, 0, 0);
+	i->bits = 0;
+	return 0;
 } // }}}
-// {{{ static void integer_get_word(integer_t *i, WORD w) {
-static void integer_get_word(integer_t *i, WORD w) {
-	integer_clear(i);
-	i->positive = 1;
-	simple_vector_append(i->digits, &w);
+// {{{ int integer_word_power(integer_t *i, size_t digit, WORD w) {
+int integer_word_power(integer_t *i, size_t digit, WORD w) {
+	if (digit >= integer_num_digits(i) && word_vector_set_size(i->digits, digit + 1) == -1) {
+		return -1;
+	}
+	word_vector_set(i->digits, digit, w);
+	integer_normalise(i);
+	return 0;
+} // }}}
+
+// {{{ void integer_normalise(integer_t *i) {
+void integer_normalise(integer_t *i) {
+
+	// strip leading zero digits, keeping a single zero digit for zero
+	WORD *d = word_vector_data(i->digits);
+	size_t digits = integer_num_digits(i);
+	WORD w;
+	while (digits > 0 && d[digits - 1] == 0) {
+		digits--;
+	}
+
+	if (digits == 0) {
+		integer_zero(i);
+		return;
+	}
+
+	simple_vector_truncate(i->digits, digits);
+	w = d[digits - 1];
+	for (i->bits = (digits - 1) * WORD_BITS; w != 0; w >>= 1) {
+		i->bits++;
+	}
+
+} // }}}
+// {{{ size_t integer_bit_length(integer_t *i) {
+size_t integer_bit_length(integer_t *i) {
+	return i->bits;
 } // }}}
-// {{{ void integer_word_power(integer_t *i, size_t digit, WORD w) {
-void integer_word_power(integer_t *i, size_t digit, WORD w) {
-	size_t idigits = integer_num_digits(i);
-	ssize_t d;
-	WORD zero = 0;
-	for (d = idigits; d <= digit; d++) {
-		simple_vector_append(i->digits, &zero);
+// {{{ int integer_test_bit(integer_t *i, size_t bit) {
+int integer_test_bit(integer_t *i, size_t bit) {
+
+	if (bit >= i->bits) {
+		return 0;
 	}
-	simple_vector_put(i->digits, digit, &w);
+	return word_vector_at(i->digits, bit / WORD_BITS) >> (bit % WORD_BITS) & 1;
+
+} // }}}
+// {{{ uint64_t integer_to_u64(integer_t *i) {
+uint64_t integer_to_u64(integer_t *i) {
+
+	WORD *d = word_vector_data(i->digits);
+	size_t digit = integer_num_digits(i);
+	uint64_t v = 0;
+
+	if (digit > 64 / WORD_BITS) {
+		digit = 64 / WORD_BITS;
+	}
+	while (digit > 0) {
+		v = v << WORD_BITS | d[--digit];
+	}
+
+	return v;
+
 } // }}}
 
 // {{{ char *integer_to_hex_string(integer_t *i) {
@@ -243,26 +443,20 @@ char *integer_to_hex_string(integer_t *i) {
 // {{{ static int integer_magnitude_cmp(integer_t *lhs, integer_t *rhs) {
 static int integer_magnitude_cmp(integer_t *lhs, integer_t *rhs) {
 
-	// compare numbers of digits
-	size_t ldigits, rdigits;
-	ldigits = integer_num_digits(lhs);
-	rdigits = integer_num_digits(rhs);
-	if (ldigits < rdigits) {
+	// compare bit lengths
+	if (lhs->bits < rhs->bits) {
 		return -1;
-	} else if (ldigits > rdigits) {
+	} else if (lhs->bits > rhs->bits) {
 		return 1;
 	}
 
-	// same number of digits -- compare digits
-	int digit;
-	WORD wl, wr;
-	for (digit = ldigits - 1; digit >= 0; digit -= 1) {
-		simple_vector_get(lhs->digits, digit, &wl);
-		simple_vector_get(rhs->digits, digit, &wr);
-		if (wl < wr) {
-			return -1;
-		} else if (wl > wr) {
-			return 1;
+	// same length -- compare digits
+	WORD *dl = word_vector_data(lhs->digits);
+	WORD *dr = word_vector_data(rhs->digits);
+	ssize_t digit;
+	for (digit = integer_num_digits(lhs) - 1; digit >= 0; digit -= 1) {
+		if (dl[digit] != dr[digit]) {
+			return dl[digit] < dr[digit] ? -1 : 1;
 		}
 	}
 	
@@ -296,95 +490,114 @@ int integer_cmp(integer_t *lhs, integer_t *rhs) {
 // {{{ void integer_copy(integer_t *i1, integer_t *i2) {
 void integer_copy(integer_t *i1, integer_t *i2) {
 
-	integer_clear(i1);
-
-	size_t digit;
-	size_t digits = integer_num_digits(i2);
-	WORD w;
+	simple_vector_copy(i1->digits, i2->digits);
+	i1->positive = i2->positive;
+	i1->bits = i2->bits;
 
-	for (digit = 0; digit < digits; digit++) {
-		simple_vector_get(i2->digits, digit, &w);
-		simple_vector_append(i1->digits, &w);
+} // }}}
+// {{{ static void integer_swap(integer_t *i1, integer_t *i2) {
+static void integer_swap(integer_t *i1, integer_t *i2) {
+
+	simple_vector_t *digits = i1->digits;
+	int positive = i1->positive;
+	size_t bits = i1->bits;
+
+	// i1 takes the value of i2, which keeps either i1's old value or its
+	// own; digits only change hands between integers of one allocator,
+	// so every integer stays entirely in the memory it was created with
+	if (memcmp(&i1->allocator, &i2->allocator, sizeof(simple_vector_allocator_t)) != 0) {
+		integer_copy(i1, i2);
+		return;
 	}
 
+	i1->digits = i2->digits;
+	i1->positive = i2->positive;
+	i1->bits = i2->bits;
+	i2->digits = digits;
+	i2->positive = positive;
+	i2->bits = bits;
+
 } // }}}
+// {{{ static int integer_reserve(integer_t *i, size_t digits) {
+static int integer_reserve(integer_t *i, size_t digits) {
 
-// {{{ static void integer_magnitude_add(integer_t *big, integer_t *lit, integer_t *sum_r) {
-static void integer_magnitude_add(integer_t *big, integer_t *lit, integer_t *sum_r) {
+	return simple_vector_reserve(i->digits, digits);
 
-	ssize_t digit;
+} // }}}
+
+// {{{ static int integer_magnitude_add(integer_t *big, integer_t *lit, integer_t *sum_r) {
+static int integer_magnitude_add(integer_t *big, integer_t *lit, integer_t *sum_r) {
+
+	size_t digit;
 	size_t bdigits = integer_num_digits(big);
 	size_t ldigits = integer_num_digits(lit);
 	DWORD dw;
-	WORD w1, w2, w3, carry = 0;
+	WORD carry = 0;
 
-	// digit by digit
-	for (digit = 0; digit < bdigits; digit++) {
-		simple_vector_get(big->digits, digit, &w1);
-		if (digit < ldigits) {
-			simple_vector_get(lit->digits, digit, &w2);
-		} else {
-			w2 = 0;
-		}
-		dw = (DWORD) w1 + (DWORD) w2 + (DWORD) carry;
-		w3 = dw & MAX_WORD;
-		simple_vector_append(sum_r->digits, &w3);
-		carry = dw >> (sizeof(WORD) * 8); 
+	if (word_vector_set_size(sum_r->digits, bdigits + 1) == -1) {
+		return -1;
 	}
-
-	// append the carry if it's nonzero
-	if (carry != 0) {
-		simple_vector_append(sum_r->digits, &carry);
+	WORD *b = word_vector_data(big->digits);
+	WORD *l = word_vector_data(lit->digits);
+	WORD *d = word_vector_data(sum_r->digits);
+
+	// digit by digit, over the overlap and then the rest of big
+	for (digit = 0; digit < ldigits; digit++) {
+		dw = (DWORD) b[digit] + (DWORD) l[digit] + (DWORD) carry;
+		d[digit] = dw & MAX_WORD;
+		carry = dw >> WORD_BITS;
+	}
+	for ( ; digit < bdigits; digit++) {
+		dw = (DWORD) b[digit] + (DWORD) carry;
+		d[digit] = dw & MAX_WORD;
+		carry = dw >> WORD_BITS;
 	}
+	d[bdigits] = carry;
+
+	integer_normalise(sum_r);
+	return 0;
 
 } // }}}
-// {{{ static void integer_magnitude_sub(integer_t *big, integer_t *lit, integer_t *diff_r) {
-static void integer_magnitude_sub(integer_t *big, integer_t *lit, integer_t *diff_r) {
+// {{{ static int integer_magnitude_sub(integer_t *big, integer_t *lit, integer_t *diff_r) {
+static int integer_magnitude_sub(integer_t *big, integer_t *lit, integer_t *diff_r) {
 
-	ssize_t digit;
+	size_t digit;
 	size_t bdigits = integer_num_digits(big);
 	size_t ldigits = integer_num_digits(lit);
-	WORD w1, w2, w3, carry = 0;
 	DWORD dw;
-	int skipped_zeros = 0;
+	WORD borrow = 0;
 
-	// digit by digit
-	for (digit = 0; digit < bdigits; digit += 1) {
-		simple_vector_get(big->digits, digit, &w1);
-		if (digit < ldigits) {
-			simple_vector_get(lit->digits, digit, &w2);
-		} else {
-			w2 = 0;
-		}
-		dw = (DWORD) w1 - (DWORD) w2 - (DWORD) carry;
-		if (dw > (DWORD) w1) {
-			carry = 1;
-		} else {
-			carry = 0;
-		}
-		w3 = dw & MAX_WORD;
-		if (w3 == 0) {
-			skipped_zeros += 1;
-		} else {
-			w1 = 0;
-			for ( ; skipped_zeros > 0; skipped_zeros -= 1) {
-				simple_vector_append(diff_r->digits, &w1);
-			}
-			simple_vector_append(diff_r->digits, &w3);
-		}
+	if (word_vector_set_size(diff_r->digits, bdigits) == -1) {
+		return -1;
+	}
+	WORD *b = word_vector_data(big->digits);
+	WORD *l = word_vector_data(lit->digits);
+	WORD *d = word_vector_data(diff_r->digits);
+
+	// digit by digit, a wrapped difference means a borrow
+	for (digit = 0; digit < ldigits; digit++) {
+		dw = (DWORD) b[digit] - (DWORD) l[digit] - (DWORD) borrow;
+		d[digit] = dw & MAX_WORD;
+		borrow = (dw >> WORD_BITS) != 0;
+	}
+	for ( ; digit < bdigits; digit++) {
+		dw = (DWORD) b[digit] - (DWORD) borrow;
+		d[digit] = dw & MAX_WORD;
+		borrow = (dw >> WORD_BITS) != 0;
 	}
 
-	// there really shouldn't be anything in carry
+	// there really shouldn't be anything in borrow
+	integer_normalise(diff_r);
+	return 0;
 
 } // }}}
-// {{{ void integer_add(integer_t *i1, integer_t *i2, integer_t *sum_r) {
-void integer_add(integer_t *i1, integer_t *i2, integer_t *sum_r) {
-
-	// clear out sum
-	integer_clear(sum_r);
+// {{{ int integer_add(integer_t *i1, integer_t *i2, integer_t *sum_r) {
+int integer_add(integer_t *i1, integer_t *i2, integer_t *sum_r) {
 
-	// determine big and little by magnitudes
+	// determine big and little by magnitudes; every digit of the sum is
+	// written, so it needs no clearing and stays as it was on failure
 	integer_t *big, *lit;
+	int positive, r;
 	if (integer_magnitude_cmp(i1, i2) >= 0) {
 		big = i1;
 		lit = i2;
@@ -394,24 +607,29 @@ void integer_add(integer_t *i1, integer_t *i2, integer_t *sum_r) {
 	}
 
 	// sign of sum is always sign of big
-	sum_r->positive = big->positive;
+	positive = big->positive;
 
 	// if signs agree, add magnitudes, otherwise, subtract magnitudes
 	if (big->positive == lit->positive) {
-		integer_magnitude_add(big, lit, sum_r);
+		r = integer_magnitude_add(big, lit, sum_r);
 	} else {
-		integer_magnitude_sub(big, lit, sum_r);
+		r = integer_magnitude_sub(big, lit, sum_r);
+	}
+	if (r == -1) {
+		return -1;
 	}
 
-} // }}}
-// {{{ void integer_sub(integer_t *i1, integer_t *i2, integer_t *diff_r)
-void integer_sub(integer_t *i1, integer_t *i2, integer_t *diff_r) {
+	sum_r->positive = positive || sum_r->bits == 0;
+	return 0;
 
-	// clear out sum
-	integer_clear(diff_r);
+} // }}}
+// {{{ int integer_sub(integer_t *i1, integer_t *i2, integer_t *diff_r)
+int integer_sub(integer_t *i1, integer_t *i2, integer_t *diff_r) {
 
-	// determine big and little by magnitudes
+	// determine big and little by magnitudes, diff_r is written whole as
+	// for integer_add
 	integer_t *big, *lit;
+	int positive, r;
 	if (integer_magnitude_cmp(i1, i2) >= 0) {
 		big = i1;
 		lit = i2;
@@ -423,277 +641,758 @@ void integer_sub(integer_t *i1, integer_t *i2, integer_t *diff_r) {
 	// if signs differ, its just addition and takes the sign of i1
 	// else, subtract magnitudes
 	if (i1->positive != i2->positive) {
-		diff_r->positive = i1->positive;
-		integer_magnitude_add(big, lit, diff_r);
+		positive = i1->positive;
+		r = integer_magnitude_add(big, lit, diff_r);
 	} else { 
 		if (big == i1) {
-			diff_r->positive = big->positive;
+			positive = big->positive;
 		} else {
-			diff_r->positive = !big->positive;
+			positive = !big->positive;
 		}
-		integer_magnitude_sub(big, lit, diff_r);
+		r = integer_magnitude_sub(big, lit, diff_r);
+	}
+	if (r == -1) {
+		return -1;
 	}
 
+	diff_r->positive = positive || diff_r->bits == 0;
+	return 0;
+
 } // }}}
 
-// {{{ void integer_mult(integer_t *i1, integer_t *i2, integer_t *prod_r) {
-void integer_mult(integer_t *i1, integer_t *i2, integer_t *prod_r) {
+// {{{ int integer_mult(integer_t *i1, integer_t *i2, integer_t *prod_r) {
+int integer_mult(integer_t *i1, integer_t *i2, integer_t *prod_r) {
 
-	// set the product to zero
-	integer_zero(prod_r);
+	size_t n1 = integer_num_digits(i1);
+	size_t n2 = integer_num_digits(i2);
+	size_t d1, d2;
+	DWORD dw;
+	WORD carry;
+
+	// the product has at most n1 + n2 digits, all starting at zero; with
+	// the room reserved first, clearing and growing cannot fail
+	if (integer_reserve(prod_r, n1 + n2) == -1) {
+		return -1;
+	}
+	word_vector_set_size(prod_r->digits, 0);
+	word_vector_set_size(prod_r->digits, n1 + n2);
+	WORD *a = word_vector_data(i1->digits);
+	WORD *b = word_vector_data(i2->digits);
+	WORD *p = word_vector_data(prod_r->digits);
 
 	// multiply i1 by each digit in i2, accumulating in prod_r
-	size_t i2_digits = integer_num_digits(i2);
-	ssize_t digit;
-	WORD w;
-	for (digit = 0; digit < i2_digits; digit += 1) {
-		simple_vector_get(i2->digits, digit, &w);
-		integer_mult_word_add(i1, w, digit, prod_r);
+	for (d2 = 0; d2 < n2; d2++) {
+		if (b[d2] == 0) {
+			continue;
+		}
+		carry = 0;
+		for (d1 = 0; d1 < n1; d1++) {
+			dw = (DWORD) a[d1] * (DWORD) b[d2] + (DWORD) p[d1 + d2] + (DWORD) carry;
+			p[d1 + d2] = dw & MAX_WORD;
+			carry = dw >> WORD_BITS;
+		}
+		p[n1 + d2] = carry;
 	}
 
-	// resolve sign of product
-	prod_r->positive = i1->positive == i2->positive;
+	integer_normalise(prod_r);
+
+	// resolve sign of product, zero is always positive
+	prod_r->positive = i1->positive == i2->positive || prod_r->bits == 0;
+	return 0;
 
 } // }}}
 
-// {{{ void integer_div_approx(integer_t *i1, integer_t *i2, WORD *w_r, size_t *shift_r) {
-void integer_div_approx(integer_t *i1, integer_t *i2, WORD *w_r, size_t *shift_r) {
+// {{{ static void integer_digits_to_array(integer_t *i, WORD *a) {
+static void integer_digits_to_array(integer_t *i, WORD *a) {
+	simple_vector_get_range(i->digits, 0, integer_num_digits(i), a);
 } // }}}
-// {{{ void integer_div2(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
-void integer_div2(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
+// {{{ static int integer_set_array(integer_t *i, WORD *a, size_t digits) {
+static int integer_set_array(integer_t *i, WORD *a, size_t digits) {
 
-	WORD w;
-	size_t shift;
+	// the room comes first, so a failure leaves i as it was
+	if (integer_reserve(i, digits) == -1) {
+		return -1;
+	}
+	simple_vector_clear(i->digits);
+	simple_vector_append_n(i->digits, a, digits);
+	i->positive = 1;
+	integer_normalise(i);
+	return 0;
 
-	/*integer_zero(quot_r);
-	integer_copy(rem_r, i2);
-	
-	while (integer_cmp(rem_r, i2) >= 0) {
+} // }}}
+// {{{ static int integer_magnitude_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
+static int integer_magnitude_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
+
+	// Knuth, TAOCP vol. 2, 4.3.1, algorithm D
+	size_t n = integer_num_digits(i2);
+	size_t m = integer_num_digits(i1) - n;
+	WORD *u, *v, *q;
+	DWORD qhat, rhat, p, b = (DWORD) MAX_WORD + 1;
+	int shift;
+	ssize_t j, k;
+	size_t i;
+
+	// u, v and q all live in the thread's scratch words
+	struct integer_scratch *scratch;
+	if ((scratch = integer_scratch_get()) == NULL
+			|| (u = integer_scratch_words(scratch, 2 * (m + n + 1))) == NULL) {
+		return -1;
+	}
+	v = u + m + n + 1;
+	q = v + n;
+	integer_digits_to_array(i1, u);
+	integer_digits_to_array(i2, v);
 
-		// rem_r / i2 ~= w followed by shift zeros, must always undershoot
-		integer_div_approx(rem_r, i2, &w, &shift);
+	// normalise so the top digit of the divisor has its high bit set
+	for (shift = 0; (v[n - 1] << shift & (1 << (WORD_BITS - 1))) == 0; shift++) {
+	}
+	if (shift > 0) {
+		for (k = n - 1; k > 0; k--) {
+			v[k] = (v[k] << shift) | (v[k - 1] >> (WORD_BITS - shift));
+		}
+		v[0] <<= shift;
+		u[m + n] = u[m + n - 1] >> (WORD_BITS - shift);
+		for (k = m + n - 1; k > 0; k--) {
+			u[k] = (u[k] << shift) | (u[k - 1] >> (WORD_BITS - shift));
+		}
+		u[0] <<= shift;
+	}
 
-		// quot_r += w followed by shift zeros
-		integer_accumulate_word(quot_r, w, shift);
+	for (j = m; j >= 0; j--) {
 
-		// rem_r -= i2 * (w followed by shift zeros)
-		integer_mult_word_sub(i2, w, shift, rem_r);
+		// estimate the quotient digit from the top two digits
+		qhat = ((DWORD) u[j + n] * b + u[j + n - 1]) / v[n - 1];
+		rhat = ((DWORD) u[j + n] * b + u[j + n - 1]) % v[n - 1];
+		while (qhat >= b || (n > 1 && qhat * v[n - 2] > b * rhat + u[j + n - 2])) {
+			qhat--;
+			rhat += v[n - 1];
+			if (rhat >= b) {
+				break;
+			}
+		}
+
+		// multiply and subtract
+		DWORD borrow = 0, carry = 0;
+		for (i = 0; i < n; i++) {
+			p = qhat * v[i] + carry;
+			carry = p >> WORD_BITS;
+			p = (DWORD) u[j + i] - (p & MAX_WORD) - borrow;
+			u[j + i] = p & MAX_WORD;
+			borrow = (p >> WORD_BITS) != 0;
+		}
+		p = (DWORD) u[j + n] - carry - borrow;
+		u[j + n] = p & MAX_WORD;
 
+		// overshot by one, add back
+		if ((p >> WORD_BITS) != 0) {
+			qhat--;
+			carry = 0;
+			for (i = 0; i < n; i++) {
+				p = (DWORD) u[j + i] + v[i] + carry;
+				u[j + i] = p & MAX_WORD;
+				carry = p >> WORD_BITS;
+			}
+			u[j + n] += carry;
+		}
 
+		q[j] = qhat;
 
-	}*/
+	}
 
-} // }}}
-// {{{ void integer_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
-void integer_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
+	// unnormalise the remainder
+	if (shift > 0) {
+		for (i = 0; i < n - 1; i++) {
+			u[i] = (u[i] >> shift) | (u[i + 1] << (WORD_BITS - shift));
+		}
+		u[n - 1] >>= shift;
+	}
 
-	WORD w2, wq, wr;
-	DWORD dw2, dwr, dwq;
-	size_t n2, nr;
+	if (integer_set_array(quot_r, q, m + 1) == -1
+			|| integer_set_array(rem_r, u, n) == -1) {
+		return -1;
+	}
 
-	n2 = integer_num_digits(i2);
-	simple_vector_get(i2->digits, n2 - 1, &w2);
+	return 0;
 
-	integer_zero(quot_r);
-	integer_copy(rem_r, i1);
-	
-	while (integer_cmp(rem_r, i2) >= 0) {
+} // }}}
+// {{{ int integer_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
+int integer_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r) {
+
+	// division by zero leaves both results as they were
+	if (i2->bits == 0) {
+		errno = EDOM;
+		return -1;
+	}
 
-		nr = integer_num_digits(rem_r);
-		simple_vector_get(rem_r->digits, nr - 1, &wr);
+	int dividend_positive = i1->positive;
+	int divisor_positive = i2->positive;
 
-		// approximate quotient for this remaining part of i1
-		if (w2 <= wr) {
-			wq = wr / w2;
-		} else {
-			dwr = wr << (sizeof(WORD) * 8);
-			nr--;
-			simple_vector_get(rem_r->digits, nr - 1, &wr);
-			dwr += wr;
-			wq = (WORD) (dwr / (DWORD) wq);
+	// |i1| < |i2|, quotient is zero
+	if (integer_magnitude_cmp(i1, i2) < 0) {
+		integer_zero(quot_r);
+		integer_copy(rem_r, i1);
+		rem_r->positive = 1;
+	} else if (integer_magnitude_div(i1, i2, quot_r, rem_r) == -1) {
+		return -1;
+	}
+
+	// keep the remainder non-negative: -a = -(q + 1) * b + (b - r)
+	if (!dividend_positive && rem_r->bits != 0) {
+		struct integer_scratch *scratch;
+		if ((scratch = integer_scratch_get()) == NULL) {
+			return -1;
 		}
-		
-		// calculate real remainder for this approximate quotient
-		integer_mult_word_sub(i1, wq, nr - n2, rem_r);
+		integer_clear(scratch->div_rem);
+		if (integer_magnitude_sub(i2, rem_r, scratch->div_rem) == -1
+				|| integer_accumulate_word(quot_r, 1, 0) == -1) {
+			return -1;
+		}
+		integer_swap(rem_r, scratch->div_rem);
+	}
 
-		// if we overshot, correct
-		if (!rem_r->positive) {
-			integer_mult_word_add(i1, 1, nr - n2, rem_r);
-			wq--;
+	quot_r->positive = dividend_positive == divisor_positive
+		|| quot_r->bits == 0;
+
+	return 0;
+
+} // }}}
+
+// {{{ uint64_t integer_div_u64(integer_t *i, uint64_t d, integer_t *quot_r) {
+uint64_t integer_div_u64(integer_t *i, uint64_t d, integer_t *quot_r) {
+
+	size_t digit = integer_num_digits(i);
+	WORD *n = word_vector_data(i->digits), *q = NULL;
+	unsigned __int128 r = 0;
+
+	// each quotient digit is written after its dividend digit is read,
+	// so quot_r may share digits with i; the remainder is below d, so
+	// UINT64_MAX is free to report a quotient that cannot grow
+	if (quot_r != NULL) {
+		if (quot_r != i && word_vector_set_size(quot_r->digits, digit) == -1) {
+			return UINT64_MAX;
 		}
+		q = word_vector_data(quot_r->digits);
+	}
 
-		// accumulate the quotient
-		integer_accumulate_word(quot_r, wq, nr - n2);
+	// schoolbook, a word at a time from the top; r < d throughout
+	while (digit > 0) {
+		digit--;
+		r = r << WORD_BITS | n[digit];
+		if (q != NULL) {
+			q[digit] = r / d;
+		}
+		r %= d;
+	}
 
+	if (quot_r != NULL) {
+		quot_r->positive = 1;
+		integer_normalise(quot_r);
 	}
 
+	return r;
+
 } // }}}
 
-// {{{ void integer_accumulate_word(integer_t *i, WORD w, size_t shift) {
-void integer_accumulate_word(integer_t *i, WORD w, size_t shift) {
+// {{{ int integer_accumulate_word(integer_t *i, WORD w, size_t shift) {
+int integer_accumulate_word(integer_t *i, WORD w, size_t shift) {
 
 	size_t digits = integer_num_digits(i);
 	DWORD dw;
-	WORD iw, carry;
 
-	// Add with carry starting in the middle of i (if necessary)
-	while (w > 0 && shift < digits) {
-
-		simple_vector_get(i->digits, shift, &iw);
-	
-		dw = (DWORD) iw + (DWORD) w;
-		iw = dw & MAX_WORD;
-		carry = dw >> (sizeof(WORD) * 8);
-
-		shift++;
-		w = carry;
+	// make room for the word and one carry beyond the current top
+	if (w == 0) {
+		return 0;
 	}
+	if (word_vector_set_size(i->digits, (shift > digits ? shift : digits) + 2) == -1) {
+		return -1;
+	}
+	WORD *d = word_vector_data(i->digits);
 
-	// Add beyond the most significant digits of i
-	if (w > 0) {
-		ssize_t digit;
-
-		// add leading zeroes, if any
-		iw = 0;
-		for (digit = digits; digit < shift; digit++) {
-			simple_vector_append(i->digits, &iw);
-		}
-	
-		// add w as most significant digit
-		simple_vector_append(i->digits, &w);
+	// add with carry starting in the middle of i (if necessary)
+	for ( ; w > 0; shift++) {
+		dw = (DWORD) d[shift] + (DWORD) w;
+		d[shift] = dw & MAX_WORD;
+		w = dw >> WORD_BITS;
 	}
 
+	integer_normalise(i);
+	return 0;
+
 } // }}}
-// {{{ void integer_mult_word_add(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
-void integer_mult_word_add(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
+// {{{ int integer_mult_word_add(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
+int integer_mult_word_add(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
 
-	ssize_t digit;
+	size_t digit;
 	size_t digits = integer_num_digits(i);
 	size_t adigits = integer_num_digits(acc_r);
 	DWORD dw;
-	WORD iw, aw, mult_carry = 0, add_carry = 0;
+	WORD carry = 0;
 
 	// if w == 0, do nothing
 	if (w == 0) {
-		return;
+		return 0;
 	}
-	
-	// digit by digit, multiply the word, save the mult_carry, 
-	// add it to the accumulator, and save the add_carry
+
+	// acc_r + i * w * (MAX_WORD + 1) ^ shift is below twice the larger of
+	// the two, so one digit past both always holds the carry; growing once
+	// up front means a failure leaves acc_r as it was
+	adigits = (adigits > digits + shift ? adigits : digits + shift) + 1;
+	if (word_vector_set_size(acc_r->digits, adigits) == -1) {
+		return -1;
+	}
+	WORD *d = word_vector_data(i->digits);
+	WORD *a = word_vector_data(acc_r->digits) + shift;
+
+	// digit by digit, multiply and add to the accumulator in one step;
+	// w * d + a + carry never exceeds a DWORD
 	for (digit = 0; digit < digits; digit++) {
+		dw = (DWORD) d[digit] * (DWORD) w + (DWORD) a[digit] + (DWORD) carry;
+		a[digit] = dw & MAX_WORD;
+		carry = dw >> WORD_BITS;
+	}
 
-		simple_vector_get(i->digits, digit, &iw);
+	// keep adding until the carry goes away
+	for ( ; carry > 0; digit++) {
+		dw = (DWORD) a[digit] + (DWORD) carry;
+		a[digit] = dw & MAX_WORD;
+		carry = dw >> WORD_BITS;
+	}
 
-		dw = (DWORD) iw * (DWORD) w + (DWORD) mult_carry;
-		mult_carry = dw >> (sizeof(WORD) * 8);
+	integer_normalise(acc_r);
+	return 0;
 
-		if (digit + shift < adigits) {
-			simple_vector_get(acc_r->digits, digit + shift, &aw);
-		} else {
-			aw = 0;
+} // }}}
+// {{{ int integer_mult_word_sub(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
+int integer_mult_word_sub(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
+
+	struct integer_scratch *scratch;
+	integer_t *temp, *diff;
+	if ((scratch = integer_scratch_get()) == NULL) {
+		return -1;
+	}
+	temp = scratch->sub_temp;
+	diff = scratch->sub_diff;
+
+	// temp = i * w * (MAX_WORD + 1) ^ shift
+	if (integer_zero(temp) == -1 || integer_mult_word_add(i, w, shift, temp) == -1) {
+		return -1;
+	}
+	temp->positive = i->positive || temp->bits == 0;
+
+	// subtract temp from accumulator
+	if (integer_sub(acc_r, temp, diff) == -1) {
+		return -1;
+	}
+	integer_swap(acc_r, diff);
+
+	return 0;
+
+} // }}}
+
+// {{{ static int integer_mult_small(integer_t *i, uint64_t v) {
+static int integer_mult_small(integer_t *i, uint64_t v) {
+
+	// i *= v in place, v < PRODUCT_LEAF_MAX so digit * v + carry fits
+	size_t digits = integer_num_digits(i);
+	size_t digit;
+	uint64_t t, carry = 0;
+
+	if (word_vector_set_size(i->digits, digits + sizeof(uint64_t) / sizeof(WORD)) == -1) {
+		return -1;
+	}
+	WORD *d = word_vector_data(i->digits);
+
+	for (digit = 0; digit < digits; digit++) {
+		t = (uint64_t) d[digit] * v + carry;
+		d[digit] = t & MAX_WORD;
+		carry = t >> WORD_BITS;
+	}
+
+	for ( ; carry != 0; carry >>= WORD_BITS) {
+		d[digit++] = carry & MAX_WORD;
+	}
+
+	integer_normalise(i);
+	return 0;
+
+} // }}}
+// {{{ static int integer_mult_leaf(integer_t *r, uint64_t *acc, uint64_t v) {
+static int integer_mult_leaf(integer_t *r, uint64_t *acc, uint64_t v) {
+
+	// gather small factors into one machine word before touching r
+	if (v >= PRODUCT_LEAF_MAX) {
+		integer_t *t = integer_new_from_u64(v);
+		integer_t *p = integer_new();
+		int result = -1;
+		if (t != NULL && p != NULL && integer_mult(r, t, p) == 0) {
+			integer_swap(r, p);
+			result = 0;
+		}
+		integer_free(t);
+		integer_free(p);
+		return result;
+	}
+
+	if (v != 0 && *acc >= PRODUCT_LEAF_MAX / v) {
+		if (integer_mult_small(r, *acc) == -1) {
+			return -1;
 		}
+		*acc = 1;
+	}
+	*acc *= v;
+	return 0;
 
-		dw = (dw & MAX_WORD) + (DWORD) aw + (DWORD) add_carry;
-		add_carry = dw >> (sizeof(WORD) * 8);
-		aw = dw & MAX_WORD;
+} // }}}
+// {{{ static int integer_product_tree(const uint64_t *v, uint64_t lo, uint64_t hi, integer_t *r) {
+static int integer_product_tree(const uint64_t *v, uint64_t lo, uint64_t hi, integer_t *r) {
 
-		if (digit + shift < adigits) {
-			simple_vector_put(acc_r->digits, digit + shift, &aw);
-		} else {
-			simple_vector_append(acc_r->digits, &aw);
+	// product of v[lo..hi), or of the numbers lo..hi-1 themselves when v is NULL
+	uint64_t k, acc = 1;
+
+	if (hi - lo <= PRODUCT_LEAF_SIZE) {
+		integer_set_u64(r, 1);
+		for (k = lo; k < hi; k++) {
+			if (integer_mult_leaf(r, &acc, v == NULL ? k : v[k]) == -1) {
+				return -1;
+			}
 		}
+		return integer_mult_small(r, acc);
+	}
 
+	// split in half so both subproducts end up the same size
+	uint64_t mid = lo + (hi - lo) / 2;
+	integer_t *left = integer_new();
+	integer_t *right = integer_new();
+	int result = -1;
+
+	if (left != NULL && right != NULL
+			&& integer_product_tree(v, lo, mid, left) == 0
+			&& integer_product_tree(v, mid, hi, right) == 0) {
+		result = integer_mult(left, right, r);
 	}
 
-	// push it all into the add_carry
-	add_carry += mult_carry;
+	integer_free(left);
+	integer_free(right);
+	return result;
 
-	// keep adding until the add_carry goes away
-	for ( ; add_carry > 0; digit++) {
+} // }}}
+// {{{ int integer_product_u64(const uint64_t *v, size_t count, integer_t *r) {
+int integer_product_u64(const uint64_t *v, size_t count, integer_t *r) {
+	return integer_product_tree(v, 0, count, r);
+} // }}}
+// {{{ int integer_factorial(uint64_t n, integer_t *r) {
+int integer_factorial(uint64_t n, integer_t *r) {
+	return integer_product_tree(NULL, 1, n + 1, r);
+} // }}}
+// {{{ int integer_binomial(uint64_t n, uint64_t k, integer_t *r) {
+int integer_binomial(uint64_t n, uint64_t k, integer_t *r) {
 
-		if (digit + shift < adigits) {
-			simple_vector_get(acc_r->digits, digit + shift, &aw);
-		} else {
-			aw = 0;
+	if (k > n) {
+		return integer_zero(r);
+	}
+	if (k > n - k) {
+		k = n - k;
+	}
+
+	// (n - k + 1) * ... * n / k!, the division is exact
+	integer_t *num = integer_new();
+	integer_t *den = integer_new();
+	integer_t *rem = integer_new();
+	int result = -1;
+
+	if (num != NULL && den != NULL && rem != NULL
+			&& integer_product_tree(NULL, n - k + 1, n + 1, num) == 0
+			&& integer_product_tree(NULL, 1, k + 1, den) == 0) {
+		result = integer_div(num, den, r, rem);
+	}
+
+	integer_free(num);
+	integer_free(den);
+	integer_free(rem);
+	return result;
+
+} // }}}
+
+// {{{ int integer_shift_left(integer_t *i, size_t bits, integer_t *r) {
+int integer_shift_left(integer_t *i, size_t bits, integer_t *r) {
+
+	size_t digits = integer_num_digits(i);
+	size_t words = bits / WORD_BITS;
+	int shift = bits % WORD_BITS;
+	size_t digit;
+	WORD carry = 0;
+
+	// r is all zeros up front, so only the shifted digits need writing;
+	// as in integer_mult, the room is reserved before r is cleared
+	if (integer_reserve(r, digits + words + 1) == -1) {
+		return -1;
+	}
+	word_vector_set_size(r->digits, 0);
+	word_vector_set_size(r->digits, digits + words + 1);
+	WORD *d = word_vector_data(i->digits);
+	WORD *o = word_vector_data(r->digits) + words;
+	r->positive = i->positive;
+
+	if (shift == 0) {
+		simple_vector_put_range(r->digits, words, digits, d);
+	} else {
+		for (digit = 0; digit < digits; digit++) {
+			o[digit] = (d[digit] << shift) | carry;
+			carry = d[digit] >> (WORD_BITS - shift);
 		}
+		o[digits] = carry;
+	}
 
-		dw = (DWORD) aw + (DWORD) add_carry;
-		add_carry = dw >> (sizeof(WORD) * 8);
-		aw = dw & MAX_WORD;
+	integer_normalise(r);
+	return 0;
 
-		if (digit + shift < adigits) {
-			simple_vector_put(acc_r->digits, digit + shift, &aw);
-		} else {
-			simple_vector_append(acc_r->digits, &aw);
+} // }}}
+// {{{ static int integer_is_power_of_two(integer_t *i, size_t bits) {
+static int integer_is_power_of_two(integer_t *i, size_t bits) {
+
+	// only the top bit of the magnitude may be set
+	WORD *d = word_vector_data(i->digits);
+	size_t digit;
+	for (digit = 0; digit < (bits - 1) / WORD_BITS; digit++) {
+		if (d[digit] != 0) {
+			return 0;
 		}
+	}
+	return (d[digit] & (d[digit] - 1)) == 0;
 
+} // }}}
+// {{{ static int integer_mult_swap(integer_t *r, integer_t *i, integer_t *t) {
+static int integer_mult_swap(integer_t *r, integer_t *i, integer_t *t) {
+
+	// r *= i through t, which must share r's allocator
+	if (integer_mult(r, i, t) == -1) {
+		return -1;
 	}
+	integer_swap(r, t);
+	return 0;
 
 } // }}}
-// {{{ void integer_mult_word_sub(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
-void integer_mult_word_sub(integer_t *i, WORD w, size_t shift, integer_t *acc_r) {
+// {{{ int integer_pow(integer_t *base, unsigned int exp, integer_t *r) {
+int integer_pow(integer_t *base, unsigned int exp, integer_t *r) {
 
-	// assumes w * (MAX_WORD + 1) ^ shift < i
+	size_t bits = integer_bit_length(base);
+	int negative = !base->positive && (exp & 1);
+	int ebits, window, k, l;
 
-	// create temporary variable
-	integer_t *temp;
-	temp = integer_new_zero();
+	if (exp == 0) {
+		integer_set_u64(r, 1);
+		return 0;
+	}
+	if (bits == 0) {
+		return integer_zero(r);
+	}
 
-	// insert trailing zeroes
-	ssize_t digit;
-	WORD tw = 0;
-	for (digit = 0; digit < shift; digit++) {
-		simple_vector_append(temp->digits, &tw);
+	// +-2^k: the result is a single bit, no multiplications needed
+	if (integer_is_power_of_two(base, bits)) {
+		integer_t *one = integer_new_from_u64(1);
+		int result = -1;
+		if (one != NULL && integer_shift_left(one, (bits - 1) * (size_t) exp, r) == 0) {
+			r->positive = !negative;
+			result = 0;
+		}
+		integer_free(one);
+		return result;
 	}
 
-	// perform multiplication digit by digit
-	size_t idigits = integer_num_digits(i);
-	DWORD dw;
-	WORD iw, carry = 0;
-	for (digit = 0; digit < idigits; digit++) {
-		simple_vector_get(i->digits, digit, &iw);
-		dw = (DWORD) w * (DWORD) iw + (DWORD) carry;
-		tw = dw & MAX_WORD;
-		carry = dw >> (sizeof(WORD) * 8);
-		simple_vector_append(temp->digits, &tw);
+	for (ebits = 0; (exp >> ebits) != 0 && ebits < 32; ebits++) {
 	}
 
-	// append carry if necessary
-	if (carry > 0) {
-		simple_vector_append(temp->digits, &carry);
+	// wider windows pay off only for longer exponents
+	if (ebits <= 6) {
+		window = 1;
+	} else if (ebits <= 24) {
+		window = 3;
+	} else {
+		window = 4;
 	}
 
-	// subtract temp from accumulator
-	WORD w1, w2, w3;
-	size_t adigits = integer_num_digits(acc_r);
-	size_t tdigits = integer_num_digits(temp);
-	int skipped_zeros = 0;
-	for (digit = 0; digit < adigits; digit += 1) {
-		simple_vector_get(acc_r->digits, digit, &w1);
-		if (digit < tdigits) {
-			simple_vector_get(temp->digits, digit, &w2);
+	// odd powers base^1, base^3, ..., base^(2^window - 1)
+	integer_t *table[1 << 3] = { NULL };
+	integer_t *square = integer_new();
+	int odd = 1 << (window - 1);
+	int failed = square == NULL;
+	for (k = 0; k < odd && !failed; k++) {
+		if ((table[k] = integer_new()) == NULL) {
+			failed = 1;
+		} else if (k == 0) {
+			integer_copy(table[0], base);
+			table[0]->positive = 1;
+			failed = integer_mult(table[0], table[0], square) == -1;
 		} else {
-			w2 = 0;
+			failed = integer_mult(table[k - 1], square, table[k]) == -1;
 		}
-		dw = (DWORD) w1 - (DWORD) w2 - (DWORD) carry;
-		if (dw > (DWORD) w1) {
-			carry = 1;
-		} else {
-			carry = 0;
+	}
+
+	// the result has at most exp * bits bits, so both buffers are sized
+	// once; t shares r's allocator so the two can swap digits
+	integer_t *t = integer_new_allocator(&r->allocator);
+	size_t digits = (bits * (size_t) exp) / WORD_BITS + 1;
+	failed = failed || t == NULL
+		|| integer_reserve(r, digits) == -1 || integer_reserve(t, digits) == -1;
+
+	// left-to-right sliding window
+	int started = 0;
+	for (k = ebits - 1; k >= 0 && !failed; ) {
+
+		if (((exp >> k) & 1) == 0) {
+			failed = integer_mult_swap(r, r, t) == -1;
+			k--;
+			continue;
 		}
-		w3 = dw & MAX_WORD;
-		if (w3 == 0) {
-			skipped_zeros += 1;
+
+		// longest window starting at bit k that ends on a set bit
+		l = k - window + 1 < 0 ? 0 : k - window + 1;
+		while (((exp >> l) & 1) == 0) {
+			l++;
+		}
+		unsigned int value = (exp >> l) & ((1u << (k - l + 1)) - 1);
+
+		if (!started) {
+			integer_copy(r, table[value >> 1]);
+			started = 1;
 		} else {
-			w1 = 0;
-			for ( ; skipped_zeros > 0; skipped_zeros -= 1) {
-				simple_vector_append(acc_r->digits, &w1);
+			int j;
+			for (j = k; j >= l && !failed; j--) {
+				failed = integer_mult_swap(r, r, t) == -1;
 			}
-			simple_vector_append(acc_r->digits, &w3);
+			failed = failed || integer_mult_swap(r, table[value >> 1], t) == -1;
 		}
+
+		k = l - 1;
+
+	}
+
+	if (!failed) {
+		r->positive = !negative;
+	}
+
+	for (k = 0; k < odd; k++) {
+		integer_free(table[k]);
+	}
+	integer_free(square);
+	integer_free(t);
+	return failed ? -1 : 0;
+
+} // }}}
+
+// {{{ static uint64_t rotl(uint64_t x, int k) {
+static uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+} // }}}
+// {{{ void integer_rand_seed(integer_rand_t *state, uint64_t seed) {
+void integer_rand_seed(integer_rand_t *state, uint64_t seed) {
+
+	// expand the seed with splitmix64, which never yields an all-zero state
+	int k;
+	uint64_t z;
+	for (k = 0; k < 4; k++) {
+		seed += 0x9e3779b97f4a7c15ULL;
+		z = seed;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		state->s[k] = z ^ (z >> 31);
+	}
+
+} // }}}
+// {{{ uint64_t integer_rand_next(integer_rand_t *state) {
+uint64_t integer_rand_next(integer_rand_t *state) {
+
+	uint64_t *s = state->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+
+} // }}}
+// {{{ void integer_rand_jump(integer_rand_t *state) {
+void integer_rand_jump(integer_rand_t *state) {
+
+	static const uint64_t jump[] = {
+		0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+		0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+	};
+
+	uint64_t s[4] = { 0, 0, 0, 0 };
+	int j, b, k;
+	for (j = 0; j < 4; j++) {
+		for (b = 0; b < 64; b++) {
+			if (jump[j] & ((uint64_t) 1 << b)) {
+				for (k = 0; k < 4; k++) {
+					s[k] ^= state->s[k];
+				}
+			}
+			integer_rand_next(state);
+		}
+	}
+
+	for (k = 0; k < 4; k++) {
+		state->s[k] = s[k];
 	}
 
-	// there really shouldn't be anything in carry
+} // }}}
+// {{{ int integer_random_bits(integer_rand_t *state, size_t bits, integer_t *r) {
+int integer_random_bits(integer_rand_t *state, size_t bits, integer_t *r) {
+
+	size_t words = (bits + WORD_BITS - 1) / WORD_BITS;
+	size_t digit;
+	uint64_t x = 0;
+	int avail = 0;
+
+	if (word_vector_set_size(r->digits, words) == -1) {
+		return -1;
+	}
+	WORD *d = word_vector_data(r->digits);
+	r->positive = 1;
+
+	// slice each 64-bit output into as many words as it holds
+	for (digit = 0; digit < words; digit++) {
+		if (avail == 0) {
+			x = integer_rand_next(state);
+			avail = 64 / WORD_BITS;
+		}
+		d[digit] = x & MAX_WORD;
+		x >>= WORD_BITS;
+		avail--;
+	}
+
+	// drop the excess high bits of the top word
+	if (bits % WORD_BITS != 0) {
+		d[words - 1] &= ((WORD) 1 << (bits % WORD_BITS)) - 1;
+	}
+
+	integer_normalise(r);
+	return 0;
+
+} // }}}
+// {{{ int integer_random_below(integer_rand_t *state, integer_t *bound, integer_t *r) {
+int integer_random_below(integer_rand_t *state, integer_t *bound, integer_t *r) {
+
+	size_t bits = integer_bit_length(bound);
+
+	if (bits == 0 || !bound->positive) {
+		return integer_zero(r);
+	}
+
+	// rejection sampling, accepts with probability above 1/2
+	do {
+		if (integer_random_bits(state, bits, r) == -1) {
+			return -1;
+		}
+	} while (integer_magnitude_cmp(r, bound) >= 0);
+
+	return 0;
 
 } // }}}
 
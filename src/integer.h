@@ -4,40 +4,92 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+#include "simple_vector.h"
+
 #define WORD uint8_t
 
 struct integer;
 typedef struct integer integer_t;
 
+// xoshiro256** generator state, owned by the caller (one per thread)
+struct integer_rand {
+	uint64_t s[4];
+};
+typedef struct integer_rand integer_rand_t;
+
 integer_t *integer_new_zero();
+// the integer and its digits come from allocator, which it keeps a copy of
+integer_t *integer_new_zero_allocator(const simple_vector_allocator_t *allocator);
 integer_t *integer_new_from_hex(const char *string);
+integer_t *integer_new_from_u64(uint64_t v);
 void integer_free(integer_t *i);
 
 char *integer_to_hex_string(integer_t *i);
 
 int integer_cmp(integer_t *lhs, integer_t *rhs);
 
+// bit length of the magnitude, 0 for zero
+size_t integer_bit_length(integer_t *i);
+// bit of the magnitude, 0 past the top
+int integer_test_bit(integer_t *i, size_t bit);
+// the low 64 bits of the magnitude
+uint64_t integer_to_u64(integer_t *i);
+
+// the functions below returning int give -1 with errno ENOMEM when the
+// result's digits cannot grow, leaving the result as it was unless said
+
 // i = 0
-void integer_zero(integer_t *i);
+int integer_zero(integer_t *i);
 // i1 = i2
 void integer_copy(integer_t *i1, integer_t *i2);
+// i = v
+void integer_set_u64(integer_t *i, uint64_t v);
 
 // sum_r = i1 + i2
-void integer_add(integer_t *i1, integer_t *i2, integer_t *sum_r);
+int integer_add(integer_t *i1, integer_t *i2, integer_t *sum_r);
 // diff_r = i1 - i2
-void integer_sub(integer_t *i1, integer_t *i2, integer_t *diff_r);
+int integer_sub(integer_t *i1, integer_t *i2, integer_t *diff_r);
 // prod_r = i1 * i2
-void integer_mult(integer_t *i1, integer_t *i2, integer_t *prod_r);
-// i1 = quot_r * i2 + rem_r, 0 <= rem_r < i2
-void integer_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r);
+int integer_mult(integer_t *i1, integer_t *i2, integer_t *prod_r);
+// i1 = quot_r * i2 + rem_r, 0 <= rem_r < i2; -1 with errno EDOM when i2
+// is zero, or ENOMEM when the thread's scratch space or the results
+// cannot grow
+int integer_div(integer_t *i1, integer_t *i2, integer_t *quot_r, integer_t *rem_r);
+// quot_r = |i| / d, returns |i| mod d; d > 0, quot_r may be i, or NULL
+// when only the remainder is wanted; UINT64_MAX with errno ENOMEM, and
+// quot_r as it was, when quot_r cannot grow
+uint64_t integer_div_u64(integer_t *i, uint64_t d, integer_t *quot_r);
+
+// r = base ^ exp; r holds no particular value on failure
+int integer_pow(integer_t *base, unsigned int exp, integer_t *r);
+// r = i * 2 ^ bits
+int integer_shift_left(integer_t *i, size_t bits, integer_t *r);
+
+// r = v[0] * v[1] * ... * v[count - 1], by balanced product tree; this and
+// the two below leave r with no particular value on failure
+int integer_product_u64(const uint64_t *v, size_t count, integer_t *r);
+// r = n!
+int integer_factorial(uint64_t n, integer_t *r);
+// r = n! / (k! * (n - k)!)
+int integer_binomial(uint64_t n, uint64_t k, integer_t *r);
 
 
 // i += w * (MAX_WORD + 1) ^ shift
-void integer_accumulate_word(integer_t *i, WORD w, size_t shift);
+int integer_accumulate_word(integer_t *i, WORD w, size_t shift);
 // acc_r += i * w * (MAX_WORD + 1) ^ shift
-void integer_mult_word_add(integer_t *i, WORD w, size_t shift, integer_t *acc_r);
-// acc_r -= i * w * (MAX_WORD + 1) ^ shift
-void integer_mult_word_sub(integer_t *i, WORD w, size_t shift, integer_t *acc_r);
+int integer_mult_word_add(integer_t *i, WORD w, size_t shift, integer_t *acc_r);
+// acc_r -= i * w * (MAX_WORD + 1) ^ shift; -1 as for integer_div
+int integer_mult_word_sub(integer_t *i, WORD w, size_t shift, integer_t *acc_r);
+
+// seed state deterministically from a single 64-bit value
+void integer_rand_seed(integer_rand_t *state, uint64_t seed);
+// advance state by 2^128 steps, giving a non-overlapping stream
+void integer_rand_jump(integer_rand_t *state);
+uint64_t integer_rand_next(integer_rand_t *state);
 
+// r = uniformly random in [0, 2 ^ bits)
+int integer_random_bits(integer_rand_t *state, size_t bits, integer_t *r);
+// r = uniformly random in [0, bound), r must not be bound
+int integer_random_below(integer_rand_t *state, integer_t *bound, integer_t *r);
 
 #endif
@@ -0,0 +1,81 @@
+#ifndef mont64_h
+#define mont64_h
+
+#include <stdint.h>
+
+// Montgomery arithmetic modulo an odd 64 bit n, with R = 2^64. Values in
+// Montgomery form are x * R mod n, kept in [0, n); products go through a
+// 128 bit intermediate and one reduction, with no division.
+struct mont64 {
+	uint64_t n;
+	uint64_t inv;	// n^-1 mod 2^64
+	uint64_t one;	// R mod n
+	uint64_t r2;	// R^2 mod n
+};
+typedef struct mont64 mont64_t;
+
+// {{{ static inline void mont64_init(mont64_t *m, uint64_t n)
+static inline void mont64_init(mont64_t *m, uint64_t n) {
+
+	uint64_t inv = n;
+	int i;
+
+	// n * n == 1 mod 8; each Newton step doubles the correct bits
+	for (i = 0; i < 5; i++) {
+		inv *= 2 - n * inv;
+	}
+
+	m->n = n;
+	m->inv = inv;
+	m->one = -n % n;
+	m->r2 = (unsigned __int128) m->one * m->one % n;
+
+} // }}}
+// {{{ static inline uint64_t mont64_reduce(const mont64_t *m, unsigned __int128 t)
+static inline uint64_t mont64_reduce(const mont64_t *m, unsigned __int128 t) {
+
+	// q * n matches t in the low word, so (t - q * n) / R is a
+	// difference of high words
+	uint64_t q = (uint64_t) t * m->inv;
+	uint64_t hi = t >> 64, qn = ((unsigned __int128) q * m->n) >> 64;
+
+	return hi >= qn ? hi - qn : hi - qn + m->n;
+
+} // }}}
+// {{{ static inline uint64_t mont64_mul(const mont64_t *m, uint64_t a, uint64_t b)
+static inline uint64_t mont64_mul(const mont64_t *m, uint64_t a, uint64_t b) {
+	return mont64_reduce(m, (unsigned __int128) a * b);
+} // }}}
+// {{{ static inline uint64_t mont64_add(const mont64_t *m, uint64_t a, uint64_t b)
+static inline uint64_t mont64_add(const mont64_t *m, uint64_t a, uint64_t b) {
+	return a >= m->n - b ? a - (m->n - b) : a + b;
+} // }}}
+// {{{ static inline uint64_t mont64_sub(const mont64_t *m, uint64_t a, uint64_t b)
+static inline uint64_t mont64_sub(const mont64_t *m, uint64_t a, uint64_t b) {
+	return a >= b ? a - b : a - b + m->n;
+} // }}}
+// {{{ static inline uint64_t mont64_to(const mont64_t *m, uint64_t a)
+static inline uint64_t mont64_to(const mont64_t *m, uint64_t a) {
+	return mont64_mul(m, a % m->n, m->r2);
+} // }}}
+// {{{ static inline uint64_t mont64_from(const mont64_t *m, uint64_t a)
+static inline uint64_t mont64_from(const mont64_t *m, uint64_t a) {
+	return mont64_reduce(m, a);
+} // }}}
+// {{{ static inline uint64_t mont64_pow(const mont64_t *m, uint64_t a, uint64_t e)
+static inline uint64_t mont64_pow(const mont64_t *m, uint64_t a, uint64_t e) {
+
+	uint64_t r = m->one;
+
+	for (; e != 0; e >>= 1) {
+		if (e & 1) {
+			r = mont64_mul(m, r, a);
+		}
+		a = mont64_mul(m, a, a);
+	}
+
+	return r;
+
+} // }}}
+
+#endif
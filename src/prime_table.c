@@ -0,0 +1,482 @@
+#include "prime_table.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "typed_vector.h"
+
+// address space reserved for the gap bytes, room for every prime below
+// 2^40; the checkpoints need a sixty-fourth as many entries
+#define PRIME_TABLE_MAX_GAPS ((size_t) 1 << 36)
+
+// bumped whenever the layout or checksum of a saved table changes
+#define PRIME_TABLE_FILE_VERSION 2
+
+struct prime_table_checkpoint {
+	uint64_t prime;		// the prime at index k * PRIME_TABLE_STRIDE
+	uint64_t offset;	// offset of the gap to the prime after it
+};
+
+// a saved table is this header, then the checkpoints and the gaps exactly
+// as they sit in memory, so a mapping of the file can be used in place;
+// order is written as PRIME_TABLE_FILE_ORDER so that a file from a
+// machine of the other byte order is turned away
+#define PRIME_TABLE_FILE_MAGIC "AEPRIMES"
+#define PRIME_TABLE_FILE_ORDER 0x0102030405060708ULL
+
+struct prime_table_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t stride;
+	uint64_t order;
+	uint64_t count;
+	uint64_t last;
+	uint64_t limit;			// every prime up to here is in the table
+	uint64_t checkpoints;
+	uint64_t gaps;
+	uint64_t checksum;		// of the whole file, with this field zeroed
+};
+
+TYPED_VECTOR(gap, unsigned char)
+TYPED_VECTOR(checkpoint, struct prime_table_checkpoint)
+
+struct prime_table {
+
+	simple_vector_t *gaps;
+	simple_vector_t *checkpoints;
+
+	size_t count;
+	uint64_t last;
+
+	// a table loaded from a file reads straight from the read only
+	// mapping, shared with every other process that has it open, until
+	// it first grows and moves into the vectors
+	const struct prime_table_header *map;
+	size_t map_size;
+
+};
+
+// {{{ static simple_vector_t *prime_table_vector_new(size_t max_capacity, size_t elem_size)
+static simple_vector_t *prime_table_vector_new(size_t max_capacity, size_t elem_size) {
+
+	simple_vector_t *sv;
+
+	// reserve address space so growing never copies, falling back to
+	// the heap with 1.5x growth where the reservation is refused
+	if ((sv = simple_vector_new_mapped(max_capacity, elem_size)) == NULL) {
+		if ((sv = simple_vector_new(16, elem_size)) == NULL) {
+			return NULL;
+		}
+		simple_vector_set_growth(sv, SIMPLE_VECTOR_GROW_HALF, 0);
+	}
+
+	return sv;
+
+} // }}}
+// {{{ prime_table_t *prime_table_new(void)
+prime_table_t *prime_table_new(void) {
+
+	prime_table_t *t;
+
+	if ((t = malloc(sizeof(prime_table_t))) == NULL) {
+		return NULL;
+	}
+
+	t->gaps = prime_table_vector_new(PRIME_TABLE_MAX_GAPS, sizeof(unsigned char));
+	t->checkpoints = prime_table_vector_new(PRIME_TABLE_MAX_GAPS / PRIME_TABLE_STRIDE,
+			sizeof(struct prime_table_checkpoint));
+	if (t->gaps == NULL || t->checkpoints == NULL) {
+		prime_table_free(t);
+		return NULL;
+	}
+
+	t->count = 0;
+	t->last = 0;
+	t->map = NULL;
+	t->map_size = 0;
+
+	return t;
+
+} // }}}
+// {{{ void prime_table_free(prime_table_t *t)
+void prime_table_free(prime_table_t *t) {
+
+	if (t != NULL) {
+		if (t->map != NULL) {
+			munmap((void *) t->map, t->map_size);
+		}
+		simple_vector_free(t->gaps, 0, NULL);
+		simple_vector_free(t->checkpoints, 0, NULL);
+		free(t);
+	}
+
+} // }}}
+
+// {{{ static const unsigned char *prime_table_gaps(prime_table_t *t, size_t *size_r)
+static const unsigned char *prime_table_gaps(prime_table_t *t, size_t *size_r) {
+
+	if (t->map != NULL) {
+		*size_r = t->map->gaps;
+		return (const unsigned char *) t->map + sizeof(struct prime_table_header)
+			+ t->map->checkpoints * sizeof(struct prime_table_checkpoint);
+	}
+
+	*size_r = gap_vector_size(t->gaps);
+	return gap_vector_data(t->gaps);
+
+} // }}}
+// {{{ static const struct prime_table_checkpoint *prime_table_checkpoints(prime_table_t *t, size_t *count_r)
+static const struct prime_table_checkpoint *prime_table_checkpoints(prime_table_t *t, size_t *count_r) {
+
+	if (t->map != NULL) {
+		*count_r = t->map->checkpoints;
+		return (const struct prime_table_checkpoint *) (t->map + 1);
+	}
+
+	*count_r = checkpoint_vector_size(t->checkpoints);
+	return checkpoint_vector_data(t->checkpoints);
+
+} // }}}
+// {{{ static int prime_table_unmap(prime_table_t *t)
+static int prime_table_unmap(prime_table_t *t) {
+
+	const struct prime_table_checkpoint *checkpoints;
+	const unsigned char *gaps;
+	size_t size, count;
+
+	// copy the mapping into the vectors, which can grow
+	gaps = prime_table_gaps(t, &size);
+	checkpoints = prime_table_checkpoints(t, &count);
+	if (simple_vector_append_n(t->gaps, (void *) gaps, size) == -1
+			|| simple_vector_append_n(t->checkpoints, (void *) checkpoints, count) == -1) {
+		simple_vector_clear(t->gaps);
+		simple_vector_clear(t->checkpoints);
+		return -1;
+	}
+
+	munmap((void *) t->map, t->map_size);
+	t->map = NULL;
+	t->map_size = 0;
+
+	return 0;
+
+} // }}}
+
+// {{{ int prime_table_append(prime_table_t *t, uint64_t prime)
+int prime_table_append(prime_table_t *t, uint64_t prime) {
+
+	struct prime_table_checkpoint cp;
+	size_t offset;
+	uint64_t gap;
+
+	if (t->map != NULL && prime_table_unmap(t) == -1) {
+		return -1;
+	}
+	offset = gap_vector_size(t->gaps);
+
+	if (t->count == 0) {
+		// the table always starts at 2, which has no gap
+		if (prime != 2) {
+			errno = EINVAL;
+			return -1;
+		}
+	} else {
+		if (prime <= t->last || (t->last != 2 && (prime - t->last) % 2 != 0)) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		// 2 to 3 is the only odd gap, stored as is
+		gap = t->last == 2 ? 1 : (prime - t->last) / 2;
+		if (gap < 256) {
+			if (gap_vector_append(t->gaps, (unsigned char) gap) == -1) {
+				return -1;
+			}
+		} else if (gap < 65536) {
+			unsigned char escaped[] = { 0, gap & 0xff, gap >> 8 };
+			if (simple_vector_append_n(t->gaps, escaped, 3) == -1) {
+				return -1;
+			}
+		} else {
+			errno = ERANGE;
+			return -1;
+		}
+	}
+
+	if (t->count % PRIME_TABLE_STRIDE == 0) {
+		cp.prime = prime;
+		cp.offset = gap_vector_size(t->gaps);
+		if (checkpoint_vector_append(t->checkpoints, cp) == -1) {
+			simple_vector_truncate(t->gaps, offset);
+			return -1;
+		}
+	}
+
+	t->count++;
+	t->last = prime;
+
+	return 0;
+
+} // }}}
+
+// {{{ size_t prime_table_size(prime_table_t *t)
+size_t prime_table_size(prime_table_t *t) {
+	return t->count;
+} // }}}
+// {{{ uint64_t prime_table_last(prime_table_t *t)
+uint64_t prime_table_last(prime_table_t *t) {
+	return t->last;
+} // }}}
+// {{{ uint64_t prime_table_at(prime_table_t *t, size_t index)
+uint64_t prime_table_at(prime_table_t *t, size_t index) {
+
+	prime_table_iter_t it;
+	uint64_t prime = 0;
+
+	prime_table_iter_init(t, index, &it);
+	prime_table_iter_next(&it, &prime);
+
+	return prime;
+
+} // }}}
+
+// {{{ void prime_table_iter_init(prime_table_t *t, size_t index, prime_table_iter_t *it)
+void prime_table_iter_init(prime_table_t *t, size_t index, prime_table_iter_t *it) {
+
+	const struct prime_table_checkpoint *cp;
+	size_t size;
+	uint64_t prime;
+
+	it->gaps = prime_table_gaps(t, &size);
+	it->count = t->count;
+
+	if (index >= t->count) {
+		it->index = t->count;
+		it->pos = 0;
+		it->prime = 0;
+		return;
+	}
+
+	// start from the nearest checkpoint and decode forwards
+	cp = prime_table_checkpoints(t, &size) + index / PRIME_TABLE_STRIDE;
+	it->index = index - index % PRIME_TABLE_STRIDE;
+	it->pos = cp->offset;
+	it->prime = cp->prime;
+
+	while (it->index < index) {
+		prime_table_iter_next(it, &prime);
+	}
+
+} // }}}
+
+// {{{ static uint64_t prime_table_checksum(const unsigned char *data, size_t size, uint64_t h)
+static uint64_t prime_table_checksum(const unsigned char *data, size_t size, uint64_t h) {
+
+	uint64_t lane[4] = { h, h ^ 1, h ^ 2, h ^ 3 }, w;
+	size_t i, k;
+
+	// four independent multiply-xorshift lanes over 8 byte words, so a
+	// large table checks at memory speed, then the tail a byte at a time
+	for (i = 0; i + 32 <= size; i += 32) {
+		for (k = 0; k < 4; k++) {
+			memcpy(&w, data + i + 8 * k, 8);
+			lane[k] = (lane[k] ^ w) * 0x9e3779b97f4a7c15ULL;
+			lane[k] ^= lane[k] >> 29;
+		}
+	}
+	for (h = size, k = 0; k < 4; k++) {
+		h = (h ^ lane[k]) * 0xbf58476d1ce4e5b9ULL;
+		h ^= h >> 31;
+	}
+	for (; i < size; i++) {
+		h = (h ^ data[i]) * 0x94d049bb133111ebULL;
+		h ^= h >> 29;
+	}
+
+	return h;
+
+} // }}}
+// {{{ static uint64_t prime_table_file_checksum(const struct prime_table_header *header, const struct prime_table_checkpoint *checkpoints, const unsigned char *gaps)
+static uint64_t prime_table_file_checksum(const struct prime_table_header *header,
+		const struct prime_table_checkpoint *checkpoints, const unsigned char *gaps) {
+
+	struct prime_table_header copy = *header;
+	uint64_t h;
+
+	// the header too, so that no field can change unnoticed
+	copy.checksum = 0;
+	h = prime_table_checksum((const unsigned char *) &copy, sizeof(struct prime_table_header),
+			PRIME_TABLE_FILE_VERSION);
+	h = prime_table_checksum((const unsigned char *) checkpoints,
+			header->checkpoints * sizeof(struct prime_table_checkpoint), h);
+	return prime_table_checksum(gaps, header->gaps, h);
+
+} // }}}
+// {{{ static int prime_table_write(int fd, const void *data, size_t size)
+static int prime_table_write(int fd, const void *data, size_t size) {
+
+	const unsigned char *p = data;
+	ssize_t written;
+
+	while (size > 0) {
+		if ((written = write(fd, p, size)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += written;
+		size -= written;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ int prime_table_save(prime_table_t *t, uint64_t limit, const char *path)
+int prime_table_save(prime_table_t *t, uint64_t limit, const char *path) {
+
+	struct prime_table_header header;
+	const struct prime_table_checkpoint *checkpoints;
+	const unsigned char *gaps;
+	size_t size, count;
+	char *tmp;
+	int fd, saved;
+
+	gaps = prime_table_gaps(t, &size);
+	checkpoints = prime_table_checkpoints(t, &count);
+
+	memset(&header, 0, sizeof(struct prime_table_header));
+	memcpy(header.magic, PRIME_TABLE_FILE_MAGIC, sizeof(header.magic));
+	header.version = PRIME_TABLE_FILE_VERSION;
+	header.stride = PRIME_TABLE_STRIDE;
+	header.order = PRIME_TABLE_FILE_ORDER;
+	header.count = t->count;
+	header.last = t->last;
+	header.limit = limit;
+	header.checkpoints = count;
+	header.gaps = size;
+	header.checksum = prime_table_file_checksum(&header, checkpoints, gaps);
+
+	// written beside the destination and renamed over it, so a process
+	// opening path sees either the old table or the whole new one
+	if ((tmp = malloc(strlen(path) + 32)) == NULL) {
+		return -1;
+	}
+	sprintf(tmp, "%s.%ld.tmp", path, (long) getpid());
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		free(tmp);
+		return -1;
+	}
+	if (prime_table_write(fd, &header, sizeof(struct prime_table_header)) == -1
+			|| prime_table_write(fd, checkpoints, count * sizeof(struct prime_table_checkpoint)) == -1
+			|| prime_table_write(fd, gaps, size) == -1 || fsync(fd) == -1) {
+		saved = errno;
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		errno = saved;
+		return -1;
+	}
+
+	// fd is gone even when close fails, so only the file is left to undo
+	if (close(fd) == -1 || rename(tmp, path) == -1) {
+		saved = errno;
+		unlink(tmp);
+		free(tmp);
+		errno = saved;
+		return -1;
+	}
+
+	free(tmp);
+	return 0;
+
+} // }}}
+// {{{ static int prime_table_check_header(const struct prime_table_header *header, size_t size)
+static int prime_table_check_header(const struct prime_table_header *header, size_t size) {
+
+	size_t data = size - sizeof(struct prime_table_header);
+
+	// the sizes are checked piece by piece, as the products could wrap
+	if (memcmp(header->magic, PRIME_TABLE_FILE_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != PRIME_TABLE_FILE_VERSION
+			|| header->stride != PRIME_TABLE_STRIDE
+			|| header->order != PRIME_TABLE_FILE_ORDER
+			|| header->count == 0 || header->last > header->limit
+			|| header->checkpoints != (header->count + PRIME_TABLE_STRIDE - 1) / PRIME_TABLE_STRIDE
+			|| header->gaps > data || header->gaps < header->count - 1
+			|| header->checkpoints > (data - header->gaps) / sizeof(struct prime_table_checkpoint)
+			|| header->checkpoints * sizeof(struct prime_table_checkpoint) != data - header->gaps) {
+		return -1;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ prime_table_t *prime_table_load(const char *path, uint64_t *limit_r)
+prime_table_t *prime_table_load(const char *path, uint64_t *limit_r) {
+
+	const struct prime_table_header *header;
+	const struct prime_table_checkpoint *checkpoints;
+	prime_table_t *t;
+	struct stat st;
+	void *map;
+	int fd, saved;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return NULL;
+	}
+	if (fstat(fd, &st) == -1) {
+		saved = errno;
+		close(fd);
+		errno = saved;
+		return NULL;
+	}
+	if ((size_t) st.st_size < sizeof(struct prime_table_header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	// mapped privately and read only: the pages come from the page cache,
+	// and nothing here ever writes to them
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	saved = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = saved;
+		return NULL;
+	}
+
+	header = map;
+	checkpoints = (const struct prime_table_checkpoint *) (header + 1);
+	if (prime_table_check_header(header, st.st_size) == -1
+			|| prime_table_file_checksum(header, checkpoints,
+				(const unsigned char *) (checkpoints + header->checkpoints)) != header->checksum) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((t = prime_table_new()) == NULL) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	t->map = header;
+	t->map_size = st.st_size;
+	t->count = header->count;
+	t->last = header->last;
+
+	if (limit_r != NULL) {
+		*limit_r = header->limit;
+	}
+
+	return t;
+
+} // }}}
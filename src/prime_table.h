@@ -0,0 +1,73 @@
+#ifndef prime_table_h
+#define prime_table_h
+
+#include <stdint.h>
+
+#include "simple_vector.h"
+
+// A sorted table of primes starting at 2, stored as one byte per prime:
+// half the gap to the previous prime, with 0 escaping to a two byte little
+// endian half gap for the (rare, past 2^32) gaps that do not fit. Every
+// PRIME_TABLE_STRIDE primes an absolute checkpoint is kept, so lookups by
+// index only ever decode a short run of gaps.
+#define PRIME_TABLE_STRIDE 64
+
+struct prime_table;
+typedef struct prime_table prime_table_t;
+
+// walks the table in order; the table must not grow while it is in use
+struct prime_table_iter {
+	const unsigned char *gaps;
+	size_t pos;		// offset of the gap to the prime after prime
+	size_t index;	// index of prime
+	size_t count;
+	uint64_t prime;	// the prime the next call returns
+};
+typedef struct prime_table_iter prime_table_iter_t;
+
+prime_table_t *prime_table_new(void);
+void prime_table_free(prime_table_t *t);
+
+// primes must be appended in increasing order
+int prime_table_append(prime_table_t *t, uint64_t prime);
+
+size_t prime_table_size(prime_table_t *t);
+uint64_t prime_table_last(prime_table_t *t);
+uint64_t prime_table_at(prime_table_t *t, size_t index);
+
+void prime_table_iter_init(prime_table_t *t, size_t index, prime_table_iter_t *it);
+
+// save the table, along with the limit every prime below which it holds,
+// to a versioned and checksummed file; path is replaced atomically
+int prime_table_save(prime_table_t *t, uint64_t limit, const char *path);
+// map a saved table read only, so processes loading the same file share
+// its pages; the table moves to the heap the first time it grows. Fails
+// with EINVAL when the file is damaged or from another version or byte
+// order.
+prime_table_t *prime_table_load(const char *path, uint64_t *limit_r);
+
+// {{{ static inline int prime_table_iter_next(prime_table_iter_t *it, uint64_t *prime_r)
+static inline int prime_table_iter_next(prime_table_iter_t *it, uint64_t *prime_r) {
+
+	unsigned int gap;
+
+	if (it->index >= it->count) {
+		return 0;
+	}
+
+	*prime_r = it->prime;
+
+	// decode the following prime ahead of time
+	if (++it->index < it->count) {
+		if ((gap = it->gaps[it->pos++]) == 0) {
+			gap = it->gaps[it->pos] | (unsigned int) it->gaps[it->pos + 1] << 8;
+			it->pos += 2;
+		}
+		it->prime += it->prime == 2 ? 1 : 2 * (uint64_t) gap;
+	}
+
+	return 1;
+
+} // }}}
+
+#endif
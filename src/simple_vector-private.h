@@ -0,0 +1,39 @@
+#ifndef simple_vector_private_h
+#define simple_vector_private_h
+
+#include <stdint.h>
+
+#include "simple_vector.h"
+
+// vectors whose elements fit in this many bytes keep them inside the
+// struct itself, so a small vector costs a single allocation
+#define SIMPLE_VECTOR_INLINE_SIZE 64
+
+struct simple_vector {
+	
+	size_t size;
+	size_t capacity;
+	size_t elem_size;
+	
+	void *elements;
+
+	simple_vector_allocator_t allocator;
+
+	simple_vector_growth_t growth;
+	size_t increment;
+
+	// mapped vectors reserve mapped_size bytes of address space up front
+	// and commit the first committed bytes of it; zero when heap backed
+	size_t mapped_size;
+	size_t committed;
+
+	union {
+		unsigned char bytes[SIMPLE_VECTOR_INLINE_SIZE];
+		uint64_t align_u64;
+		double align_double;
+		void *align_ptr;
+	} inline_elements;
+
+};
+
+#endif
@@ -1,31 +1,104 @@
 #include "simple_vector.h"
+#include "simple_vector-private.h"
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// mapped vectors commit in whole huge pages where the kernel offers them
+#ifdef MADV_HUGEPAGE
+#define SIMPLE_VECTOR_MAPPED_GRANULE (2 * 1024 * 1024)
+#else
+#define SIMPLE_VECTOR_MAPPED_GRANULE 0
+#endif
+
+// {{{ static void *simple_vector_libc_alloc(void *ctx, size_t size)
+static void *
+simple_vector_libc_alloc(void *ctx, size_t size)
+{
+	(void) ctx;
+	return malloc(size);
+} // }}}
+// {{{ static void *simple_vector_libc_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+static void *
+simple_vector_libc_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+	(void) ctx;
+	(void) old_size;
+	return realloc(ptr, new_size);
+} // }}}
+// {{{ static void simple_vector_libc_free(void *ctx, void *ptr, size_t size)
+static void
+simple_vector_libc_free(void *ctx, void *ptr, size_t size)
+{
+	(void) ctx;
+	(void) size;
+	free(ptr);
+} // }}}
 
-struct simple_vector {
-	
-	size_t size;
-	size_t capacity;
-	size_t elem_size;
-	
-	void *elements;
-
+static const simple_vector_allocator_t simple_vector_libc_allocator = {
+	simple_vector_libc_alloc, simple_vector_libc_realloc, simple_vector_libc_free, NULL
+};
+static simple_vector_allocator_t simple_vector_allocator = {
+	simple_vector_libc_alloc, simple_vector_libc_realloc, simple_vector_libc_free, NULL
 };
 
+// {{{ void simple_vector_set_default_allocator(const simple_vector_allocator_t *allocator)
+void
+simple_vector_set_default_allocator(const simple_vector_allocator_t *allocator)
+{
+	simple_vector_allocator = allocator == NULL ? simple_vector_libc_allocator : *allocator;
+} // }}}
+// {{{ const simple_vector_allocator_t *simple_vector_default_allocator(void)
+const simple_vector_allocator_t *
+simple_vector_default_allocator(void)
+{
+	return &simple_vector_allocator;
+} // }}}
+// {{{ const simple_vector_allocator_t *simple_vector_get_allocator(simple_vector_t *sv)
+const simple_vector_allocator_t *
+simple_vector_get_allocator(simple_vector_t *sv)
+{
+	return &sv->allocator;
+} // }}}
+// {{{ static simple_vector_t *simple_vector_alloc(const simple_vector_allocator_t *allocator)
+static simple_vector_t *
+simple_vector_alloc(const simple_vector_allocator_t *allocator)
+{
+	simple_vector_t *sv;
+
+	if ((sv = allocator->alloc(allocator->ctx, sizeof(simple_vector_t))) == NULL) {
+		return NULL;
+	}
+
+	memset(sv, 0, sizeof(simple_vector_t));
+	sv->allocator = *allocator;
+	return sv;
+
+} // }}}
+
 // {{{ simple_vector_t *simple_vector_new(size_t capacity, size_t elem_size)
 simple_vector_t *
 simple_vector_new(size_t capacity, size_t elem_size)
+{
+	return simple_vector_new_allocator(capacity, elem_size, &simple_vector_allocator);
+} // }}}
+// {{{ simple_vector_t *simple_vector_new_allocator(size_t capacity, size_t elem_size, const simple_vector_allocator_t *allocator)
+simple_vector_t *
+simple_vector_new_allocator(size_t capacity, size_t elem_size,
+		const simple_vector_allocator_t *allocator)
 {
 	simple_vector_t *sv;
 
-	if (elem_size == 0) {
+	if (elem_size == 0 || allocator == NULL) {
 		errno = EFAULT;
 		return NULL;
 	}
 
-	if ((sv = calloc(1, sizeof(simple_vector_t))) == NULL) {
+	if ((sv = simple_vector_alloc(allocator)) == NULL) {
 		errno = ENOMEM;
 		return NULL;
 	}
@@ -33,8 +106,115 @@ simple_vector_new(size_t capacity, size_t elem_size)
 	sv->size = 0;
 	sv->capacity = capacity == 0 ? 1 : capacity;
 	sv->elem_size = elem_size;
+	sv->growth = SIMPLE_VECTOR_GROW_DOUBLE;
+	sv->increment = 0;
+
+	// small vectors start out in the (already zeroed) inline buffer
+	if (sv->capacity <= SIMPLE_VECTOR_INLINE_SIZE / elem_size) {
+		sv->capacity = SIMPLE_VECTOR_INLINE_SIZE / elem_size;
+		sv->elements = sv->inline_elements.bytes;
+		return sv;
+	}
+
+	if ((sv->elements = allocator->alloc(allocator->ctx, sv->capacity * sv->elem_size)) == NULL) {
+		simple_vector_free(sv, 0, NULL);
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(sv->elements, 0, sv->capacity * sv->elem_size);
+
+	return sv;
+
+} // }}}
+// {{{ static size_t simple_vector_mapped_granule(void)
+static size_t
+simple_vector_mapped_granule(void)
+{
+	long page = sysconf(_SC_PAGESIZE);
+
+	if (page <= 0) {
+		page = 4096;
+	}
+
+	return SIMPLE_VECTOR_MAPPED_GRANULE > page ? SIMPLE_VECTOR_MAPPED_GRANULE : page;
+
+} // }}}
+// {{{ static int simple_vector_mapped_resize(simple_vector_t *sv, size_t capacity)
+static int
+simple_vector_mapped_resize(simple_vector_t *sv, size_t capacity)
+{
+	size_t granule = simple_vector_mapped_granule();
+	size_t bytes;
+
+	if (capacity > sv->mapped_size / sv->elem_size) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	// whole granules, but never past the reservation
+	bytes = (capacity * sv->elem_size + granule - 1) / granule * granule;
+	if (bytes > sv->mapped_size) {
+		bytes = sv->mapped_size;
+	}
+
+	if (bytes > sv->committed) {
+		if (mprotect(sv->elements + sv->committed, bytes - sv->committed,
+				PROT_READ | PROT_WRITE) == -1) {
+			return -1;
+		}
+	} else if (bytes < sv->committed) {
+		// hand the pages back; they read as zero if committed again
+		madvise(sv->elements + bytes, sv->committed - bytes, MADV_DONTNEED);
+		mprotect(sv->elements + bytes, sv->committed - bytes, PROT_NONE);
+	}
+
+	sv->committed = bytes;
+	sv->capacity = bytes / sv->elem_size;
+	return 0;
+
+} // }}}
+// {{{ simple_vector_t *simple_vector_new_mapped(size_t max_capacity, size_t elem_size)
+simple_vector_t *
+simple_vector_new_mapped(size_t max_capacity, size_t elem_size)
+{
+	simple_vector_t *sv;
+	size_t granule = simple_vector_mapped_granule();
+
+	if (elem_size == 0 || max_capacity == 0) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	if (max_capacity > (SIZE_MAX - granule) / elem_size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ((sv = simple_vector_alloc(&simple_vector_allocator)) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	sv->size = 0;
+	sv->elem_size = elem_size;
+	sv->growth = SIMPLE_VECTOR_GROW_DOUBLE;
+	sv->increment = 0;
+	sv->mapped_size = (max_capacity * elem_size + granule - 1) / granule * granule;
+
+	// address space only, nothing is committed until the vector grows
+	sv->elements = mmap(NULL, sv->mapped_size, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (sv->elements == MAP_FAILED) {
+		sv->allocator.free(sv->allocator.ctx, sv, sizeof(simple_vector_t));
+		errno = ENOMEM;
+		return NULL;
+	}
 
-	if ((sv->elements = calloc(sv->capacity, sv->elem_size)) == NULL) {
+#ifdef MADV_HUGEPAGE
+	madvise(sv->elements, sv->mapped_size, MADV_HUGEPAGE);
+#endif
+
+	if (simple_vector_mapped_resize(sv, 1) == -1) {
 		simple_vector_free(sv, 0, NULL);
 		errno = ENOMEM;
 		return NULL;
@@ -68,8 +248,12 @@ simple_vector_free(simple_vector_t *sv, int free_elems, free_fn fn)
 			}
 		}
 
-		free(sv->elements);
-		free(sv);
+		if (sv->mapped_size != 0) {
+			munmap(sv->elements, sv->mapped_size);
+		} else if (sv->elements != sv->inline_elements.bytes && sv->elements != NULL) {
+			sv->allocator.free(sv->allocator.ctx, sv->elements, sv->capacity * sv->elem_size);
+		}
+		sv->allocator.free(sv->allocator.ctx, sv, sizeof(simple_vector_t));
 
 	}
 
@@ -122,6 +306,20 @@ simple_vector_capacity(simple_vector_t *sv)
 int simple_vector_clear(simple_vector_t *sv) {
 
 	sv->size = 0;
+	return 0;
+
+} // }}}
+// {{{ int simple_vector_truncate(simple_vector_t *sv, size_t size)
+int
+simple_vector_truncate(simple_vector_t *sv, size_t size)
+{
+
+	if (size > sv->size) {
+		return -1;
+	}
+
+	sv->size = size;
+	return 0;
 
 } // }}}
 // {{{ int simple_vector_resize(simple_vector_t *sv, size_t capacity)
@@ -138,7 +336,24 @@ simple_vector_resize(simple_vector_t *sv, size_t capacity)
 		return -1;
 	}
 
-	if ((elements = realloc(sv->elements, capacity * sv->elem_size)) == NULL) {
+	if (sv->mapped_size != 0) {
+		return simple_vector_mapped_resize(sv, capacity);
+	}
+
+	// still fits inline, nothing to move
+	if (sv->elements == sv->inline_elements.bytes
+			&& capacity <= SIMPLE_VECTOR_INLINE_SIZE / sv->elem_size) {
+		return 0;
+	}
+
+	// leaving the inline buffer copies its contents out once
+	if (sv->elements == sv->inline_elements.bytes) {
+		if ((elements = sv->allocator.alloc(sv->allocator.ctx, capacity * sv->elem_size)) == NULL) {
+			return -1;
+		}
+		memcpy(elements, sv->elements, sv->capacity * sv->elem_size);
+	} else if ((elements = sv->allocator.realloc(sv->allocator.ctx, sv->elements,
+			sv->capacity * sv->elem_size, capacity * sv->elem_size)) == NULL) {
 		return -1;
 	}
 
@@ -154,13 +369,28 @@ simple_vector_resize(simple_vector_t *sv, size_t capacity)
 
 } // }}}
 
+// {{{ int simple_vector_set_growth(simple_vector_t *sv, simple_vector_growth_t growth, size_t increment)
+int
+simple_vector_set_growth(simple_vector_t *sv, simple_vector_growth_t growth, size_t increment)
+{
+
+	if (growth == SIMPLE_VECTOR_GROW_FIXED && increment == 0) {
+		return -1;
+	}
+
+	sv->growth = growth;
+	sv->increment = increment;
+	return 0;
+
+} // }}}
+
 // {{{ int simple_vector_append(simple_vector_t *sv, void *elem)
 int
 simple_vector_append(simple_vector_t *sv, void *elem)
 {
 
 	if (sv->size == sv->capacity) {
-		if (simple_vector_resize(sv, 2 * sv->capacity) == -1) {
+		if (simple_vector_reserve(sv, sv->size + 1) == -1) {
 			return -1;
 		}
 	}
@@ -168,3 +398,155 @@ simple_vector_append(simple_vector_t *sv, void *elem)
 	return simple_vector_put(sv, sv->size, elem);
 
 } // }}}
+
+// {{{ int simple_vector_reserve(simple_vector_t *sv, size_t capacity)
+int
+simple_vector_reserve(simple_vector_t *sv, size_t capacity)
+{
+
+	size_t grown;
+
+	if (capacity <= sv->capacity) {
+		return 0;
+	}
+
+	// the growth policy decides how far past the request to go
+	switch (sv->growth) {
+	case SIMPLE_VECTOR_GROW_HALF:
+		grown = sv->capacity + sv->capacity / 2 + 1;
+		break;
+	case SIMPLE_VECTOR_GROW_FIXED:
+		grown = sv->capacity + sv->increment;
+		break;
+	case SIMPLE_VECTOR_GROW_EXACT:
+		grown = capacity;
+		break;
+	case SIMPLE_VECTOR_GROW_DOUBLE:
+	default:
+		grown = 2 * sv->capacity;
+		break;
+	}
+
+	// a mapped vector grows at most to the end of its reservation
+	if (sv->mapped_size != 0 && grown > sv->mapped_size / sv->elem_size) {
+		grown = sv->mapped_size / sv->elem_size;
+	}
+
+	return simple_vector_resize(sv, grown > capacity ? grown : capacity);
+
+} // }}}
+// {{{ int simple_vector_append_n(simple_vector_t *sv, void *elems, size_t count)
+int
+simple_vector_append_n(simple_vector_t *sv, void *elems, size_t count)
+{
+	return simple_vector_put_range(sv, sv->size, count, elems);
+} // }}}
+// {{{ int simple_vector_fill(simple_vector_t *sv, size_t offset, size_t count, void *elem)
+int
+simple_vector_fill(simple_vector_t *sv, size_t offset, size_t count, void *elem)
+{
+	size_t done, i;
+	unsigned char *start, *bytes = elem;
+	int uniform = 1;
+
+	if (offset > sv->size) {
+		return -1;
+	}
+
+	if (simple_vector_reserve(sv, offset + count) == -1) {
+		return -1;
+	}
+
+	start = (unsigned char *) sv->elements + offset * sv->elem_size;
+
+	// a value made of one repeated byte (zero included) is a single memset
+	if (elem != NULL) {
+		for (i = 1; i < sv->elem_size; i++) {
+			if (bytes[i] != bytes[0]) {
+				uniform = 0;
+				break;
+			}
+		}
+	}
+
+	if (uniform) {
+		memset(start, elem == NULL ? 0 : bytes[0], count * sv->elem_size);
+	} else if (count > 0) {
+		// otherwise seed one element and keep doubling the copied prefix
+		memcpy(start, elem, sv->elem_size);
+		for (done = 1; done < count; done *= 2) {
+			memcpy(start + done * sv->elem_size, start,
+					(done < count - done ? done : count - done) * sv->elem_size);
+		}
+	}
+
+	if (offset + count > sv->size) {
+		sv->size = offset + count;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ int simple_vector_get_range(simple_vector_t *sv, size_t offset, size_t count, void *elems)
+int
+simple_vector_get_range(simple_vector_t *sv, size_t offset, size_t count, void *elems)
+{
+
+	if (offset > sv->size || count > sv->size - offset) {
+		return -1;
+	}
+
+	memcpy(elems, sv->elements + offset * sv->elem_size, count * sv->elem_size);
+	return 0;
+
+} // }}}
+// {{{ int simple_vector_put_range(simple_vector_t *sv, size_t offset, size_t count, void *elems)
+int
+simple_vector_put_range(simple_vector_t *sv, size_t offset, size_t count, void *elems)
+{
+	uintptr_t start = (uintptr_t) sv->elements, from = (uintptr_t) elems;
+	int own = from >= start && from < start + sv->size * sv->elem_size;
+
+	// like simple_vector_put, the range may start at most at the end
+	if (offset > sv->size) {
+		return -1;
+	}
+
+	if (elems == NULL) {
+		return simple_vector_fill(sv, offset, count, NULL);
+	}
+
+	if (simple_vector_reserve(sv, offset + count) == -1) {
+		return -1;
+	}
+
+	// elems may be a range of the vector itself, which the reserve above
+	// can have moved, and which may overlap where it is going
+	if (own) {
+		elems = sv->elements + (from - start);
+	}
+	memmove(sv->elements + offset * sv->elem_size, elems, count * sv->elem_size);
+	if (offset + count > sv->size) {
+		sv->size = offset + count;
+	}
+
+	return 0;
+
+} // }}}
+// {{{ int simple_vector_copy(simple_vector_t *dst, simple_vector_t *src)
+int
+simple_vector_copy(simple_vector_t *dst, simple_vector_t *src)
+{
+
+	if (dst->elem_size != src->elem_size) {
+		return -1;
+	}
+
+	if (dst == src) {
+		return 0;
+	}
+
+	dst->size = 0;
+	return simple_vector_put_range(dst, 0, src->size, src->elements);
+
+} // }}}
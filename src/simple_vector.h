@@ -8,9 +8,41 @@ typedef struct simple_vector simple_vector_t;
 
 typedef void (free_fn)(void *);
 
+// how a full vector picks its next capacity
+enum simple_vector_growth {
+	SIMPLE_VECTOR_GROW_DOUBLE,		// 2x, the default
+	SIMPLE_VECTOR_GROW_HALF,		// 1.5x
+	SIMPLE_VECTOR_GROW_FIXED,		// + increment elements
+	SIMPLE_VECTOR_GROW_EXACT		// just what is needed
+};
+typedef enum simple_vector_growth simple_vector_growth_t;
+
+// where vectors (and the integers built on them) get their memory; every
+// call is handed ctx back, along with the size of the block it concerns
+struct simple_vector_allocator {
+	void *(*alloc)(void *ctx, size_t size);
+	void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+	void (*free)(void *ctx, void *ptr, size_t size);
+	void *ctx;
+};
+typedef struct simple_vector_allocator simple_vector_allocator_t;
+
+// the allocator used when none is given, malloc/realloc/free unless
+// replaced; set it before creating any vectors, NULL restores the libc one
+void simple_vector_set_default_allocator(const simple_vector_allocator_t *allocator);
+const simple_vector_allocator_t *simple_vector_default_allocator(void);
+
 simple_vector_t *simple_vector_new(size_t capacity, size_t elem_size);
+// as simple_vector_new, the vector keeps its own copy of *allocator
+simple_vector_t *simple_vector_new_allocator(size_t capacity, size_t elem_size,
+		const simple_vector_allocator_t *allocator);
+// backed by an mmap reservation of at least max_capacity elements, committing pages as
+// the vector grows, so growing never copies existing elements
+simple_vector_t *simple_vector_new_mapped(size_t max_capacity, size_t elem_size);
 void simple_vector_free(simple_vector_t *sv, int free_elems, free_fn fn);
 
+const simple_vector_allocator_t *simple_vector_get_allocator(simple_vector_t *sv);
+
 int simple_vector_get(simple_vector_t *sv, size_t offset, void *elem);
 int simple_vector_put(simple_vector_t *sv, size_t offset, void *elem);
 
@@ -18,8 +50,20 @@ size_t simple_vector_size(simple_vector_t *sv);
 size_t simple_vector_capacity(simple_vector_t *sv);
 
 int simple_vector_clear(simple_vector_t *sv);
+int simple_vector_truncate(simple_vector_t *sv, size_t size);
 int simple_vector_resize(simple_vector_t *sv, size_t capacity);
+int simple_vector_set_growth(simple_vector_t *sv, simple_vector_growth_t growth, size_t increment);
 
 int simple_vector_append(simple_vector_t *sv, void *elem);
 
+// bulk operations, each moving the whole range with one memmove/memset and
+// reallocating at most once; a NULL elems/elem stands for zeroed elements,
+// and elems may be a range of sv itself
+int simple_vector_reserve(simple_vector_t *sv, size_t capacity);
+int simple_vector_append_n(simple_vector_t *sv, void *elems, size_t count);
+int simple_vector_fill(simple_vector_t *sv, size_t offset, size_t count, void *elem);
+int simple_vector_get_range(simple_vector_t *sv, size_t offset, size_t count, void *elems);
+int simple_vector_put_range(simple_vector_t *sv, size_t offset, size_t count, void *elems);
+int simple_vector_copy(simple_vector_t *dst, simple_vector_t *src);
+
 #endif
@@ -0,0 +1,52 @@
+#ifndef typed_vector_h
+#define typed_vector_h
+
+#include "simple_vector-private.h"
+
+// TYPED_VECTOR(name, type) generates inline accessors over a simple_vector_t
+// whose elements are of the given type. They read and write the element
+// array directly, without bounds checks or memcpy, so loops over
+// name_vector_data() compile down to plain pointer arithmetic. The vector
+// itself is an ordinary simple_vector_t, created with name_vector_new and
+// usable with every simple_vector_* function.
+#define TYPED_VECTOR(name, type)											\
+																			\
+static inline simple_vector_t *name##_vector_new(size_t capacity) {			\
+	return simple_vector_new(capacity, sizeof(type));						\
+}																			\
+																			\
+static inline type *name##_vector_data(simple_vector_t *sv) {				\
+	return (type *) sv->elements;											\
+}																			\
+																			\
+static inline size_t name##_vector_size(simple_vector_t *sv) {				\
+	return sv->size;														\
+}																			\
+																			\
+static inline type name##_vector_at(simple_vector_t *sv, size_t offset) {	\
+	return ((type *) sv->elements)[offset];									\
+}																			\
+																			\
+static inline void name##_vector_set(simple_vector_t *sv, size_t offset,	\
+		type elem) {														\
+	((type *) sv->elements)[offset] = elem;									\
+}																			\
+																			\
+static inline int name##_vector_append(simple_vector_t *sv, type elem) {	\
+	if (sv->size == sv->capacity) {											\
+		return simple_vector_append(sv, &elem);								\
+	}																		\
+	((type *) sv->elements)[sv->size++] = elem;								\
+	return 0;																\
+}																			\
+																			\
+/* grow or shrink to size elements, new elements are zero */				\
+static inline int name##_vector_set_size(simple_vector_t *sv, size_t size) {	\
+	if (size > sv->size) {													\
+		return simple_vector_fill(sv, sv->size, size - sv->size, NULL);		\
+	}																		\
+	sv->size = size;														\
+	return 0;																\
+}
+
+#endif
@@ -0,0 +1,239 @@
+#include "work_pool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// the task numbers a worker has left, guarded by its own lock so
+// thieves only ever contend with the owner they steal from
+struct work_pool_share {
+	pthread_mutex_t lock;
+	size_t begin;
+	size_t end;
+};
+
+struct work_pool_worker {
+	work_pool_t *pool;
+	unsigned int id;
+	pthread_t thread;
+};
+
+struct work_pool {
+
+	unsigned int threads;
+	struct work_pool_share *shares;
+	struct work_pool_worker *workers;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned long generation;	// bumped for every run
+	unsigned int active;		// background workers still in the run
+	int shutdown;
+
+	work_pool_fn *fn;
+	void *arg;
+
+};
+
+// {{{ static int work_pool_take(work_pool_t *pool, unsigned int id, size_t *task_r)
+static int work_pool_take(work_pool_t *pool, unsigned int id, size_t *task_r) {
+
+	struct work_pool_share *own = &pool->shares[id], *victim;
+	size_t half;
+	unsigned int i;
+
+	pthread_mutex_lock(&own->lock);
+	if (own->begin < own->end) {
+		*task_r = own->begin++;
+		pthread_mutex_unlock(&own->lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&own->lock);
+
+	// steal from the back, leaving the victim the tasks it is next to run
+	for (i = 1; i < pool->threads; i++) {
+		victim = &pool->shares[(id + i) % pool->threads];
+		pthread_mutex_lock(&victim->lock);
+		if (victim->begin < victim->end) {
+			half = (victim->end - victim->begin + 1) / 2;
+			victim->end -= half;
+			*task_r = victim->end;
+			pthread_mutex_unlock(&victim->lock);
+
+			pthread_mutex_lock(&own->lock);
+			own->begin = *task_r + 1;
+			own->end = *task_r + half;
+			pthread_mutex_unlock(&own->lock);
+			return 1;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	return 0;
+
+} // }}}
+// {{{ static void work_pool_work(work_pool_t *pool, unsigned int id)
+static void work_pool_work(work_pool_t *pool, unsigned int id) {
+
+	size_t task;
+
+	while (work_pool_take(pool, id, &task)) {
+		pool->fn(pool->arg, task, id);
+	}
+
+} // }}}
+// {{{ static void *work_pool_main(void *p)
+static void *work_pool_main(void *p) {
+
+	struct work_pool_worker *worker = p;
+	work_pool_t *pool = worker->pool;
+	unsigned long seen = 0;
+
+	for (;;) {
+
+		pthread_mutex_lock(&pool->lock);
+		while (pool->generation == seen && !pool->shutdown) {
+			pthread_cond_wait(&pool->start, &pool->lock);
+		}
+		if (pool->shutdown) {
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		work_pool_work(pool, worker->id);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->active == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+	}
+
+} // }}}
+
+// {{{ work_pool_t *work_pool_new(unsigned int threads)
+work_pool_t *work_pool_new(unsigned int threads) {
+
+	work_pool_t *pool;
+	unsigned int i;
+	long cpus;
+
+	if (threads == 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+
+	if ((pool = calloc(1, sizeof(work_pool_t))) == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	pool->shares = calloc(threads, sizeof(struct work_pool_share));
+	pool->workers = calloc(threads, sizeof(struct work_pool_worker));
+	if (pool->shares == NULL || pool->workers == NULL) {
+		free(pool->shares);
+		free(pool->workers);
+		free(pool);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for (i = 0; i < threads; i++) {
+		pthread_mutex_init(&pool->shares[i].lock, NULL);
+	}
+
+	// worker 0 is whoever calls work_pool_run
+	for (pool->threads = 1; pool->threads < threads; pool->threads++) {
+		pool->workers[pool->threads].pool = pool;
+		pool->workers[pool->threads].id = pool->threads;
+		if (pthread_create(&pool->workers[pool->threads].thread, NULL, work_pool_main,
+				&pool->workers[pool->threads]) != 0) {
+			work_pool_free(pool);
+			errno = EAGAIN;
+			return NULL;
+		}
+	}
+
+	return pool;
+
+} // }}}
+// {{{ void work_pool_free(work_pool_t *pool)
+void work_pool_free(work_pool_t *pool) {
+
+	unsigned int i;
+
+	if (pool != NULL) {
+
+		pthread_mutex_lock(&pool->lock);
+		pool->shutdown = 1;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->lock);
+
+		for (i = 1; i < pool->threads; i++) {
+			pthread_join(pool->workers[i].thread, NULL);
+		}
+
+		for (i = 0; i < pool->threads; i++) {
+			pthread_mutex_destroy(&pool->shares[i].lock);
+		}
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->start);
+		pthread_cond_destroy(&pool->done);
+
+		free(pool->shares);
+		free(pool->workers);
+		free(pool);
+
+	}
+
+} // }}}
+
+// {{{ unsigned int work_pool_threads(work_pool_t *pool)
+unsigned int work_pool_threads(work_pool_t *pool) {
+	return pool->threads;
+} // }}}
+// {{{ int work_pool_run(work_pool_t *pool, size_t tasks, work_pool_fn *fn, void *arg)
+int work_pool_run(work_pool_t *pool, size_t tasks, work_pool_fn *fn, void *arg) {
+
+	unsigned int i;
+
+	if (tasks == 0) {
+		return 0;
+	}
+
+	// even shares to start with, stealing evens out the rest
+	for (i = 0; i < pool->threads; i++) {
+		pthread_mutex_lock(&pool->shares[i].lock);
+		pool->shares[i].begin = tasks * i / pool->threads;
+		pool->shares[i].end = tasks * (i + 1) / pool->threads;
+		pthread_mutex_unlock(&pool->shares[i].lock);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->active = pool->threads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	work_pool_work(pool, 0);
+
+	// every task has been taken, wait for the ones still running
+	pthread_mutex_lock(&pool->lock);
+	while (pool->active != 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+
+} // }}}
@@ -0,0 +1,27 @@
+#ifndef work_pool_h
+#define work_pool_h
+
+#include <sys/types.h>
+
+// A fixed set of threads that run numbered tasks. Each run hands every
+// worker a contiguous share of the task numbers; a worker that runs out
+// steals the back half of another worker's remaining share, so uneven
+// tasks still keep every thread busy. The calling thread works as worker
+// 0, so a pool of one thread runs everything inline.
+struct work_pool;
+typedef struct work_pool work_pool_t;
+
+// called once per task, worker is in [0, work_pool_threads())
+typedef void (work_pool_fn)(void *arg, size_t task, unsigned int worker);
+
+// threads == 0 uses one thread per online CPU
+work_pool_t *work_pool_new(unsigned int threads);
+void work_pool_free(work_pool_t *pool);
+
+unsigned int work_pool_threads(work_pool_t *pool);
+
+// runs fn for every task in [0, tasks) and returns once all are done;
+// one run at a time per pool
+int work_pool_run(work_pool_t *pool, size_t tasks, work_pool_fn *fn, void *arg);
+
+#endif
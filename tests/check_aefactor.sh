@@ -0,0 +1,84 @@
+#!/bin/sh
+# aefactor end to end: input split across files, bad tokens and bad
+# options, and the exit status of each
+
+AEFACTOR=${AEFACTOR:-../src/aefactor}
+dir=$(mktemp -d "${TMPDIR:-/tmp}/check_aefactor.XXXXXX") || exit 1
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# expect <name> <status> <expected stdout> -- <arguments>, with stdin from
+# $dir/stdin when it exists
+expect() {
+	name=$1 status=$2 output=$3
+	shift 4
+	if [ -f "$dir/stdin" ]; then
+		"$AEFACTOR" "$@" <"$dir/stdin" >"$dir/out" 2>"$dir/err"
+	else
+		"$AEFACTOR" "$@" </dev/null >"$dir/out" 2>"$dir/err"
+	fi
+	got=$?
+	printf '%s' "$output" >"$dir/want"
+	if [ "$got" -ne "$status" ]; then
+		echo "FAIL $name: exit status $got, expected $status"
+		cat "$dir/err"
+		failed=1
+	elif ! cmp -s "$dir/out" "$dir/want"; then
+		echo "FAIL $name: output differs"
+		diff "$dir/want" "$dir/out"
+		failed=1
+	else
+		echo "ok $name"
+	fi
+	rm -f "$dir/stdin"
+}
+
+printf '12 1\n0\n18446744073709551557\t4294967291\n' >"$dir/stdin"
+expect stdin 0 '12: 2 2 3
+1:
+0:
+18446744073709551557: 18446744073709551557
+4294967291: 4294967291
+' -- -t 2
+
+# a file boundary ends a number like a space would, and - is stdin
+printf '12' >"$dir/a"
+printf '34\n5' >"$dir/b"
+printf '6\n' >"$dir/stdin"
+expect boundary 0 '12: 2 2 3
+34: 2 17
+5: 5
+6: 2 3
+' -- "$dir/a" "$dir/b" -
+
+# more numbers than one batch holds keep their order through the
+# reader, the factoring and the writer
+awk 'BEGIN { for (i = 1; i <= 200000; i++) print i }' >"$dir/stdin"
+cp "$dir/stdin" "$dir/nums"
+"$AEFACTOR" <"$dir/stdin" >"$dir/out" 2>"$dir/err"
+if [ $? -ne 0 ] || ! cut -d: -f1 "$dir/out" | cmp -s - "$dir/nums" \
+		|| [ "$(sed -n '199999p' "$dir/out")" != '199999: 199999' ] \
+		|| [ "$(sed -n '131072p' "$dir/out")" != '131072: 2 2 2 2 2 2 2 2 2 2 2 2 2 2 2 2 2' ]; then
+	echo "FAIL batches: output differs"
+	failed=1
+else
+	echo "ok batches"
+fi
+rm -f "$dir/stdin"
+
+# bad tokens and missing files are reported and skipped, with status 1
+printf '10 abc 18446744073709551616 -5 1x 7\n' >"$dir/stdin"
+expect tokens 1 '10: 2 5
+7: 7
+' --
+[ "$(grep -c 'not a valid integer' "$dir/err")" -eq 4 ] || { echo "FAIL tokens: messages"; failed=1; }
+expect missing 1 '12: 2 2 3
+' -- "$dir/none" "$dir/a"
+
+# bad thread counts are usage errors
+for t in abc -1 ' 3' 3x 1025 99999999999999999999999; do
+	expect "threads '$t'" 2 '' -- -t "$t"
+done
+expect "threads 1024" 0 '' -- -t 1024
+
+exit $failed
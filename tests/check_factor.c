@@ -0,0 +1,689 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "../src/factor.h"
+#include "../src/factor64.h"
+#include "../src/prime_table.h"
+
+// Core test cases
+// {{{ START_TEST(test_prime_ctx_check)
+START_TEST(test_prime_ctx_check)
+{
+	prime_ctx_t *ctx;
+	uint64_t n, d;
+	int prime;
+
+	ctx = prime_ctx_new();
+
+	fail_unless(prime_ctx_check(ctx, 0) == 0);
+	fail_unless(prime_ctx_check(ctx, 1) == 0);
+
+	// against trial division
+	for (n = 2; n < 20000; n++) {
+		for (prime = 1, d = 2; d * d <= n && prime; d++) {
+			prime = n % d != 0;
+		}
+		fail_unless(prime_ctx_check(ctx, n) == prime);
+	}
+
+	prime_ctx_free(ctx);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_prime_ctx_check_large)
+START_TEST(test_prime_ctx_check_large)
+{
+	prime_ctx_t *ctx;
+
+	ctx = prime_ctx_new();
+
+	// strong pseudoprimes to several small bases
+	fail_unless(prime_ctx_check(ctx, 3215031751ULL) == 0);
+	fail_unless(prime_ctx_check(ctx, 3474749660383ULL) == 0);
+	fail_unless(prime_ctx_check(ctx, 341550071728321ULL) == 0);
+	fail_unless(prime_ctx_check(ctx, 3825123056546413051ULL) == 0);
+
+	// the largest primes below 2^32 and 2^64, and products of them
+	fail_unless(prime_ctx_check(ctx, 4294967291ULL) == 1);
+	fail_unless(prime_ctx_check(ctx, 18446744073709551557ULL) == 1);
+	fail_unless(prime_ctx_check(ctx, 18446744073709551615ULL) == 0);
+	fail_unless(prime_ctx_check(ctx, 4294967291ULL * 4294967291ULL) == 0);
+	fail_unless(prime_ctx_check(ctx, 4294967291ULL * 4294967279ULL) == 0);
+
+	prime_ctx_free(ctx);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_prime_ctx_check_small_bases)
+START_TEST(test_prime_ctx_check_small_bases)
+{
+	static char composite[70000];
+	prime_ctx_t *ctx;
+	uint64_t n, d;
+	int prime;
+
+	ctx = prime_ctx_new();
+
+	// the first strong pseudoprime to 2, 7 and 61, where the small bases
+	// stop being enough
+	fail_unless(prime_ctx_check(ctx, 4759123141ULL) == 0);
+	fail_unless(prime_ctx_check(ctx, 4759123141ULL - 1) == 0);
+
+	// either side of it, against trial division by the primes to sqrt
+	for (d = 2; d * d < 70000; d++) {
+		for (n = d * d; !composite[d] && n < 70000; n += d) {
+			composite[n] = 1;
+		}
+	}
+	for (n = 4759123141ULL - 50000; n < 4759123141ULL + 50000; n++) {
+		for (prime = 1, d = 2; d * d <= n && prime; d++) {
+			prime = composite[d] || n % d != 0;
+		}
+		fail_unless(prime_ctx_check(ctx, n) == prime);
+	}
+
+	prime_ctx_free(ctx);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_primorial)
+START_TEST(test_integer_primorial)
+{
+	prime_ctx_t *ctx;
+	integer_t *r;
+	char *s;
+
+	ctx = prime_ctx_new();
+	r = integer_new_zero();
+
+	fail_unless(integer_primorial(ctx, 50, r) == 0);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x88886ffdb344692") == 0);
+	free(s);
+
+	fail_unless(integer_primorial(ctx, 1, r) == 0);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x1") == 0);
+	free(s);
+
+	integer_free(r);
+	prime_ctx_free(ctx);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_prime_ctx_count)
+START_TEST(test_prime_ctx_count)
+{
+	static const uint64_t x[] = { 0, 1, 2, 3, 4, 100, 2999999, 1000000000, 10000000000ULL };
+	static const uint64_t pi[] = { 0, 0, 1, 2, 2, 25, 216816, 50847534, 455052511 };
+	prime_ctx_t *ctx, *threaded;
+	uint64_t count;
+	size_t i;
+
+	ctx = prime_ctx_new();
+	threaded = prime_ctx_new_threads(4);
+
+	for (i = 0; i < sizeof(x) / sizeof(x[0]); i++) {
+		fail_unless(prime_ctx_count(ctx, x[i], &count) == 0 && count == pi[i]);
+		fail_unless(prime_ctx_count(threaded, x[i], &count) == 0 && count == pi[i]);
+	}
+
+	prime_ctx_free(ctx);
+	prime_ctx_free(threaded);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_prime_iter)
+START_TEST(test_prime_iter)
+{
+	static const uint64_t first[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+	static const uint64_t top[] = { 59, 83, 95, 179, 189, 257, 279, 323, 353, 363 };
+	prime_ctx_t *ctx;
+	prime_iter_t *it;
+	uint64_t p, last, count, pi_from, pi_to;
+	size_t i;
+
+	ctx = prime_ctx_new();
+
+	it = prime_iter_new(ctx, 0, 37);
+	for (i = 0; i < sizeof(first) / sizeof(first[0]); i++) {
+		fail_unless(prime_iter_next(it, &p) == 1 && p == first[i]);
+	}
+	fail_unless(prime_iter_next(it, &p) == 0);
+	fail_unless(prime_iter_next(it, &p) == 0);
+
+	// back to the start, and ahead into the middle of a wheel turn
+	prime_iter_skip(it, 4);
+	fail_unless(prime_iter_next(it, &p) == 1 && p == 5);
+	prime_iter_skip(it, 24);
+	fail_unless(prime_iter_next(it, &p) == 1 && p == 29);
+	prime_iter_free(it);
+
+	// a window far past the table, over several segments, against pi(x)
+	it = prime_iter_new(ctx, 1000000000000ULL, 1000030000000ULL);
+	for (count = 0, last = 0; prime_iter_next(it, &p); count++, last = p) {
+		fail_unless(p > last);
+	}
+	fail_unless(prime_ctx_count(ctx, 1000030000000ULL, &pi_to) == 0);
+	fail_unless(prime_ctx_count(ctx, 999999999999ULL, &pi_from) == 0);
+	fail_unless(count == pi_to - pi_from);
+	prime_iter_free(it);
+
+	// the top of the range, where most of the sieving is left to
+	// Miller-Rabin: the primes 2^64 - k just below 2^64...
+	it = prime_iter_new(ctx, 18446744073709551216ULL, UINT64_MAX);
+	for (i = sizeof(top) / sizeof(top[0]); i-- > 0; ) {
+		fail_unless(prime_iter_next(it, &p) == 1 && p == 0 - top[i]);
+	}
+	fail_unless(prime_iter_next(it, &p) == 0);
+	prime_iter_free(it);
+
+	// ...and a wider window against checking every odd number
+	it = prime_iter_new(ctx, 18446744073707551616ULL, UINT64_MAX);
+	for (p = 0, last = 18446744073707551617ULL; prime_iter_next(it, &p); last = p + 2) {
+		for (; last < p; last += 2) {
+			fail_unless(!prime_ctx_check(ctx, last));
+		}
+		fail_unless(prime_ctx_check(ctx, p));
+	}
+	fail_unless(p == 18446744073709551557ULL);
+	prime_iter_free(it);
+
+	prime_ctx_free(ctx);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_prime_ctx_save)
+START_TEST(test_prime_ctx_save)
+{
+	char path[] = "check_factor.XXXXXX", dir[] = "check_factor.XXXXXX", tmp[64];
+	prime_ctx_t *ctx, *loaded;
+	integer_t *r1, *r2;
+	FILE *f;
+	int c;
+
+	fail_unless(mkdtemp(dir) != NULL);
+	close(mkstemp(path));
+	ctx = prime_ctx_new();
+	r1 = integer_new_zero();
+	r2 = integer_new_zero();
+
+	fail_unless(prime_ctx_grow(ctx, 100000) == 0);
+	fail_unless(prime_ctx_save(ctx, path) == 0);
+	loaded = prime_ctx_new_file(path, 1);
+	fail_unless(loaded != NULL);
+
+	// read from the mapping, then grown past it
+	fail_unless(integer_primorial(ctx, 100000, r1) == 0);
+	fail_unless(integer_primorial(loaded, 100000, r2) == 0);
+	fail_unless(integer_cmp(r1, r2) == 0);
+	fail_unless(integer_primorial(ctx, 150000, r1) == 0);
+	fail_unless(integer_primorial(loaded, 150000, r2) == 0);
+	fail_unless(integer_cmp(r1, r2) == 0);
+	prime_ctx_free(loaded);
+
+	// a flipped bit in the gaps fails the checksum
+	f = fopen(path, "r+b");
+	fseek(f, -100, SEEK_END);
+	c = fgetc(f);
+	fseek(f, -100, SEEK_END);
+	fputc(c ^ 4, f);
+	fclose(f);
+	errno = 0;
+	fail_unless(prime_ctx_new_file(path, 1) == NULL && errno == EINVAL);
+
+	// and so does one in the header, here the top byte of the limit, which
+	// would still pass for a limit
+	fail_unless(prime_ctx_save(ctx, path) == 0);
+	f = fopen(path, "r+b");
+	fseek(f, 47, SEEK_SET);
+	c = fgetc(f);
+	fseek(f, 47, SEEK_SET);
+	fputc(c ^ 1, f);
+	fclose(f);
+	errno = 0;
+	fail_unless(prime_ctx_new_file(path, 1) == NULL && errno == EINVAL);
+	remove(path);
+
+	// the rename over a directory fails, and takes the temporary file
+	// with it
+	fail_unless(prime_ctx_save(ctx, dir) == -1);
+	sprintf(tmp, "%s.%ld.tmp", dir, (long) getpid());
+	fail_unless(access(tmp, F_OK) == -1 && errno == ENOENT);
+	fail_unless(rmdir(dir) == 0);
+
+	integer_free(r1);
+	integer_free(r2);
+	prime_ctx_free(ctx);
+}
+END_TEST // }}}
+// {{{ static int prime_ctx_same(prime_ctx_t *ctx1, prime_ctx_t *ctx2)
+static int prime_ctx_same(prime_ctx_t *ctx1, prime_ctx_t *ctx2) {
+
+	char path1[] = "check_factor.XXXXXX", path2[] = "check_factor.XXXXXX";
+	uint64_t num1, num2;
+	FILE *f1, *f2;
+	int c1, c2;
+
+	// a batch stops at the limit and a single segment goes past it, so
+	// the shorter table is checked a number at a time up to the end of
+	// the other, then the saved tables are compared byte for byte
+	prime_ctx_check_next(ctx1, &num1);
+	prime_ctx_check_next(ctx2, &num2);
+	while (num1 < num2) {
+		prime_ctx_check_next(ctx1, &num1);
+	}
+	while (num2 < num1) {
+		prime_ctx_check_next(ctx2, &num2);
+	}
+
+	close(mkstemp(path1));
+	close(mkstemp(path2));
+	fail_unless(prime_ctx_save(ctx1, path1) == 0);
+	fail_unless(prime_ctx_save(ctx2, path2) == 0);
+	f1 = fopen(path1, "rb");
+	f2 = fopen(path2, "rb");
+	fail_unless(f1 != NULL && f2 != NULL);
+	do {
+		c1 = fgetc(f1);
+		c2 = fgetc(f2);
+	} while (c1 == c2 && c1 != EOF);
+	fclose(f1);
+	fclose(f2);
+	remove(path1);
+	remove(path2);
+
+	return c1 == c2;
+
+} // }}}
+// {{{ START_TEST(test_prime_ctx_threads)
+START_TEST(test_prime_ctx_threads)
+{
+	static const unsigned int threads[] = { 2, 3, 4, 7, 64 };
+	static const uint64_t limits[] = { 1000000, 40000000 };
+	prime_ctx_t *single, *ctx;
+	size_t i, j;
+
+	// batches of every size, a short last one, and more threads than
+	// there are segments left to sieve
+	for (j = 0; j < sizeof(limits) / sizeof(limits[0]); j++) {
+		single = prime_ctx_new();
+		fail_unless(prime_ctx_grow(single, limits[j]) == 0);
+		for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+			ctx = prime_ctx_new_threads(threads[i]);
+			fail_unless(ctx != NULL);
+			fail_unless(prime_ctx_grow(ctx, limits[j]) == 0);
+			fail_unless(prime_ctx_same(single, ctx), "%u threads, limit %llu",
+					threads[i], (unsigned long long) limits[j]);
+			prime_ctx_free(ctx);
+		}
+		prime_ctx_free(single);
+	}
+}
+END_TEST // }}}
+// {{{ START_TEST(test_factor_batch)
+START_TEST(test_factor_batch)
+{
+	uint64_t nums[3000], product;
+	prime_ctx_t *pctx;
+	factor_batch_t results;
+	size_t i, j;
+	uint32_t k;
+
+	// spread over the chunks, with the awkward cases among them
+	for (i = 0; i < 3000; i++) {
+		nums[i] = 0x9e3779b97f4a7c15ULL * (i + 1) >> (i % 40);
+	}
+	nums[0] = 0;
+	nums[1] = 1;
+	nums[2] = 18446744073709551557ULL;
+	nums[3] = 4294967291ULL * 4294967279ULL;
+
+	pctx = prime_ctx_new_threads(4);
+	fail_unless(factor_batch(pctx, nums, 3000, NULL, &results) == 0);
+	fail_unless(results.count == 3000);
+	fail_unless(results.offsets[1] == 0 && results.offsets[2] == 0);
+
+	// in input order, increasing, multiplying back to the input
+	for (i = 2; i < 3000; i++) {
+		product = 1;
+		for (j = results.offsets[i]; j < results.offsets[i + 1]; j++) {
+			fail_unless(prime_ctx_check(pctx, results.factors[j].prime));
+			fail_unless(j == results.offsets[i] || results.factors[j - 1].prime < results.factors[j].prime);
+			for (k = 0; k < results.factors[j].power; k++) {
+				product *= results.factors[j].prime;
+			}
+		}
+		fail_unless(product == nums[i]);
+	}
+
+	factor_batch_free(&results);
+	prime_ctx_free(pctx);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_factor_trial)
+START_TEST(test_factor_trial)
+{
+	// powers and products of the primes either side of the trial
+	// division limit
+	static const uint64_t products[] = {
+		9223372036854775808ULL,						// 2^63
+		12157665459056928801ULL,					// 3^40
+		1021ULL * 1021 * 1021 * 1021 * 1021 * 1021,
+		1019ULL * 1021 * 1031 * 1033 * 1039 * 1049,
+		997ULL * 997 * 1009 * 1009 * 1013 * 1013,
+		3ULL * 5 * 7 * 11 * 13 * 17 * 19 * 23 * 29 * 31 * 37 * 41 * 43 * 47,
+	};
+	uint64_t nums[20000 + sizeof(products) / sizeof(products[0])], n, d;
+	prime_ctx_t *pctx;
+	factor_batch_t results;
+	size_t i, j, count;
+	uint32_t power;
+
+	for (count = 0; count < 20000; count++) {
+		nums[count] = count + 2;
+	}
+	for (i = 0; i < sizeof(products) / sizeof(products[0]); i++) {
+		nums[count++] = products[i];
+	}
+
+	pctx = prime_ctx_new();
+	fail_unless(factor_batch(pctx, nums, count, NULL, &results) == 0);
+
+	// against plain trial division
+	for (i = 0; i < count; i++) {
+		j = results.offsets[i];
+		for (n = nums[i], d = 2; d * d <= n; d++) {
+			for (power = 0; n % d == 0; power++) {
+				n /= d;
+			}
+			if (power != 0) {
+				fail_unless(j < results.offsets[i + 1]);
+				fail_unless(results.factors[j].prime == d && results.factors[j].power == power);
+				j++;
+			}
+		}
+		if (n != 1) {
+			fail_unless(j < results.offsets[i + 1]);
+			fail_unless(results.factors[j].prime == n && results.factors[j].power == 1);
+			j++;
+		}
+		fail_unless(j == results.offsets[i + 1]);
+	}
+
+	factor_batch_free(&results);
+	prime_ctx_free(pctx);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_factor_ctx)
+START_TEST(test_integer_factor_ctx)
+{
+	// 3^5 * 65537 * 1000003^2 * (2^31 - 1) * (2^89 - 1)
+	static const char *primes[] = { "0x3", "0x10001", "0xf4243", "0x7fffffff", "0x1ffffffffffffffffffffff" };
+	static const uint32_t powers[] = { 5, 1, 2, 1, 1 };
+	const integer_prime_factor_t *factors;
+	integer_factor_ctx_t *ctx;
+	prime_ctx_t *pctx;
+	integer_t *n;
+	size_t i, count;
+	char *s;
+
+	pctx = prime_ctx_new();
+	n = integer_new_from_hex("0xdd030c95fe9a6fdb8ebeed7b7e79b500b2c81238a0890b");
+
+	ctx = integer_factor_ctx_new(pctx, n);
+	fail_unless(integer_factor_ctx_finish(ctx) == 0);
+	factors = integer_factor_ctx_factors(ctx, &count);
+	fail_unless(count == 5);
+	for (i = 0; i < count; i++) {
+		s = integer_to_hex_string(factors[i].prime);
+		fail_unless(strcmp(s, primes[i]) == 0);
+		fail_unless(factors[i].power == powers[i]);
+		free(s);
+	}
+	integer_factor_ctx_free(ctx);
+
+	// small enough for factor_ctx all along
+	integer_set_u64(n, 1000003ULL * 2147483647ULL * 4);
+	ctx = integer_factor_ctx_new(pctx, n);
+	fail_unless(integer_factor_ctx_finish(ctx) == 0);
+	factors = integer_factor_ctx_factors(ctx, &count);
+	fail_unless(count == 3);
+	fail_unless(integer_to_u64(factors[0].prime) == 2 && factors[0].power == 2);
+	fail_unless(integer_to_u64(factors[1].prime) == 1000003);
+	fail_unless(integer_to_u64(factors[2].prime) == 2147483647);
+	integer_factor_ctx_free(ctx);
+
+	// two 40 bit primes: past factor_ctx, and below SIQS, so found by ECM
+	// on the integer
+	integer_free(n);
+	n = integer_new_from_hex("0x1800000002780000000ff");
+	ctx = integer_factor_ctx_new(pctx, n);
+	fail_unless(integer_factor_ctx_finish(ctx) == 0);
+	factors = integer_factor_ctx_factors(ctx, &count);
+	fail_unless(count == 2);
+	fail_unless(integer_to_u64(factors[0].prime) == 1099511627791ULL && factors[0].power == 1);
+	fail_unless(integer_to_u64(factors[1].prime) == 1649267441681ULL && factors[1].power == 1);
+	integer_factor_ctx_free(ctx);
+
+	// (2^61 - 1) * (2^89 - 1), out of reach of rho and left to SIQS
+	integer_free(n);
+	n = integer_new_from_hex("0x3ffffffffffffffdffffffe000000000000001");
+	ctx = integer_factor_ctx_new(pctx, n);
+	fail_unless(integer_factor_ctx_finish(ctx) == 0);
+	factors = integer_factor_ctx_factors(ctx, &count);
+	fail_unless(count == 2);
+	s = integer_to_hex_string(factors[0].prime);
+	fail_unless(strcmp(s, "0x1fffffffffffffff") == 0);
+	free(s);
+	s = integer_to_hex_string(factors[1].prime);
+	fail_unless(strcmp(s, "0x1ffffffffffffffffffffff") == 0);
+	free(s);
+	integer_factor_ctx_free(ctx);
+
+	integer_free(n);
+	prime_ctx_free(pctx);
+}
+END_TEST // }}}
+
+// Private test cases
+// {{{ START_TEST(test_prime_table)
+START_TEST(test_prime_table)
+{
+	// half gaps around the one byte limit, the largest that can be
+	// stored, and where they fall relative to the checkpoints
+	static const struct {
+		size_t index;
+		uint64_t half_gap;
+	} wide[] = {
+		{ 10, 255 }, { 11, 256 }, { 63, 65535 }, { 64, 300 }, { 65, 1000 },
+		{ 127, 256 }, { 128, 40000 }, { 191, 255 }, { 192, 65535 }, { 500, 12345 },
+	};
+	uint64_t values[1000], p;
+	prime_table_iter_t it;
+	prime_table_t *t;
+	size_t i, j, w;
+
+	// the table takes any increasing odd numbers after 2, which is enough
+	// to lay out every encoding
+	values[0] = 2;
+	values[1] = 3;
+	for (i = 2, w = 0; i < 1000; i++) {
+		values[i] = values[i - 1] + 2 * (1 + i % 7);
+		if (w < sizeof(wide) / sizeof(wide[0]) && wide[w].index == i) {
+			values[i] = values[i - 1] + 2 * wide[w++].half_gap;
+		}
+	}
+
+	t = prime_table_new();
+	errno = 0;
+	fail_unless(prime_table_append(t, 3) == -1 && errno == EINVAL);
+	for (i = 0; i < 1000; i++) {
+		fail_unless(prime_table_append(t, values[i]) == 0);
+	}
+	errno = 0;
+	fail_unless(prime_table_append(t, values[999]) == -1 && errno == EINVAL);
+	fail_unless(prime_table_append(t, values[999] + 3) == -1 && errno == EINVAL);
+	fail_unless(prime_table_append(t, values[999] + 2 * 65536) == -1 && errno == ERANGE);
+	fail_unless(prime_table_size(t) == 1000 && prime_table_last(t) == values[999]);
+
+	for (i = 0; i < 1000; i++) {
+		fail_unless(prime_table_at(t, i) == values[i]);
+	}
+
+	// iteration from every index, through the following checkpoint
+	for (i = 0; i < 1000; i++) {
+		prime_table_iter_init(t, i, &it);
+		for (j = i; j < 1000 && j < i + PRIME_TABLE_STRIDE + 2; j++) {
+			fail_unless(prime_table_iter_next(&it, &p) == 1 && p == values[j]);
+		}
+	}
+	prime_table_iter_init(t, 937, &it);
+	for (j = 937; j < 1000; j++) {
+		fail_unless(prime_table_iter_next(&it, &p) == 1 && p == values[j]);
+	}
+	fail_unless(prime_table_iter_next(&it, &p) == 0);
+	prime_table_iter_init(t, 1000, &it);
+	fail_unless(prime_table_iter_next(&it, &p) == 0);
+
+	prime_table_free(t);
+}
+END_TEST // }}}
+// {{{ static uint64_t factor64_test_prime(uint64_t *state, int bits)
+static uint64_t factor64_test_prime(uint64_t *state, int bits) {
+
+	uint64_t p;
+
+	// xorshift, so every run sees the same primes
+	do {
+		*state ^= *state << 13;
+		*state ^= *state >> 7;
+		*state ^= *state << 17;
+		p = *state >> (64 - bits) | (uint64_t) 1 << (bits - 1) | 1;
+	} while (!factor64_is_prime(p));
+
+	return p;
+
+} // }}}
+// {{{ static int factor64_divides(uint64_t n, uint64_t d)
+static int factor64_divides(uint64_t n, uint64_t d) {
+	return d > 1 && d < n && n % d == 0;
+} // }}}
+// {{{ START_TEST(test_factor64_stages)
+START_TEST(test_factor64_stages)
+{
+	// the largest primes below 2^32, and a square
+	static const uint64_t known[] = {
+		4294967291ULL * 4294967279ULL,
+		4294967279ULL * 4294967231ULL,
+		4294967291ULL * 4294967291ULL,
+		1000003ULL * 1000033ULL,
+		2147483647ULL * 2305843009ULL,
+	};
+	factor_effort_t effort = { 1 << 16, 1 << 20, 64, 0, 0 };
+	uint64_t n, state = 88172645463325252ULL;
+	uint32_t b1;
+	size_t i;
+	int bits;
+
+	for (i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+		fail_unless(factor64_divides(known[i], factor64_squfof(known[i], 0)));
+		fail_unless(factor64_divides(known[i], factor64_ecm(known[i], 64, 165, 25 * 165)));
+		fail_unless(factor64_divides(known[i], factor64_split(known[i], &effort)));
+	}
+
+	// balanced semiprimes across the sizes each stage is used for; SQUFOF
+	// has to reach the multipliers that take kn past 64 bits
+	for (bits = 40; bits <= 64; bits += 2) {
+		b1 = bits <= 52 ? 85 : bits <= 58 ? 125 : 165;
+		for (i = 0; i < 50; i++) {
+			n = factor64_test_prime(&state, bits / 2) * factor64_test_prime(&state, bits / 2);
+			fail_unless(factor64_divides(n, factor64_squfof(n, 0)), "squfof %llu", (unsigned long long) n);
+			fail_unless(factor64_divides(n, factor64_ecm(n, 64, b1, 25 * b1)), "ecm %llu", (unsigned long long) n);
+			fail_unless(factor64_divides(n, factor64_split(n, &effort)), "split %llu", (unsigned long long) n);
+		}
+	}
+}
+END_TEST // }}}
+// {{{ START_TEST(test_factor_effort)
+START_TEST(test_factor_effort)
+{
+	factor_effort_t least = { 1, 1, 1, 2, 2 };
+	uint64_t nums[200], p[200], q[200], state = 2463534242ULL;
+	prime_ctx_t *pctx;
+	factor_batch_t results;
+	size_t i, stopped = 0;
+
+	for (i = 0; i < 200; i++) {
+		p[i] = factor64_test_prime(&state, 30 + i % 2);
+		q[i] = factor64_test_prime(&state, 32);
+		nums[i] = p[i] * q[i];
+
+		// each stage gives up within its effort
+		fail_unless(factor64_rho(nums[i], 1) == 0);
+		fail_unless(factor64_ecm(nums[i], 0, 165, 25 * 165) == 0);
+		if (factor64_squfof(nums[i], 1) == 0) {
+			stopped++;
+		}
+	}
+	fail_unless(stopped != 0);
+
+	// and unlimited rho still finishes the job
+	pctx = prime_ctx_new();
+	fail_unless(factor_batch(pctx, nums, 200, &least, &results) == 0);
+	for (i = 0; i < 200; i++) {
+		fail_unless(results.offsets[i + 1] - results.offsets[i] == 2);
+		fail_unless(results.factors[results.offsets[i]].prime == p[i]);
+		fail_unless(results.factors[results.offsets[i] + 1].prime == q[i]);
+	}
+
+	factor_batch_free(&results);
+	prime_ctx_free(pctx);
+}
+END_TEST // }}}
+
+// {{{ Suite *factor_suite() {
+Suite *factor_suite() {
+
+	Suite *s = suite_create("Factor");
+
+	// {{{ Core test case
+	TCase *tc_core = tcase_create("Core");
+	tcase_add_test(tc_core, test_prime_ctx_check);
+	tcase_add_test(tc_core, test_prime_ctx_check_large);
+	tcase_add_test(tc_core, test_prime_ctx_check_small_bases);
+	tcase_add_test(tc_core, test_integer_primorial);
+	tcase_add_test(tc_core, test_prime_ctx_count);
+	tcase_add_test(tc_core, test_prime_iter);
+	tcase_add_test(tc_core, test_prime_ctx_save);
+	tcase_add_test(tc_core, test_prime_ctx_threads);
+	tcase_add_test(tc_core, test_factor_batch);
+	tcase_add_test(tc_core, test_factor_trial);
+	tcase_add_test(tc_core, test_integer_factor_ctx);
+	suite_add_tcase(s, tc_core);
+	// }}}
+
+	// {{{ Private test case
+	TCase *tc_private = tcase_create("Private");
+	tcase_add_test(tc_private, test_prime_table);
+	tcase_add_test(tc_private, test_factor64_stages);
+	tcase_add_test(tc_private, test_factor_effort);
+	suite_add_tcase(s, tc_private);
+	// }}}
+
+	return s;
+
+} // }}}
+
+// {{{ int main (void)
+int main (void)
+{
+	int number_failed;
+	Suite *s = factor_suite();
+	SRunner *sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+} // }}}
+
+// vim: fdm=marker ts=4
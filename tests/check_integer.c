@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -403,6 +405,451 @@ START_TEST(test_integer_div)
 
 }
 END_TEST // }}}
+// {{{ START_TEST(test_integer_div_neg)
+START_TEST(test_integer_div_neg)
+{
+
+	integer_t *i1, *i2, *quot, *rem;
+	char *s;
+
+	i1 = integer_new_from_hex("-0x70ef00");
+	i2 = integer_new_from_hex("0x1001");
+	quot = integer_new_zero();
+	rem = integer_new_zero();
+	integer_div(i1, i2, quot, rem);
+	s = integer_to_hex_string(quot);
+	fail_unless(strcmp(s, "-0x70f") == 0);
+	free(s);
+
+	s = integer_to_hex_string(rem);
+	fail_unless(strcmp(s, "0x80f") == 0);
+
+	free(s);
+	integer_free(i1);
+	integer_free(i2);
+	integer_free(quot);
+	integer_free(rem);
+
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_div_zero)
+START_TEST(test_integer_div_zero)
+{
+
+	integer_t *i1, *i2, *quot, *rem;
+	char *s;
+
+	i1 = integer_new_from_hex("0x70ef00");
+	i2 = integer_new_zero();
+	quot = integer_new_from_hex("0x5");
+	rem = integer_new_from_hex("0x7");
+
+	// an error, with both results left alone
+	errno = 0;
+	fail_unless(integer_div(i1, i2, quot, rem) == -1 && errno == EDOM);
+	s = integer_to_hex_string(quot);
+	fail_unless(strcmp(s, "0x5") == 0);
+	free(s);
+	s = integer_to_hex_string(rem);
+	fail_unless(strcmp(s, "0x7") == 0);
+	free(s);
+
+	integer_free(i1);
+	integer_free(i2);
+	integer_free(quot);
+	integer_free(rem);
+
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_div_u64)
+START_TEST(test_integer_div_u64)
+{
+
+	integer_t *i, *quot;
+	char *s;
+
+	i = integer_new_from_hex("0x123456789abcdef0123456789abcdef");
+	quot = integer_new_zero();
+
+	fail_unless(integer_bit_length(i) == 121);
+	fail_unless(integer_test_bit(i, 100) == 0);
+	fail_unless(integer_test_bit(i, 101) == 1);
+	fail_unless(integer_test_bit(i, 121) == 0);
+	fail_unless(integer_to_u64(i) == 0x0123456789abcdefULL);
+
+	fail_unless(integer_div_u64(i, 0xfffffffffffffc5ULL, quot) == 0x333333333333eb0ULL);
+	s = integer_to_hex_string(quot);
+	fail_unless(strcmp(s, "0x123456789abcdf33") == 0);
+	free(s);
+
+	// in place, and remainder only
+	fail_unless(integer_div_u64(i, 7, NULL) == 4);
+	fail_unless(integer_div_u64(i, 7, i) == 4);
+	s = integer_to_hex_string(i);
+	fail_unless(strcmp(s, "0x299c335ccf668fdb97530eca8641fd") == 0);
+	free(s);
+
+	integer_free(i);
+	integer_free(quot);
+
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_factorial)
+START_TEST(test_integer_factorial)
+{
+	integer_t *i;
+	char *s;
+
+	i = integer_new_zero();
+
+	integer_factorial(0, i);
+	s = integer_to_hex_string(i);
+	fail_unless(strcmp(s, "0x1") == 0);
+	free(s);
+
+	integer_factorial(100, i);
+	s = integer_to_hex_string(i);
+	fail_unless(strcmp(s, "0x1b30964ec395dc24069528d54bbda40d16e966ef9a70eb21b5b2943a321cdf10391745570cca9420c6ecb3b72ed2ee8b02ea2735c61a000000000000000000000000") == 0);
+	free(s);
+
+	integer_free(i);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_binomial)
+START_TEST(test_integer_binomial)
+{
+	integer_t *i;
+	char *s;
+
+	i = integer_new_zero();
+
+	integer_binomial(100, 50, i);
+	s = integer_to_hex_string(i);
+	fail_unless(strcmp(s, "0x145ff5d3b1070380dc8085568") == 0);
+	free(s);
+
+	integer_binomial(1000, 997, i);
+	s = integer_to_hex_string(i);
+	fail_unless(strcmp(s, "0x9e781d8") == 0);
+	free(s);
+
+	integer_binomial(5, 7, i);
+	s = integer_to_hex_string(i);
+	fail_unless(strcmp(s, "0x0") == 0);
+	free(s);
+
+	integer_free(i);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_product_u64)
+START_TEST(test_integer_product_u64)
+{
+	uint64_t v[] = { 3, 5, 0x1000000000000021ULL, 0x800000000000001dULL, 7 };
+	integer_t *i;
+	char *s;
+
+	i = integer_new_zero();
+	integer_product_u64(v, 5, i);
+	s = integer_to_hex_string(i);
+	fail_unless(strcmp(s, "0x34800000000000782d000000000018885") == 0);
+	free(s);
+
+	integer_free(i);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_pow)
+START_TEST(test_integer_pow)
+{
+	integer_t *b, *r;
+	char *s;
+
+	r = integer_new_zero();
+
+	b = integer_new_from_hex("0x3");
+	integer_pow(b, 100, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x5a4653ca673768565b41f775d6947d55cf3813d1") == 0);
+	free(s);
+
+	integer_pow(b, 0, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x1") == 0);
+	free(s);
+	integer_free(b);
+
+	b = integer_new_from_hex("0x1234567");
+	integer_pow(b, 37, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x769c6cc1a7f7b052a9bbc0dbee03e5d7ebd23d44b6d43e90efa686e193d04d4262b8ca8217d108eeb8207d60721ba6ac2b037892f1227728f697698b48ccfe0e3f0e229156f01e5420aa23273df63a612f0a4a7b879decd422fb702975daa55df982543615a3028f7613416ae3477187") == 0);
+	free(s);
+	integer_free(b);
+
+	b = integer_new_from_hex("-0x1fe");
+	integer_pow(b, 41, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "-0x1b417b8d3e92a7f372573031b8f49cd6d8e5352e2d10838d24050cedc151b21e0e506d39527419851fe0000000000") == 0);
+	free(s);
+	integer_free(b);
+
+	integer_free(r);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_pow_two)
+START_TEST(test_integer_pow_two)
+{
+	integer_t *b, *r;
+	char *s;
+
+	r = integer_new_zero();
+
+	b = integer_new_from_hex("-0x2");
+	integer_pow(b, 65, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "-0x20000000000000000") == 0);
+	free(s);
+	integer_free(b);
+
+	b = integer_new_from_hex("0x10");
+	integer_pow(b, 3, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x1000") == 0);
+	free(s);
+	integer_free(b);
+
+	b = integer_new_zero();
+	integer_pow(b, 5, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x0") == 0);
+	free(s);
+	integer_free(b);
+
+	integer_free(r);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_normal_form)
+START_TEST(test_integer_normal_form)
+{
+	integer_t *i1, *i2, *zero, *r;
+	char *s;
+
+	i1 = integer_new_from_hex("0x1234567890");
+	i2 = integer_new_from_hex("-0x000");
+	zero = integer_new_zero();
+	r = integer_new_zero();
+
+	// negative zero parses as zero
+	fail_unless(integer_cmp(i2, zero) == 0);
+	s = integer_to_hex_string(i2);
+	fail_unless(strcmp(s, "0x0") == 0);
+	free(s);
+
+	// equal operands subtract to a single zero digit
+	integer_sub(i1, i1, r);
+	fail_unless(integer_cmp(r, zero) == 0);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x0") == 0);
+	free(s);
+
+	// cancelling the top digits leaves no leading zeros
+	integer_free(i2);
+	i2 = integer_new_from_hex("-0x1234567800");
+	integer_add(i1, i2, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x90") == 0);
+	free(s);
+
+	// a zero product is never negative
+	integer_mult(i2, zero, r);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x0") == 0);
+	free(s);
+
+	integer_free(i1);
+	integer_free(i2);
+	integer_free(zero);
+	integer_free(r);
+}
+END_TEST // }}}
+// {{{ counting allocator
+#define COUNTING_MAGIC 0x636f756e74696e67ULL
+
+// each block is preceded by its size and a magic number, which free and
+// realloc check, so a block from elsewhere or of the wrong size shows up
+// in bad instead of going unnoticed; while refuse is set, every
+// allocation fails with ENOMEM, as malloc would
+struct counting_allocator {
+	size_t live;
+	size_t calls;
+	size_t bad;
+	int refuse;
+};
+static int counting_check(struct counting_allocator *c, void *ptr, size_t size) {
+	uint64_t *p = (uint64_t *) ptr - 2;
+	if (p[0] != size || p[1] != COUNTING_MAGIC) {
+		c->bad++;
+		return 0;
+	}
+	return 1;
+}
+static void *counting_alloc(void *ctx, size_t size) {
+	struct counting_allocator *c = ctx;
+	uint64_t *p;
+	if (c->refuse) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if ((p = malloc(2 * sizeof(uint64_t) + size)) == NULL) {
+		return NULL;
+	}
+	p[0] = size;
+	p[1] = COUNTING_MAGIC;
+	c->live++;
+	c->calls++;
+	return p + 2;
+}
+static void *counting_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+	struct counting_allocator *c = ctx;
+	uint64_t *p;
+	c->calls++;
+	if (c->refuse) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (!counting_check(c, ptr, old_size)
+			|| (p = realloc((uint64_t *) ptr - 2, 2 * sizeof(uint64_t) + new_size)) == NULL) {
+		return NULL;
+	}
+	p[0] = new_size;
+	return p + 2;
+}
+static void counting_free(void *ctx, void *ptr, size_t size) {
+	struct counting_allocator *c = ctx;
+	if (counting_check(c, ptr, size)) {
+		c->live--;
+		free((uint64_t *) ptr - 2);
+	}
+}
+// }}}
+// {{{ START_TEST(test_integer_allocator)
+START_TEST(test_integer_allocator)
+{
+	struct counting_allocator counts = { 0, 0, 0, 0 };
+	simple_vector_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &counts
+	};
+	integer_t *i1, *i2, *r, *q, *base, *expect, *expect_q;
+	char *s;
+
+	i1 = integer_new_from_hex("0x123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789");
+	r = integer_new_zero_allocator(&allocator);
+	fail_unless(r != NULL);
+	fail_unless(counts.live == 2);
+
+	// growing past the inline buffer goes through the same allocator
+	integer_mult(i1, i1, r);
+	fail_unless(counts.live == 3);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x14b66dc33f6acdca878d6495a927ab94fa645b6812e4895f6d3b523a7ca16729e012490ccdef0f9ed4270f1a643231d461501847fa755409ee79217590b8763f7ba22aa326fb98751") == 0);
+	free(s);
+
+	// results built in temporaries and moved into r stay in r's memory:
+	// both ways of integer_pow, the remainder of a negative dividend, and
+	// integer_mult_word_sub
+	base = integer_new_from_u64(2);
+	expect = integer_new_zero();
+	expect_q = integer_new_zero();
+	integer_pow(base, 100, r);
+	integer_pow(base, 100, expect);
+	fail_unless(integer_cmp(r, expect) == 0);
+	integer_set_u64(base, 3);
+	integer_pow(base, 1000, r);
+	integer_pow(base, 1000, expect);
+	fail_unless(integer_cmp(r, expect) == 0);
+
+	q = integer_new_zero_allocator(&allocator);
+	i2 = integer_new_from_hex("-0xfedcba9876543210fedcba9876543210fedcba9876543210");
+	integer_set_u64(base, 1000003);
+	fail_unless(integer_div(i2, base, q, r) == 0);
+	fail_unless(integer_div(i2, base, expect_q, expect) == 0);
+	fail_unless(integer_cmp(q, expect_q) == 0 && integer_cmp(r, expect) == 0);
+	integer_free(i2);
+
+	integer_copy(r, i1);
+	integer_copy(expect, i1);
+	fail_unless(integer_mult_word_sub(base, 0x9d, 7, r) == 0);
+	fail_unless(integer_mult_word_sub(base, 0x9d, 7, expect) == 0);
+	fail_unless(integer_cmp(r, expect) == 0);
+
+	integer_free(r);
+	integer_free(q);
+	integer_free(base);
+	integer_free(expect);
+	integer_free(expect_q);
+	fail_unless(counts.live == 0);
+	fail_unless(counts.bad == 0);
+	fail_unless(counts.calls > 2);
+
+	// NULL restores plain malloc for everything created afterwards
+	simple_vector_set_default_allocator(&allocator);
+	r = integer_new_zero();
+	fail_unless(counts.live == 2);
+	simple_vector_set_default_allocator(NULL);
+	integer_free(r);
+	fail_unless(counts.live == 0);
+
+	integer_free(i1);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_alloc_failure)
+START_TEST(test_integer_alloc_failure)
+{
+	struct counting_allocator counts = { 0, 0, 0, 0 };
+	simple_vector_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &counts
+	};
+	integer_t *i1, *base, *r;
+	integer_rand_t state;
+	char *s;
+
+	// i1 is bigger than the inline buffer, so every result from it is too
+	i1 = integer_new_zero();
+	base = integer_new_from_u64(3);
+	r = integer_new_zero_allocator(&allocator);
+	integer_rand_seed(&state, 1);
+	fail_unless(integer_shift_left(base, 600, i1) == 0);
+
+	// once r cannot grow past its inline buffer, each operation that
+	// needs it bigger fails and leaves it as it was
+	integer_set_u64(r, 0x55);
+	counts.refuse = 1;
+	errno = 0;
+	fail_unless(integer_mult(i1, i1, r) == -1 && errno == ENOMEM);
+	fail_unless(integer_add(i1, i1, r) == -1);
+	fail_unless(integer_sub(i1, base, r) == -1);
+	fail_unless(integer_shift_left(base, 1000, r) == -1);
+	fail_unless(integer_accumulate_word(r, 1, 100) == -1);
+	fail_unless(integer_mult_word_add(i1, 3, 0, r) == -1);
+	fail_unless(integer_random_bits(&state, 1000, r) == -1);
+	errno = 0;
+	fail_unless(integer_div_u64(i1, 7, r) == UINT64_MAX && errno == ENOMEM);
+	s = integer_to_hex_string(r);
+	fail_unless(strcmp(s, "0x55") == 0);
+	free(s);
+
+	// these build r from scratch, so only the failure is promised
+	fail_unless(integer_pow(base, 1000, r) == -1);
+	fail_unless(integer_factorial(100, r) == -1);
+
+	counts.refuse = 0;
+	fail_unless(integer_factorial(100, r) == 0);
+	fail_unless(integer_bit_length(r) == 525);
+
+	integer_free(r);
+	integer_free(base);
+	integer_free(i1);
+	fail_unless(counts.live == 0 && counts.bad == 0);
+}
+END_TEST // }}}
 // {{{ START_TEST(test_integer_zero)
 START_TEST(test_integer_zero)
 {
@@ -431,6 +878,129 @@ START_TEST(test_integer_copy)
 	free(s);
 }
 END_TEST // }}}
+// {{{ START_TEST(test_integer_random_bits)
+START_TEST(test_integer_random_bits)
+{
+	integer_rand_t st1, st2;
+	integer_t *i1, *i2, *limit;
+	char *s1, *s2;
+	int k;
+
+	integer_rand_seed(&st1, 42);
+	integer_rand_seed(&st2, 42);
+	i1 = integer_new_zero();
+	i2 = integer_new_zero();
+	limit = integer_new_from_hex("0x20000000000000000000000000");
+
+	// same seed, same stream; 2 ^ 101 bounds every draw
+	for (k = 0; k < 100; k++) {
+		integer_random_bits(&st1, 101, i1);
+		integer_random_bits(&st2, 101, i2);
+		s1 = integer_to_hex_string(i1);
+		s2 = integer_to_hex_string(i2);
+		fail_unless(strcmp(s1, s2) == 0);
+		fail_unless(integer_cmp(i1, limit) < 0);
+		free(s1);
+		free(s2);
+	}
+
+	integer_random_bits(&st1, 0, i1);
+	s1 = integer_to_hex_string(i1);
+	fail_unless(strcmp(s1, "0x0") == 0);
+	free(s1);
+
+	integer_free(i1);
+	integer_free(i2);
+	integer_free(limit);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_integer_random_below)
+START_TEST(test_integer_random_below)
+{
+	integer_rand_t st;
+	integer_t *bound, *r, *zero;
+	int k;
+
+	integer_rand_seed(&st, 7);
+	integer_rand_jump(&st);
+	bound = integer_new_from_hex("0x100000000000000000001");
+	r = integer_new_zero();
+	zero = integer_new_zero();
+
+	for (k = 0; k < 200; k++) {
+		integer_random_below(&st, bound, r);
+		fail_unless(integer_cmp(r, bound) < 0);
+		fail_unless(integer_cmp(r, zero) >= 0);
+	}
+
+	integer_free(bound);
+	integer_free(r);
+	integer_free(zero);
+}
+END_TEST // }}}
+// {{{ static void *integer_threads_worker(void *arg)
+#define THREADS_COUNT 16
+#define THREADS_ROUNDS 200
+static void *integer_threads_worker(void *arg)
+{
+	integer_rand_t st;
+	integer_t *a, *b, *prod, *quot, *rem, *check;
+	int k, *failed = arg;
+
+	integer_rand_seed(&st, (uint64_t) (size_t) arg);
+	a = integer_new_zero();
+	b = integer_new_zero();
+	prod = integer_new_zero();
+	quot = integer_new_zero();
+	rem = integer_new_zero();
+	check = integer_new_zero();
+
+	// a * b / b == a, and quot * b + rem == a
+	for (k = 0; k < THREADS_ROUNDS; k++) {
+		integer_random_bits(&st, 300, a);
+		integer_random_bits(&st, 1 + integer_rand_next(&st) % 200, b);
+		integer_accumulate_word(b, 1, 0);
+
+		integer_mult(a, b, prod);
+		if (integer_div(prod, b, quot, rem) == -1 || integer_cmp(quot, a) != 0) {
+			*failed = 1;
+		}
+
+		if (integer_div(a, b, quot, rem) == -1) {
+			*failed = 1;
+		}
+		integer_mult(quot, b, prod);
+		integer_add(prod, rem, check);
+		if (integer_cmp(check, a) != 0) {
+			*failed = 1;
+		}
+	}
+
+	integer_free(a);
+	integer_free(b);
+	integer_free(prod);
+	integer_free(quot);
+	integer_free(rem);
+	integer_free(check);
+	return NULL;
+} // }}}
+// {{{ START_TEST(test_integer_threads)
+START_TEST(test_integer_threads)
+{
+	pthread_t threads[THREADS_COUNT];
+	int failed[THREADS_COUNT];
+	int k;
+
+	for (k = 0; k < THREADS_COUNT; k++) {
+		failed[k] = 0;
+		fail_unless(pthread_create(&threads[k], NULL, integer_threads_worker, &failed[k]) == 0);
+	}
+	for (k = 0; k < THREADS_COUNT; k++) {
+		pthread_join(threads[k], NULL);
+		fail_unless(failed[k] == 0);
+	}
+}
+END_TEST // }}}
 
 #include "../src/integer-private.h"
 
@@ -481,13 +1051,33 @@ Suite *integer_suite() {
 	tcase_add_test(tc_core, test_integer_mult);
 	tcase_add_test(tc_core, test_integer_mult_neg);
 	tcase_add_test(tc_core, test_integer_div_remainder_only);
-	//tcase_add_test(tc_core, test_integer_div_word_size);
-	//tcase_add_test(tc_core, test_integer_div);
+	tcase_add_test(tc_core, test_integer_div_word_size);
+	tcase_add_test(tc_core, test_integer_div);
+	tcase_add_test(tc_core, test_integer_div_neg);
+	tcase_add_test(tc_core, test_integer_div_zero);
+	tcase_add_test(tc_core, test_integer_div_u64);
 	tcase_add_test(tc_core, test_integer_zero);
 	tcase_add_test(tc_core, test_integer_copy);
+	tcase_add_test(tc_core, test_integer_random_bits);
+	tcase_add_test(tc_core, test_integer_random_below);
+	tcase_add_test(tc_core, test_integer_factorial);
+	tcase_add_test(tc_core, test_integer_binomial);
+	tcase_add_test(tc_core, test_integer_product_u64);
+	tcase_add_test(tc_core, test_integer_pow);
+	tcase_add_test(tc_core, test_integer_pow_two);
+	tcase_add_test(tc_core, test_integer_normal_form);
+	tcase_add_test(tc_core, test_integer_allocator);
+	tcase_add_test(tc_core, test_integer_alloc_failure);
 	suite_add_tcase(s, tc_core);
 	// }}}
 
+	// {{{ Threads test case
+	TCase *tc_threads = tcase_create("Threads");
+	tcase_set_timeout(tc_threads, 60);
+	tcase_add_test(tc_threads, test_integer_threads);
+	suite_add_tcase(s, tc_threads);
+	// }}}
+
 	// {{{ Private test case
 	TCase *tc_private = tcase_create("Private");
 	tcase_add_test(tc_private, test_integer_word);
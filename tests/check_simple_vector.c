@@ -0,0 +1,507 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "../src/concurrent_vector.h"
+#include "../src/simple_vector.h"
+#include "../src/typed_vector.h"
+
+TYPED_VECTOR(u32, uint32_t)
+
+// Core test cases
+// {{{ START_TEST(test_simple_vector_range_empty)
+START_TEST(test_simple_vector_range_empty)
+{
+	simple_vector_t *sv;
+	uint32_t v[4] = { 1, 2, 3, 4 }, out[4];
+
+	sv = simple_vector_new(0, sizeof(uint32_t));
+
+	// nothing to move, at the start and at the end, on an empty vector
+	fail_unless(simple_vector_put_range(sv, 0, 0, v) == 0);
+	fail_unless(simple_vector_append_n(sv, v, 0) == 0);
+	fail_unless(simple_vector_fill(sv, 0, 0, &v[0]) == 0);
+	fail_unless(simple_vector_get_range(sv, 0, 0, out) == 0);
+	fail_unless(simple_vector_size(sv) == 0);
+
+	// and past the end, which is never allowed
+	fail_unless(simple_vector_put_range(sv, 1, 0, v) == -1);
+	fail_unless(simple_vector_fill(sv, 1, 0, NULL) == -1);
+	fail_unless(simple_vector_get_range(sv, 1, 0, out) == -1);
+
+	fail_unless(simple_vector_append_n(sv, v, 4) == 0);
+	fail_unless(simple_vector_put_range(sv, 4, 0, v) == 0);
+	fail_unless(simple_vector_get_range(sv, 4, 0, out) == 0);
+	fail_unless(simple_vector_get_range(sv, 3, 2, out) == -1);
+	fail_unless(simple_vector_size(sv) == 4);
+
+	simple_vector_free(sv, 0, NULL);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_simple_vector_range_end)
+START_TEST(test_simple_vector_range_end)
+{
+	simple_vector_t *sv;
+	uint32_t v[100], out[100];
+	size_t i;
+
+	for (i = 0; i < 100; i++) {
+		v[i] = i;
+	}
+
+	sv = simple_vector_new(0, sizeof(uint32_t));
+
+	// starting exactly at the end appends, starting before it and running
+	// past it overwrites the tail and extends
+	fail_unless(simple_vector_put_range(sv, 0, 60, v) == 0);
+	fail_unless(simple_vector_put_range(sv, 60, 20, v + 60) == 0);
+	fail_unless(simple_vector_size(sv) == 80);
+	fail_unless(simple_vector_put_range(sv, 70, 30, v + 70) == 0);
+	fail_unless(simple_vector_size(sv) == 100);
+	fail_unless(simple_vector_get_range(sv, 0, 100, out) == 0);
+	fail_unless(memcmp(out, v, sizeof(v)) == 0);
+
+	// zeroes, and a value that is not one repeated byte, over the end
+	fail_unless(simple_vector_put_range(sv, 90, 20, NULL) == 0);
+	fail_unless(simple_vector_size(sv) == 110);
+	fail_unless(simple_vector_get_range(sv, 89, 21, out) == 0);
+	fail_unless(out[0] == 89);
+	for (i = 1; i < 21; i++) {
+		fail_unless(out[i] == 0);
+	}
+	v[0] = 0x01020304;
+	fail_unless(simple_vector_fill(sv, 105, 37, &v[0]) == 0);
+	fail_unless(simple_vector_size(sv) == 142);
+	fail_unless(simple_vector_get_range(sv, 104, 38, out) == 0);
+	fail_unless(out[0] == 0);
+	for (i = 1; i < 38; i++) {
+		fail_unless(out[i] == 0x01020304);
+	}
+
+	// shrinking from the end
+	fail_unless(simple_vector_truncate(sv, 143) == -1);
+	fail_unless(simple_vector_truncate(sv, 10) == 0);
+	fail_unless(simple_vector_size(sv) == 10);
+	fail_unless(simple_vector_get_range(sv, 9, 2, out) == -1);
+	fail_unless(simple_vector_truncate(sv, 0) == 0);
+	fail_unless(simple_vector_size(sv) == 0);
+
+	simple_vector_free(sv, 0, NULL);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_simple_vector_range_overlap)
+START_TEST(test_simple_vector_range_overlap)
+{
+	simple_vector_t *sv;
+	uint32_t expect[200];
+	size_t i;
+
+	for (i = 0; i < 100; i++) {
+		expect[i] = i;
+	}
+
+	sv = u32_vector_new(128);
+	fail_unless(simple_vector_append_n(sv, expect, 100) == 0);
+
+	// ranges of the vector put over themselves, shifted up, then down
+	fail_unless(simple_vector_put_range(sv, 10, 50, u32_vector_data(sv) + 5) == 0);
+	memmove(expect + 10, expect + 5, 50 * sizeof(uint32_t));
+	fail_unless(memcmp(u32_vector_data(sv), expect, 100 * sizeof(uint32_t)) == 0);
+	fail_unless(simple_vector_put_range(sv, 0, 50, u32_vector_data(sv) + 20) == 0);
+	memmove(expect, expect + 20, 50 * sizeof(uint32_t));
+	fail_unless(memcmp(u32_vector_data(sv), expect, 100 * sizeof(uint32_t)) == 0);
+
+	// and appended to itself, which has to reallocate under the source
+	fail_unless(simple_vector_append_n(sv, u32_vector_data(sv), 100) == 0);
+	memcpy(expect + 100, expect, 100 * sizeof(uint32_t));
+	fail_unless(u32_vector_size(sv) == 200 && simple_vector_capacity(sv) >= 200);
+	fail_unless(memcmp(u32_vector_data(sv), expect, 200 * sizeof(uint32_t)) == 0);
+
+	// a range straddling the end, put from inside the vector past it
+	fail_unless(simple_vector_put_range(sv, 150, 100, u32_vector_data(sv) + 100) == 0);
+	fail_unless(u32_vector_size(sv) == 250);
+	for (i = 0; i < 100; i++) {
+		fail_unless(u32_vector_at(sv, 150 + i) == expect[100 + i]);
+	}
+
+	simple_vector_free(sv, 0, NULL);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_simple_vector_inline)
+START_TEST(test_simple_vector_inline)
+{
+	simple_vector_t *sv;
+	size_t i, inline_capacity = SIMPLE_VECTOR_INLINE_SIZE / sizeof(uint32_t);
+
+	// anything that fits starts in the inline buffer at its full size
+	sv = u32_vector_new(1);
+	fail_unless(sv->elements == sv->inline_elements.bytes);
+	fail_unless(simple_vector_capacity(sv) == inline_capacity);
+	for (i = 0; i < inline_capacity; i++) {
+		fail_unless(u32_vector_append(sv, 1000 + i) == 0);
+	}
+	fail_unless(sv->elements == sv->inline_elements.bytes);
+
+	// one more moves it all out to the heap
+	fail_unless(u32_vector_append(sv, 1000 + i) == 0);
+	fail_unless(sv->elements != sv->inline_elements.bytes);
+	fail_unless(simple_vector_capacity(sv) == 2 * inline_capacity);
+	for (i = 0; i <= inline_capacity; i++) {
+		fail_unless(u32_vector_at(sv, i) == 1000 + i);
+	}
+
+	// shrinking back to the inline size stays on the heap, and never
+	// below what is in use
+	fail_unless(simple_vector_resize(sv, inline_capacity) == -1);
+	fail_unless(simple_vector_truncate(sv, 3) == 0);
+	fail_unless(simple_vector_resize(sv, inline_capacity) == 0);
+	fail_unless(simple_vector_capacity(sv) == inline_capacity);
+	fail_unless(simple_vector_resize(sv, 3) == 0);
+	fail_unless(simple_vector_capacity(sv) == 3);
+	for (i = 0; i < 3; i++) {
+		fail_unless(u32_vector_at(sv, i) == 1000 + i);
+	}
+	simple_vector_free(sv, 0, NULL);
+
+	// reserving within the inline buffer is free, past it moves out once
+	sv = u32_vector_new(0);
+	fail_unless(simple_vector_append_n(sv, NULL, 5) == 0);
+	u32_vector_set(sv, 4, 7);
+	fail_unless(simple_vector_reserve(sv, inline_capacity) == 0);
+	fail_unless(sv->elements == sv->inline_elements.bytes);
+	fail_unless(simple_vector_reserve(sv, 100) == 0);
+	fail_unless(sv->elements != sv->inline_elements.bytes);
+	fail_unless(simple_vector_capacity(sv) == 100);
+	fail_unless(u32_vector_size(sv) == 5 && u32_vector_at(sv, 4) == 7);
+	simple_vector_free(sv, 0, NULL);
+
+	// elements too large for the buffer never use it
+	sv = simple_vector_new(1, SIMPLE_VECTOR_INLINE_SIZE + 1);
+	fail_unless(sv->elements != sv->inline_elements.bytes);
+	fail_unless(simple_vector_capacity(sv) == 1);
+	simple_vector_free(sv, 0, NULL);
+}
+END_TEST // }}}
+// {{{ START_TEST(test_simple_vector_growth)
+START_TEST(test_simple_vector_growth)
+{
+	// the capacities appending one at a time passes through, from 16
+	static const size_t doubled[] = { 16, 32, 64, 128, 256 };
+	static const size_t half[] = { 16, 25, 38, 58, 88, 133, 200, 301 };
+	static const size_t fixed[] = { 16, 26, 36, 46, 56, 66 };
+	static const struct {
+		simple_vector_growth_t growth;
+		size_t increment;
+		const size_t *capacities;
+		size_t count;
+	} policies[] = {
+		{ SIMPLE_VECTOR_GROW_DOUBLE, 0, doubled, sizeof(doubled) / sizeof(doubled[0]) },
+		{ SIMPLE_VECTOR_GROW_HALF, 0, half, sizeof(half) / sizeof(half[0]) },
+		{ SIMPLE_VECTOR_GROW_FIXED, 10, fixed, sizeof(fixed) / sizeof(fixed[0]) },
+	};
+	size_t seen[16], i, count, n, last;
+	simple_vector_t *sv;
+
+	for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+		sv = u32_vector_new(0);
+		fail_unless(simple_vector_set_growth(sv, policies[i].growth, policies[i].increment) == 0);
+		seen[0] = simple_vector_capacity(sv);
+		last = policies[i].capacities[policies[i].count - 1];
+		for (n = 0, count = 1; n < last; n++) {
+			fail_unless(u32_vector_append(sv, n) == 0);
+			if (simple_vector_capacity(sv) != seen[count - 1]) {
+				fail_unless(count < sizeof(seen) / sizeof(seen[0]));
+				seen[count++] = simple_vector_capacity(sv);
+			}
+		}
+		fail_unless(count == policies[i].count);
+		fail_unless(memcmp(seen, policies[i].capacities, count * sizeof(size_t)) == 0);
+		simple_vector_free(sv, 0, NULL);
+	}
+
+	// exact growth gives just what is asked for
+	sv = u32_vector_new(0);
+	fail_unless(simple_vector_set_growth(sv, SIMPLE_VECTOR_GROW_EXACT, 0) == 0);
+	for (n = 0; n < 40; n++) {
+		fail_unless(u32_vector_append(sv, n) == 0);
+		fail_unless(simple_vector_capacity(sv) == (n < 16 ? 16 : n + 1));
+	}
+
+	// a request past the policy's step is met in full
+	fail_unless(simple_vector_set_growth(sv, SIMPLE_VECTOR_GROW_FIXED, 10) == 0);
+	fail_unless(simple_vector_reserve(sv, 45) == 0);
+	fail_unless(simple_vector_capacity(sv) == 50);
+	fail_unless(simple_vector_reserve(sv, 1000) == 0);
+	fail_unless(simple_vector_capacity(sv) == 1000);
+	fail_unless(simple_vector_set_growth(sv, SIMPLE_VECTOR_GROW_FIXED, 0) == -1);
+	simple_vector_free(sv, 0, NULL);
+}
+END_TEST // }}}
+
+// Concurrent test cases
+#define CONCURRENT_THREADS 8
+#define CONCURRENT_APPENDS 20000
+
+struct concurrent_appender {
+	concurrent_vector_t *cv;
+	atomic_int *finished;
+	uint64_t id;
+	size_t offsets[CONCURRENT_APPENDS];
+	int failed;
+};
+
+// {{{ static void *concurrent_append_thread(void *arg)
+static void *concurrent_append_thread(void *arg) {
+
+	struct concurrent_appender *appender = arg;
+	uint64_t value;
+	size_t i;
+
+	// values say who wrote them and when, and are never zero
+	for (i = 0; i < CONCURRENT_APPENDS; i++) {
+		value = appender->id << 32 | (i + 1);
+		if (concurrent_vector_append(appender->cv, &value, &appender->offsets[i]) == -1) {
+			appender->failed = 1;
+		}
+	}
+
+	atomic_fetch_add(appender->finished, 1);
+	return NULL;
+
+} // }}}
+// {{{ START_TEST(test_concurrent_vector_threads)
+START_TEST(test_concurrent_vector_threads)
+{
+	static struct concurrent_appender appenders[CONCURRENT_THREADS];
+	size_t total = CONCURRENT_THREADS * CONCURRENT_APPENDS, size, seen, i, j;
+	pthread_t threads[CONCURRENT_THREADS];
+	concurrent_vector_t *cv;
+	unsigned char *claimed;
+	atomic_int finished;
+	uint64_t value;
+	int done;
+
+	cv = concurrent_vector_new(sizeof(uint64_t));
+	atomic_init(&finished, 0);
+	for (i = 0; i < CONCURRENT_THREADS; i++) {
+		appenders[i].cv = cv;
+		appenders[i].finished = &finished;
+		appenders[i].id = i + 1;
+		appenders[i].failed = 0;
+		fail_unless(pthread_create(&threads[i], NULL, concurrent_append_thread, &appenders[i]) == 0);
+	}
+
+	// whatever size a reader sees is written all the way up to it
+	for (seen = 0, done = 0; !done; seen = size) {
+		done = atomic_load(&finished) == CONCURRENT_THREADS;
+		size = concurrent_vector_size(cv);
+		fail_unless(size >= seen && size <= total);
+		for (i = seen; i < size; i++) {
+			fail_unless(concurrent_vector_get(cv, i, &value) == 0 && value != 0);
+		}
+	}
+
+	for (i = 0; i < CONCURRENT_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		fail_unless(!appenders[i].failed);
+	}
+
+	// every offset handed out exactly once, holding what was appended
+	fail_unless(concurrent_vector_size(cv) == total);
+	claimed = calloc(total, 1);
+	for (i = 0; i < CONCURRENT_THREADS; i++) {
+		for (j = 0; j < CONCURRENT_APPENDS; j++) {
+			fail_unless(appenders[i].offsets[j] < total && !claimed[appenders[i].offsets[j]]);
+			claimed[appenders[i].offsets[j]] = 1;
+			fail_unless(concurrent_vector_get(cv, appenders[i].offsets[j], &value) == 0);
+			fail_unless(value == (appenders[i].id << 32 | (j + 1)));
+			fail_unless(j == 0 || appenders[i].offsets[j] > appenders[i].offsets[j - 1]);
+		}
+	}
+	free(claimed);
+
+	concurrent_vector_free(cv);
+}
+END_TEST // }}}
+// {{{ static void *failing_alloc(void *ctx, size_t size)
+static void *failing_alloc(void *ctx, size_t size) {
+
+	// ctx counts down the allocations still allowed
+	int *left = ctx;
+
+	if (*left == 0) {
+		return NULL;
+	}
+	(*left)--;
+	return malloc(size);
+
+} // }}}
+// {{{ static void *failing_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+static void *failing_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+	(void) ctx;
+	(void) old_size;
+	return realloc(ptr, new_size);
+} // }}}
+// {{{ static void failing_free(void *ctx, void *ptr, size_t size)
+static void failing_free(void *ctx, void *ptr, size_t size) {
+	(void) ctx;
+	(void) size;
+	free(ptr);
+} // }}}
+// {{{ START_TEST(test_concurrent_vector_alloc_failure)
+START_TEST(test_concurrent_vector_alloc_failure)
+{
+	simple_vector_allocator_t allocator = { failing_alloc, failing_realloc, failing_free, NULL };
+	concurrent_vector_t *cv;
+	uint32_t value;
+	size_t offset, i;
+	int left = 2;
+
+	// room for the vector and its first segment, not the second
+	allocator.ctx = &left;
+	cv = concurrent_vector_new_allocator(sizeof(uint32_t), &allocator);
+	fail_unless(cv != NULL);
+	for (i = 0; i < 1024; i++) {
+		value = i;
+		fail_unless(concurrent_vector_append(cv, &value, &offset) == 0 && offset == i);
+	}
+
+	// a failed append claims no slot, so it leaves no hole behind
+	errno = 0;
+	fail_unless(concurrent_vector_append(cv, &value, &offset) == -1 && errno == ENOMEM);
+	fail_unless(concurrent_vector_append(cv, &value, &offset) == -1);
+	fail_unless(concurrent_vector_size(cv) == 1024);
+	fail_unless(concurrent_vector_get(cv, 1024, &value) == -1);
+
+	left = 1;
+	value = 1024;
+	fail_unless(concurrent_vector_append(cv, &value, &offset) == 0 && offset == 1024);
+	fail_unless(concurrent_vector_size(cv) == 1025);
+	fail_unless(concurrent_vector_get(cv, 1024, &value) == 0 && value == 1024);
+
+	concurrent_vector_free(cv);
+
+	// and none at all for the vector itself
+	left = 0;
+	fail_unless(concurrent_vector_new_allocator(sizeof(uint32_t), &allocator) == NULL);
+}
+END_TEST // }}}
+// {{{ static void *refusing_alloc(void *ctx, size_t size)
+static void *refusing_alloc(void *ctx, size_t size) {
+
+	// ctx counts down the allocations still to refuse, from any thread
+	atomic_int *refusals = ctx;
+
+	if (atomic_fetch_sub(refusals, 1) > 0) {
+		return NULL;
+	}
+	return malloc(size);
+
+} // }}}
+// {{{ static void *concurrent_refused_thread(void *arg)
+static void *concurrent_refused_thread(void *arg) {
+
+	struct concurrent_appender *appender = arg;
+	uint64_t value;
+	size_t i;
+
+	// offsets holds the successful appends only, failed counts the rest
+	for (i = 0; i < CONCURRENT_APPENDS; i++) {
+		value = appender->id << 32 | (i + 1);
+		if (concurrent_vector_append(appender->cv, &value,
+				&appender->offsets[i - appender->failed]) == -1) {
+			appender->failed++;
+		}
+	}
+
+	return NULL;
+
+} // }}}
+// {{{ START_TEST(test_concurrent_vector_alloc_contention)
+START_TEST(test_concurrent_vector_alloc_contention)
+{
+	static struct concurrent_appender appenders[CONCURRENT_THREADS];
+	simple_vector_allocator_t allocator = { refusing_alloc, failing_realloc, failing_free, NULL };
+	pthread_t threads[CONCURRENT_THREADS];
+	concurrent_vector_t *cv;
+	atomic_int refusals;
+	size_t appended = 0, failed = 0, i;
+	uint64_t value;
+
+	// the vector itself, then segments refused until the count runs out
+	atomic_init(&refusals, 0);
+	allocator.ctx = &refusals;
+	cv = concurrent_vector_new_allocator(sizeof(uint64_t), &allocator);
+	fail_unless(cv != NULL);
+	atomic_store(&refusals, 200);
+	for (i = 0; i < CONCURRENT_THREADS; i++) {
+		appenders[i].cv = cv;
+		appenders[i].id = i + 1;
+		appenders[i].failed = 0;
+		fail_unless(pthread_create(&threads[i], NULL, concurrent_refused_thread, &appenders[i]) == 0);
+	}
+	for (i = 0; i < CONCURRENT_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		appended += CONCURRENT_APPENDS - appenders[i].failed;
+		failed += appenders[i].failed;
+	}
+
+	// failed appends took no slot with them: the size is exactly the
+	// successful ones, and every slot below it holds a value
+	fail_unless(failed > 0);
+	fail_unless(concurrent_vector_size(cv) == appended);
+	for (i = 0; i < appended; i++) {
+		fail_unless(concurrent_vector_get(cv, i, &value) == 0 && value != 0);
+	}
+
+	concurrent_vector_free(cv);
+}
+END_TEST // }}}
+
+// {{{ Suite *simple_vector_suite() {
+Suite *simple_vector_suite() {
+
+	Suite *s = suite_create("SimpleVector");
+
+	// {{{ Core test case
+	TCase *tc_core = tcase_create("Core");
+	tcase_add_test(tc_core, test_simple_vector_range_empty);
+	tcase_add_test(tc_core, test_simple_vector_range_end);
+	tcase_add_test(tc_core, test_simple_vector_range_overlap);
+	tcase_add_test(tc_core, test_simple_vector_inline);
+	tcase_add_test(tc_core, test_simple_vector_growth);
+	suite_add_tcase(s, tc_core);
+	// }}}
+
+	// {{{ Concurrent test case
+	TCase *tc_concurrent = tcase_create("Concurrent");
+	tcase_set_timeout(tc_concurrent, 60);
+	tcase_add_test(tc_concurrent, test_concurrent_vector_threads);
+	tcase_add_test(tc_concurrent, test_concurrent_vector_alloc_failure);
+	tcase_add_test(tc_concurrent, test_concurrent_vector_alloc_contention);
+	suite_add_tcase(s, tc_concurrent);
+	// }}}
+
+	return s;
+
+} // }}}
+
+// {{{ int main (void)
+int main (void)
+{
+	int number_failed;
+	Suite *s = simple_vector_suite();
+	SRunner *sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+} // }}}
+
+// vim: fdm=marker ts=4